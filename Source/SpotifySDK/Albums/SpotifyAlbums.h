@@ -0,0 +1,115 @@
+﻿// Copyright (c) Harris Barra. (MIT License)
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "MultiIdRequest.h"
+#include "RequestUtils.h"
+#include "SpotifyAlbums.generated.h"
+
+USTRUCT(BlueprintType)
+struct FAlbumProfile
+{
+	GENERATED_BODY()
+
+public:
+	UPROPERTY(BlueprintReadWrite)
+	FString Name;
+	UPROPERTY(BlueprintReadWrite)
+	FString AlbumId;
+	// album, single or compilation.
+	UPROPERTY(BlueprintReadWrite)
+	FString AlbumType;
+	UPROPERTY(BlueprintReadWrite)
+	FString ReleaseDate;
+	UPROPERTY(BlueprintReadWrite)
+	int TrackCount = 0;
+	UPROPERTY(BlueprintReadWrite)
+	int Popularity = 0;
+	UPROPERTY(BlueprintReadWrite)
+	FString Label;
+	UPROPERTY(BlueprintReadWrite)
+	TArray<FString> Artists;
+	// Cover art at every size Spotify provides, widest first.
+	UPROPERTY(BlueprintReadWrite)
+	TArray<FString> ImgUrls;
+};
+
+class FSpotifyAlbums
+{
+public:
+	/**
+	 * Requests the album details of many albums.
+	 * The ids are split into chunks of the endpoint's batch limit (20), which are requested concurrently.
+	 * ENDPOINT: https://developer.spotify.com/documentation/web-api/reference/get-multiple-albums
+	 * @param UserToken The access token for the Spotify user.
+	 * @param AlbumIds The IDs of the Spotify albums.
+	 * @param Callback A function that will be called with the albums (in the same order as AlbumIds) and the IDs that failed or were not found.
+	 * @param MaxConcurrentRequests The maximum number of chunk requests in flight.
+	 * @param OnFailure An optional function that will be called with the first error before Callback if any chunk failed.
+	 * @return A handle to cancel the request.
+	 */
+	static FSpotifyRequestHandle RequestAlbums(const FString& UserToken, const TArray<FString>& AlbumIds, TFunction<void(const TArray<FAlbumProfile>& Albums, const TArray<FString>& FailedAlbumIds)> Callback, const int MaxConcurrentRequests = 4, TFunction<void(const FSpotifyError& Error)> OnFailure = nullptr)
+	{
+		return FMultiIdRequest::Run<FAlbumProfile>(UserToken, TEXT("albums"), AlbumIds, AlbumsChunkSize, MaxConcurrentRequests, &ParseAlbums, Callback, OnFailure);
+	}
+
+	/**
+	 * Parses a response of the several albums endpoint, unknown ids (null entries) are left unset.
+	 * @param ResponseStr The raw response body.
+	 * @param OutAlbums The array the parsed albums are appended to, one entry per requested id.
+	 * @return False if the response was not valid JSON.
+	 */
+	static bool ParseAlbums(const FString& ResponseStr, TArray<TOptional<FAlbumProfile>>& OutAlbums)
+	{
+		TSharedPtr<FJsonObject> ResponseObject;
+		if (!FRequestUtils::ParseResponseString(ResponseStr, ResponseObject))
+		{
+			return false;
+		}
+
+		TArray<TSharedPtr<FJsonValue>> AlbumsArray;
+		FRequestUtils::GetArrayEntry(ResponseObject, "albums", AlbumsArray);
+		OutAlbums.Reserve(OutAlbums.Num() + AlbumsArray.Num());
+
+		for (const TSharedPtr<FJsonValue>& AlbumValue : AlbumsArray)
+		{
+			TOptional<FAlbumProfile>& Album = OutAlbums.AddDefaulted_GetRef();
+
+			const TSharedPtr<FJsonObject>* AlbumObject = nullptr;
+			if (!AlbumValue.IsValid() || !AlbumValue->TryGetObject(AlbumObject))
+			{
+				continue;
+			}
+
+			FAlbumProfile& Profile = Album.Emplace();
+			FRequestUtils::GetFieldEntry(*AlbumObject, "name", Profile.Name);
+			FRequestUtils::GetFieldEntry(*AlbumObject, "id", Profile.AlbumId);
+			FRequestUtils::GetFieldEntry(*AlbumObject, "album_type", Profile.AlbumType);
+			FRequestUtils::GetFieldEntry(*AlbumObject, "release_date", Profile.ReleaseDate);
+			FRequestUtils::GetFieldEntry(*AlbumObject, "total_tracks", Profile.TrackCount);
+			FRequestUtils::GetFieldEntry(*AlbumObject, "popularity", Profile.Popularity);
+			FRequestUtils::GetFieldEntry(*AlbumObject, "label", Profile.Label);
+
+			TArray<TSharedPtr<FJsonValue>> ArtistsArray;
+			FRequestUtils::GetArrayEntry(*AlbumObject, "artists", ArtistsArray);
+			for (const TSharedPtr<FJsonValue>& ArtistValue : ArtistsArray)
+			{
+				FRequestUtils::GetFieldEntry(ArtistValue, "name", Profile.Artists.AddDefaulted_GetRef());
+			}
+
+			TArray<TSharedPtr<FJsonValue>> ImagesArray;
+			FRequestUtils::GetArrayEntry(*AlbumObject, "images", ImagesArray);
+			for (int32 Index = 0; Index < ImagesArray.Num(); ++Index)
+			{
+				FRequestUtils::GetFieldEntryAtIndex(ImagesArray, "url", Index, Profile.ImgUrls.AddDefaulted_GetRef());
+			}
+		}
+
+		return true;
+	}
+
+private:
+	// Maximum number of ids accepted by the several albums endpoint.
+	static constexpr int32 AlbumsChunkSize = 20;
+};
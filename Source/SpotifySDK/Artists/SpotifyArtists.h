@@ -0,0 +1,103 @@
+﻿// Copyright (c) Harris Barra. (MIT License)
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "MultiIdRequest.h"
+#include "RequestUtils.h"
+#include "SpotifyArtists.generated.h"
+
+USTRUCT(BlueprintType)
+struct FArtistProfile
+{
+	GENERATED_BODY()
+
+public:
+	UPROPERTY(BlueprintReadWrite)
+	FString Name;
+	UPROPERTY(BlueprintReadWrite)
+	FString ArtistId;
+	UPROPERTY(BlueprintReadWrite)
+	TArray<FString> Genres;
+	UPROPERTY(BlueprintReadWrite)
+	int Followers = 0;
+	UPROPERTY(BlueprintReadWrite)
+	int Popularity = 0;
+	// Artist images at every size Spotify provides, widest first.
+	UPROPERTY(BlueprintReadWrite)
+	TArray<FString> ImgUrls;
+};
+
+class FSpotifyArtists
+{
+public:
+	/**
+	 * Requests the artist details of many artists.
+	 * The ids are split into chunks of the endpoint's batch limit (50), which are requested concurrently.
+	 * ENDPOINT: https://developer.spotify.com/documentation/web-api/reference/get-multiple-artists
+	 * @param UserToken The access token for the Spotify user.
+	 * @param ArtistIds The IDs of the Spotify artists.
+	 * @param Callback A function that will be called with the artists (in the same order as ArtistIds) and the IDs that failed or were not found.
+	 * @param MaxConcurrentRequests The maximum number of chunk requests in flight.
+	 * @param OnFailure An optional function that will be called with the first error before Callback if any chunk failed.
+	 * @return A handle to cancel the request.
+	 */
+	static FSpotifyRequestHandle RequestArtists(const FString& UserToken, const TArray<FString>& ArtistIds, TFunction<void(const TArray<FArtistProfile>& Artists, const TArray<FString>& FailedArtistIds)> Callback, const int MaxConcurrentRequests = 4, TFunction<void(const FSpotifyError& Error)> OnFailure = nullptr)
+	{
+		return FMultiIdRequest::Run<FArtistProfile>(UserToken, TEXT("artists"), ArtistIds, ArtistsChunkSize, MaxConcurrentRequests, &ParseArtists, Callback, OnFailure);
+	}
+
+	/**
+	 * Parses a response of the several artists endpoint, unknown ids (null entries) are left unset.
+	 * @param ResponseStr The raw response body.
+	 * @param OutArtists The array the parsed artists are appended to, one entry per requested id.
+	 * @return False if the response was not valid JSON.
+	 */
+	static bool ParseArtists(const FString& ResponseStr, TArray<TOptional<FArtistProfile>>& OutArtists)
+	{
+		TSharedPtr<FJsonObject> ResponseObject;
+		if (!FRequestUtils::ParseResponseString(ResponseStr, ResponseObject))
+		{
+			return false;
+		}
+
+		TArray<TSharedPtr<FJsonValue>> ArtistsArray;
+		FRequestUtils::GetArrayEntry(ResponseObject, "artists", ArtistsArray);
+		OutArtists.Reserve(OutArtists.Num() + ArtistsArray.Num());
+
+		for (const TSharedPtr<FJsonValue>& ArtistValue : ArtistsArray)
+		{
+			TOptional<FArtistProfile>& Artist = OutArtists.AddDefaulted_GetRef();
+
+			const TSharedPtr<FJsonObject>* ArtistObject = nullptr;
+			if (!ArtistValue.IsValid() || !ArtistValue->TryGetObject(ArtistObject))
+			{
+				continue;
+			}
+
+			FArtistProfile& Profile = Artist.Emplace();
+			FRequestUtils::GetFieldEntry(*ArtistObject, "name", Profile.Name);
+			FRequestUtils::GetFieldEntry(*ArtistObject, "id", Profile.ArtistId);
+			FRequestUtils::GetFieldEntry(*ArtistObject, "popularity", Profile.Popularity);
+
+			TSharedPtr<FJsonObject> FollowersObject;
+			FRequestUtils::GetObjectEntry(*ArtistObject, "followers", FollowersObject);
+			FRequestUtils::GetFieldEntry(FollowersObject, "total", Profile.Followers);
+
+			(*ArtistObject)->TryGetStringArrayField(TEXT("genres"), Profile.Genres);
+
+			TArray<TSharedPtr<FJsonValue>> ImagesArray;
+			FRequestUtils::GetArrayEntry(*ArtistObject, "images", ImagesArray);
+			for (int32 Index = 0; Index < ImagesArray.Num(); ++Index)
+			{
+				FRequestUtils::GetFieldEntryAtIndex(ImagesArray, "url", Index, Profile.ImgUrls.AddDefaulted_GetRef());
+			}
+		}
+
+		return true;
+	}
+
+private:
+	// Maximum number of ids accepted by the several artists endpoint.
+	static constexpr int32 ArtistsChunkSize = 50;
+};
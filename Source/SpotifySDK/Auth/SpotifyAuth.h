@@ -2,9 +2,58 @@
 
 #pragma once
 
+#include "CoreMinimal.h"
+#include "Containers/Ticker.h"
+#include "GenericPlatform/GenericPlatformHttp.h"
+#include "Misc/Base64.h"
+#include "Misc/DateTime.h"
+#include "Misc/ScopeLock.h"
+#include "Misc/ScopeRWLock.h"
+#include "RequestScheduler.h"
+#include "RequestUtils.h"
+#include "SpotifyHttpClient.h"
+
+/**
+ * An immutable snapshot of the user's credentials, replaced as a whole whenever the token changes.
+ */
+struct FSpotifyAccessToken
+{
+	FString AccessToken;
+	// The "Bearer <token>" header value, built once here and shared by every request sent with the token.
+	TSharedRef<const FString, ESPMode::ThreadSafe> AuthorizationHeader = MakeShared<const FString, ESPMode::ThreadSafe>();
+	FString RefreshToken;
+	// UTC, MaxValue if the expiry is unknown.
+	FDateTime ExpiresAt = FDateTime::MaxValue();
+};
+
 class FSpotifyAuth
 {
 public:
+	// Every request reads the token, so reads never wait on a refresh: readers grab a reference to the
+	// current snapshot under a shared lock and writers publish a new snapshot instead of mutating it.
+	// With a refresh token the access token is renewed shortly before it expires, and the request
+	// scheduler calls RefreshAccessToken when a request is rejected with a 401 anyway.
+
+	~FSpotifyAuth()
+	{
+		FHttpRequestPtr PendingRequest;
+		{
+			FScopeLock Lock(&RefreshMutex);
+			if (TickerHandle.IsValid())
+			{
+				FTSTicker::GetCoreTicker().RemoveTicker(TickerHandle);
+			}
+			PendingRequest = MoveTemp(RefreshRequest);
+		}
+
+		// The completion of a refresh still in flight captures this, it must never run.
+		if (PendingRequest.IsValid())
+		{
+			PendingRequest->OnProcessRequestComplete().Unbind();
+			PendingRequest->CancelRequest();
+		}
+	}
+
 	/**
 	 * Get the Client ID for the Spotify App.
 	 * @return A reference to the Client ID string.
@@ -21,17 +70,228 @@ public:
 	 * Get the Logged-in Spotify User Access Token.
 	 * This token is given after the user has agreed authentication and
 	 * serves as the primary bearer for all higher-level endpoint calls.
-	 * @return A reference to the User Token string.
+	 * @return A copy of the User Token string, safe to read from any thread.
+	 */
+	FString GetSpotifyUserToken() const { return GetAccessToken()->AccessToken; }
+
+	/**
+	 * Get the current credentials snapshot.
 	 */
-	const FString& GetSpotifyUserToken() { return SpotifyUserToken; }
-	void UpdateSpotifyUserToken(const FString& Token) { SpotifyUserToken = Token; }
+	TSharedRef<const FSpotifyAccessToken, ESPMode::ThreadSafe> GetAccessToken() const
+	{
+		FReadScopeLock Lock(TokenLock);
+		return Token;
+	}
+
+	/**
+	 * Replaces the access token without a refresh token, so it is not renewed.
+	 * Any refresh token that was set before is dropped, the new token may belong to another user.
+	 */
+	void UpdateSpotifyUserToken(const FString& AccessToken)
+	{
+		UpdateSpotifyUserToken(AccessToken, FString(), 0);
+	}
+
+	/**
+	 * Sets the user's credentials as returned by the token endpoint.
+	 * @param AccessToken The access token for the Spotify user.
+	 * @param RefreshToken The refresh token, if set the access token is renewed before it expires.
+	 * @param ExpiresInSeconds The lifetime of the access token, 0 if unknown.
+	 */
+	void UpdateSpotifyUserToken(const FString& AccessToken, const FString& RefreshToken, const int32 ExpiresInSeconds)
+	{
+		SetCredentials(AccessToken, RefreshToken, ExpiresInSeconds);
+	}
+
+	/**
+	 * Renews the access token with the refresh token.
+	 * Concurrent calls share a single request to the token endpoint.
+	 * ENDPOINT: https://developer.spotify.com/documentation/web-api/tutorials/refreshing-tokens
+	 * @param OnComplete A function that will be called with whether a new token was published.
+	 */
+	void RefreshAccessToken(TFunction<void(bool bRefreshed)> OnComplete = nullptr)
+	{
+		const FString RefreshToken = GetAccessToken()->RefreshToken;
+		if (RefreshToken.IsEmpty())
+		{
+			if (OnComplete)
+			{
+				OnComplete(false);
+			}
+			return;
+		}
+
+		{
+			FScopeLock Lock(&RefreshMutex);
+			if (OnComplete)
+			{
+				PendingRefreshCallbacks.Add(MoveTemp(OnComplete));
+			}
+			if (bRefreshing)
+			{
+				return;
+			}
+			bRefreshing = true;
+		}
+
+		const FString Content = FString::Printf(TEXT("grant_type=refresh_token&refresh_token=%s"), *FGenericPlatformHttp::UrlEncode(RefreshToken));
+		TSharedRef<IHttpRequest> HttpRequest = FRequestUtils::CreatePOSTRequest(TokenUrl, Content);
+		HttpRequest->SetHeader(TEXT("Authorization"), TEXT("Basic ") + FBase64::Encode(ClientId + TEXT(":") + ClientSecret));
+
+		HttpRequest->OnProcessRequestComplete().BindLambda([this, RefreshToken](FHttpRequestPtr Request, FHttpResponsePtr Response, bool bConnectedSuccessfully)
+		{
+			// Unbound by the destructor, so this is still alive here.
+			bool bRefreshed = false;
+			if (bConnectedSuccessfully && Response.IsValid() && Response->GetResponseCode() == 200)
+			{
+				TSharedPtr<FJsonObject> ResponseObject;
+				FString AccessToken;
+				if (FRequestUtils::ParseResponseString(Response->GetContentAsString(), ResponseObject)
+					&& FRequestUtils::GetFieldEntry(ResponseObject, "access_token", AccessToken))
+				{
+					// Spotify may or may not rotate the refresh token.
+					FString NewRefreshToken = RefreshToken;
+					FRequestUtils::GetFieldEntry(ResponseObject, "refresh_token", NewRefreshToken);
+					int ExpiresIn = 0;
+					FRequestUtils::GetFieldEntry(ResponseObject, "expires_in", ExpiresIn);
+
+					// The credentials may have been replaced while the refresh was in flight, the result is then stale.
+					bRefreshed = SetCredentials(AccessToken, NewRefreshToken, ExpiresIn, &RefreshToken);
+					if (!bRefreshed)
+					{
+						UE_LOG(LogTemp, Warning, TEXT("Spotify credentials changed during the token refresh, dropping the refreshed token"));
+					}
+				}
+			}
+
+			if (!bRefreshed)
+			{
+				UE_LOG(LogTemp, Error, TEXT("Spotify access token refresh failed!!!"));
+				if (Response.IsValid())
+				{
+					UE_LOG(LogTemp, Error, TEXT("Request Error (%d): %s"), Response->GetResponseCode(), *Response->GetContentAsString());
+				}
+			}
+
+			TArray<TFunction<void(bool bRefreshed)>> Callbacks;
+			{
+				FScopeLock Lock(&RefreshMutex);
+				bRefreshing = false;
+				RefreshRequest.Reset();
+				Callbacks = MoveTemp(PendingRefreshCallbacks);
+			}
+			for (const TFunction<void(bool bRefreshed)>& Callback : Callbacks)
+			{
+				Callback(bRefreshed);
+			}
+		});
+
+		{
+			FScopeLock Lock(&RefreshMutex);
+			RefreshRequest = HttpRequest;
+		}
+		HttpRequest->ProcessRequest();
+	}
+
+	/**
+	 * Sets how long before expiry the access token is renewed.
+	 */
+	void SetRefreshMargin(const FTimespan InRefreshMargin)
+	{
+		FScopeLock Lock(&RefreshMutex);
+		RefreshMargin = InRefreshMargin;
+	}
 
 private:
+	/**
+	 * @param RefreshedWith The refresh token the access token was renewed with, i.e. it belongs to the same user.
+	 * Null if the credentials were set from outside.
+	 * @return False if the token was refreshed but the credentials were replaced in the meantime, nothing is published then.
+	 */
+	bool SetCredentials(const FString& AccessToken, const FString& RefreshToken, const int32 ExpiresInSeconds, const FString* RefreshedWith = nullptr)
+	{
+		TSharedRef<FSpotifyAccessToken, ESPMode::ThreadSafe> NewToken = MakeShared<FSpotifyAccessToken, ESPMode::ThreadSafe>();
+		NewToken->AccessToken = AccessToken;
+		NewToken->AuthorizationHeader = MakeShared<const FString, ESPMode::ThreadSafe>(TEXT("Bearer ") + AccessToken);
+		NewToken->RefreshToken = RefreshToken;
+		if (ExpiresInSeconds > 0)
+		{
+			NewToken->ExpiresAt = FDateTime::UtcNow() + FTimespan::FromSeconds(ExpiresInSeconds);
+		}
+		if (!PublishToken(NewToken, RefreshedWith))
+		{
+			return false;
+		}
+
+		FScopeLock Lock(&RefreshMutex);
+		if (!RefreshToken.IsEmpty() && !TickerHandle.IsValid())
+		{
+			TickerHandle = FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateRaw(this, &FSpotifyAuth::Tick), RefreshCheckInterval);
+		}
+		return true;
+	}
+
+	bool PublishToken(const TSharedRef<const FSpotifyAccessToken, ESPMode::ThreadSafe>& NewToken, const FString* RefreshedWith)
+	{
+		const bool bRefreshed = RefreshedWith != nullptr;
+		TSharedRef<const FSpotifyAccessToken, ESPMode::ThreadSafe> OldToken = NewToken;
+		{
+			FWriteScopeLock Lock(TokenLock);
+			// Checked under the lock, so a refresh can never overwrite credentials set while it was in flight.
+			if (bRefreshed && Token->RefreshToken != *RefreshedWith)
+			{
+				return false;
+			}
+			Swap(Token, OldToken);
+		}
+
+		// Requests that still carry the old token (pagination chains, in-flight requests) switch to the new one.
+		if (OldToken->AccessToken != NewToken->AccessToken)
+		{
+			// Only a refresh keeps the cache identity, a token set from outside may belong to another user.
+			FSpotifyHttpClient::Get().RotateToken(OldToken->AccessToken, NewToken->AccessToken, NewToken->AuthorizationHeader, bRefreshed);
+			FRequestScheduler::Get().NotifyTokenRefreshed();
+		}
+		return true;
+	}
+
+	bool Tick(float DeltaTime)
+	{
+		TSharedRef<const FSpotifyAccessToken, ESPMode::ThreadSafe> CurrentToken = GetAccessToken();
+		FTimespan Margin;
+		{
+			FScopeLock Lock(&RefreshMutex);
+			if (bRefreshing)
+			{
+				return true;
+			}
+			Margin = RefreshMargin;
+		}
+
+		if (!CurrentToken->RefreshToken.IsEmpty() && CurrentToken->ExpiresAt != FDateTime::MaxValue() && FDateTime::UtcNow() + Margin >= CurrentToken->ExpiresAt)
+		{
+			RefreshAccessToken();
+		}
+		return true;
+	}
+
 	FString ClientId = FString("...");
 	// This is the Client Secret for the Spotify App, which should be kept private.
 	// For security reasons, it is not recommended to hardcode this in the codebase.
 	// For Shipping, use a PKCE implementation instead!
 	FString ClientSecret = FString("...");
 
-	FString SpotifyUserToken;
+	static constexpr const TCHAR* TokenUrl = TEXT("https://accounts.spotify.com/api/token");
+	static constexpr float RefreshCheckInterval = 15.0f;
+
+	mutable FRWLock TokenLock;
+	TSharedRef<const FSpotifyAccessToken, ESPMode::ThreadSafe> Token = MakeShared<FSpotifyAccessToken, ESPMode::ThreadSafe>();
+
+	FCriticalSection RefreshMutex;
+	TArray<TFunction<void(bool bRefreshed)>> PendingRefreshCallbacks;
+	FTimespan RefreshMargin = FTimespan::FromMinutes(5.0);
+	bool bRefreshing = false;
+	// The token request in flight, kept so the destructor can cancel it.
+	FHttpRequestPtr RefreshRequest;
+	FTSTicker::FDelegateHandle TickerHandle;
 };
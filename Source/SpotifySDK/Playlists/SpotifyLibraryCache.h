@@ -0,0 +1,564 @@
+﻿// Copyright (c) Harris Barra. (MIT License)
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "AsyncDecode.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Misc/ScopeExit.h"
+#include "Misc/ScopeLock.h"
+#include "RequestBatcher.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+#include "SpotifySDK/Playlists/SpotifyPlaylists.h"
+
+struct FCachedPlaylist
+{
+	FPlaylistProfile Profile;
+	int TrackCount = 0;
+	// Shared with every other playlist (and the search index) holding the same track.
+	TArray<FTrackProfileRef> Tracks;
+};
+
+class FSpotifyLibraryCache
+{
+public:
+	// This is a persistent on-disk store of decoded playlists and their tracks.
+	// Records are versioned by the playlist snapshot_id, so on startup only playlists whose
+	// snapshot changed since the last session have to be refetched.
+	// The file is read in one bulk read and deserialized from memory.
+	// Large libraries have the same tracks in dozens of playlists, so every distinct track is held once:
+	// in memory playlists share immutable tracks (see ShareTracks), on disk they hold indices into a track table.
+	// Track callbacks update the store from worker threads, so every accessor takes the lock and hands out copies.
+
+	static FString GetDefaultPath()
+	{
+		return FPaths::ProjectSavedDir() / TEXT("SpotifySDK") / TEXT("Library.bin");
+	}
+
+	/**
+	 * Loads the store from disk, replacing any records held in memory.
+	 * @param Path The file to load from.
+	 * @return False if the file is missing, from an older format version or corrupted.
+	 */
+	bool Load(const FString& Path = GetDefaultPath())
+	{
+		TMap<FString, FCachedPlaylist> LoadedPlaylists;
+		ON_SCOPE_EXIT
+		{
+			FScopeLock Lock(&Mutex);
+			Playlists = MoveTemp(LoadedPlaylists);
+			bDirty = false;
+
+			SharedTracks.Reset();
+			for (const TPair<FString, FCachedPlaylist>& Pair : Playlists)
+			{
+				for (const FTrackProfileRef& Track : Pair.Value.Tracks)
+				{
+					SharedTracks.Add(Track->TrackId, Track);
+				}
+			}
+			NumSharedTracksAfterCompact = SharedTracks.Num();
+		};
+
+		TArray<uint8> Bytes;
+		if (!FFileHelper::LoadFileToArray(Bytes, *Path, FILEREAD_Silent))
+		{
+			return false;
+		}
+
+		FMemoryReader Reader(Bytes);
+
+		uint32 Magic = 0;
+		uint32 Version = 0;
+		Reader << Magic << Version;
+		if (Magic != FileMagic || Version != FileVersion)
+		{
+			return false;
+		}
+
+		TArray<FTrackProfileRef> Tracks;
+		int32 NumTracks = 0;
+		Reader << NumTracks;
+		// Every track takes at least one byte, so anything larger than the rest of the file is corrupt.
+		if (NumTracks < 0 || NumTracks > Reader.TotalSize() - Reader.Tell())
+		{
+			return false;
+		}
+
+		Tracks.Reserve(NumTracks);
+		for (int32 Index = 0; Index < NumTracks && !Reader.IsError(); ++Index)
+		{
+			FTrackProfile Track;
+			SerializeTrack(Reader, Track);
+			Tracks.Add(MakeShared<const FTrackProfile, ESPMode::ThreadSafe>(MoveTemp(Track)));
+		}
+
+		int32 NumPlaylists = 0;
+		Reader << NumPlaylists;
+		if (NumPlaylists < 0)
+		{
+			return false;
+		}
+
+		LoadedPlaylists.Reserve(NumPlaylists);
+		for (int32 Index = 0; Index < NumPlaylists && !Reader.IsError(); ++Index)
+		{
+			FCachedPlaylist Playlist;
+			SerializeProfile(Reader, Playlist);
+
+			int32 NumEntries = 0;
+			Reader << NumEntries;
+			if (NumEntries < 0 || NumEntries > (Reader.TotalSize() - Reader.Tell()) / static_cast<int64>(sizeof(int32)))
+			{
+				Reader.SetError();
+				break;
+			}
+
+			Playlist.Tracks.Reserve(NumEntries);
+			for (int32 Entry = 0; Entry < NumEntries; ++Entry)
+			{
+				int32 TrackIndex = INDEX_NONE;
+				Reader << TrackIndex;
+				if (!Tracks.IsValidIndex(TrackIndex))
+				{
+					Reader.SetError();
+					break;
+				}
+				Playlist.Tracks.Add(Tracks[TrackIndex]);
+			}
+
+			LoadedPlaylists.Add(Playlist.Profile.PlaylistId, MoveTemp(Playlist));
+		}
+
+		if (Reader.IsError())
+		{
+			UE_LOG(LogTemp, Error, TEXT("Spotify library cache is corrupted: %s"), *Path);
+			LoadedPlaylists.Reset();
+			return false;
+		}
+
+		return true;
+	}
+
+	/**
+	 * Writes the store to disk in a single write.
+	 * The records are serialized from a snapshot, so the store stays usable while the file is written.
+	 * @param Path The file to save to.
+	 * @return True if the file was written.
+	 */
+	bool Save(const FString& Path = GetDefaultPath())
+	{
+		TMap<FString, FCachedPlaylist> SavedPlaylists;
+		uint64 Generation = 0;
+		{
+			FScopeLock Lock(&Mutex);
+			SavedPlaylists = Playlists;
+			Generation = ++SaveGeneration;
+			bDirty = false;
+		}
+
+		TArray<uint8> Bytes;
+		FMemoryWriter Writer(Bytes);
+
+		uint32 Magic = FileMagic;
+		uint32 Version = FileVersion;
+		Writer << Magic << Version;
+
+		// Assign every distinct track its table index first. Rows are keyed by instance, not TrackId: playlists stored
+		// before a track changed hold an older version, and local tracks share an empty id, both must load back as they were.
+		TMap<const FTrackProfile*, int32> TrackIndices;
+		TArray<const FTrackProfile*> Tracks;
+		TArray<TArray<int32>> PlaylistTrackIndices;
+		PlaylistTrackIndices.Reserve(SavedPlaylists.Num());
+		for (TPair<FString, FCachedPlaylist>& Pair : SavedPlaylists)
+		{
+			TArray<int32>& Indices = PlaylistTrackIndices.AddDefaulted_GetRef();
+			Indices.Reserve(Pair.Value.Tracks.Num());
+			for (const FTrackProfileRef& Track : Pair.Value.Tracks)
+			{
+				int32& TrackIndex = TrackIndices.FindOrAdd(&Track.Get(), INDEX_NONE);
+				if (TrackIndex == INDEX_NONE)
+				{
+					TrackIndex = Tracks.Add(&Track.Get());
+				}
+				Indices.Add(TrackIndex);
+			}
+		}
+
+		int32 NumTracks = Tracks.Num();
+		Writer << NumTracks;
+		for (const FTrackProfile* Track : Tracks)
+		{
+			// Saving archives only read, the shared tracks stay untouched.
+			SerializeTrack(Writer, const_cast<FTrackProfile&>(*Track));
+		}
+
+		int32 NumPlaylists = SavedPlaylists.Num();
+		Writer << NumPlaylists;
+		int32 PlaylistIndex = 0;
+		for (TPair<FString, FCachedPlaylist>& Pair : SavedPlaylists)
+		{
+			SerializeProfile(Writer, Pair.Value);
+			Writer << PlaylistTrackIndices[PlaylistIndex++];
+		}
+
+		FScopeLock FileLock(&FileMutex);
+		// An overlapping save already wrote a newer snapshot.
+		if (Generation < WrittenGeneration)
+		{
+			return true;
+		}
+
+		if (!FFileHelper::SaveArrayToFile(Bytes, *Path))
+		{
+			FScopeLock Lock(&Mutex);
+			bDirty = true;
+			return false;
+		}
+		WrittenGeneration = Generation;
+		return true;
+	}
+
+	/**
+	 * Saves the store on a background task, if anything changed since it was loaded or last saved.
+	 * @param Cache The store to save.
+	 * @param Path The file to save to.
+	 */
+	static void SaveChangesAsync(const TSharedRef<FSpotifyLibraryCache, ESPMode::ThreadSafe>& Cache, const FString& Path = GetDefaultPath())
+	{
+		if (!Cache->HasUnsavedChanges())
+		{
+			return;
+		}
+
+		FAsyncDecode::Launch([Cache, Path]()
+		{
+			TRACE_CPUPROFILER_EVENT_SCOPE(SpotifySDK_SaveLibrary);
+			Cache->Save(Path);
+		});
+	}
+
+	/**
+	 * Loads the store on a background task, so the bulk read and deserialization stay off the game thread.
+	 * @param Cache The store to load into.
+	 * @param Callback A function that will be called once loading finished, whether or not a file was read.
+	 * @param Path The file to load from.
+	 */
+	static void LoadAsync(const TSharedRef<FSpotifyLibraryCache, ESPMode::ThreadSafe>& Cache, TFunction<void()> Callback, const FString& Path = GetDefaultPath())
+	{
+		FAsyncDecode::Launch([Cache, Callback, Path]()
+		{
+			{
+				TRACE_CPUPROFILER_EVENT_SCOPE(SpotifySDK_LoadLibrary);
+				Cache->Load(Path);
+			}
+			FAsyncDecode::Deliver([Callback]() { Callback(); });
+		});
+	}
+
+	bool HasUnsavedChanges() const
+	{
+		FScopeLock Lock(&Mutex);
+		return bDirty;
+	}
+
+	/**
+	 * Checks whether the stored tracks of a playlist are still current.
+	 * @param Profile A freshly requested playlist profile (with its SnapshotId).
+	 * @return True if a record with the same snapshot is stored.
+	 */
+	bool IsUpToDate(const FPlaylistProfile& Profile) const
+	{
+		FScopeLock Lock(&Mutex);
+		const FCachedPlaylist* Playlist = Playlists.Find(Profile.PlaylistId);
+		return Playlist && !Profile.SnapshotId.IsEmpty() && Playlist->Profile.SnapshotId == Profile.SnapshotId;
+	}
+
+	/**
+	 * Get a copy of a stored playlist.
+	 * @return False if the playlist is not stored.
+	 */
+	bool Find(const FString& PlaylistId, FCachedPlaylist& OutPlaylist) const
+	{
+		FScopeLock Lock(&Mutex);
+		const FCachedPlaylist* Playlist = Playlists.Find(PlaylistId);
+		if (!Playlist)
+		{
+			return false;
+		}
+		OutPlaylist = *Playlist;
+		return true;
+	}
+
+	bool Contains(const FString& PlaylistId) const
+	{
+		FScopeLock Lock(&Mutex);
+		return Playlists.Contains(PlaylistId);
+	}
+
+	TArray<FString> GetPlaylistIds() const
+	{
+		FScopeLock Lock(&Mutex);
+		TArray<FString> PlaylistIds;
+		Playlists.GetKeys(PlaylistIds);
+		return PlaylistIds;
+	}
+
+	/**
+	 * Visits every stored playlist while holding the lock, the visitor must not call back into the store.
+	 */
+	void ForEachPlaylist(TFunctionRef<void(const FCachedPlaylist& Playlist)> Visitor) const
+	{
+		FScopeLock Lock(&Mutex);
+		for (const TPair<FString, FCachedPlaylist>& Pair : Playlists)
+		{
+			Visitor(Pair.Value);
+		}
+	}
+
+	/**
+	 * Stores the refetched tracks of a playlist.
+	 * @return The stored tracks, shared with the store.
+	 */
+	TArray<FTrackProfileRef> Update(const FPlaylistProfile& Profile, const FPlaylistData& Data)
+	{
+		// Track callbacks may be delivered concurrently on worker threads, see ECallbackThread.
+		FScopeLock Lock(&Mutex);
+		FCachedPlaylist& Playlist = Playlists.FindOrAdd(Profile.PlaylistId);
+		Playlist.Profile = Profile;
+		Playlist.TrackCount = Data.TrackCount;
+		Playlist.Tracks = ShareTracksLocked(Data.Tracks);
+		bDirty = true;
+		return Playlist.Tracks;
+	}
+
+	/**
+	 * Get the shared instance of every track, e.g. to index tracks before their playlist is stored.
+	 * Tracks with the same id and metadata as a track still held anywhere resolve to that track,
+	 * changed or unknown tracks are added and picked up by playlists stored later.
+	 * @param Tracks The decoded tracks.
+	 * @return The shared tracks, in the same order.
+	 */
+	TArray<FTrackProfileRef> ShareTracks(const TArray<FTrackProfile>& Tracks)
+	{
+		FScopeLock Lock(&Mutex);
+		return ShareTracksLocked(Tracks);
+	}
+
+	/**
+	 * Forgets the tracks nothing holds any more, call after a sync.
+	 * Only sweeps once the lookup grew by half since the last sweep, so periodic syncs stay cheap.
+	 */
+	void Compact()
+	{
+		FScopeLock Lock(&Mutex);
+		if (SharedTracks.Num() < FMath::Max(MinCompactSize, NumSharedTracksAfterCompact + NumSharedTracksAfterCompact / 2))
+		{
+			return;
+		}
+
+		for (auto It = SharedTracks.CreateIterator(); It; ++It)
+		{
+			if (!It.Value().IsValid())
+			{
+				It.RemoveCurrent();
+			}
+		}
+		SharedTracks.Compact();
+		NumSharedTracksAfterCompact = SharedTracks.Num();
+	}
+
+	void Remove(const FString& PlaylistId)
+	{
+		FScopeLock Lock(&Mutex);
+		if (Playlists.Remove(PlaylistId) > 0)
+		{
+			bDirty = true;
+		}
+	}
+
+	/**
+	 * Drops every playlist the user no longer has.
+	 * @param PlaylistIds The IDs of the user's current playlists.
+	 * @return The IDs of the dropped playlists.
+	 */
+	TArray<FString> RetainPlaylists(const TSet<FString>& PlaylistIds)
+	{
+		FScopeLock Lock(&Mutex);
+		TArray<FString> RemovedPlaylistIds;
+		for (auto It = Playlists.CreateIterator(); It; ++It)
+		{
+			if (!PlaylistIds.Contains(It.Key()))
+			{
+				RemovedPlaylistIds.Add(It.Key());
+				It.RemoveCurrent();
+				bDirty = true;
+			}
+		}
+		return RemovedPlaylistIds;
+	}
+
+	// Shared by RequestLibrary and FSpotifyLibrarySync::Sync, so a full request and a sync put the same load on the API.
+	// The playlist list is fetched a few pages at a time, it has to settle before any playlist is compared.
+	static constexpr int32 MaxConcurrentPlaylistPages = 4;
+	// Playlists are already refetched in parallel, so the pages of each one are fetched in order.
+	static constexpr int32 MaxConcurrentTrackPages = 1;
+	static constexpr int32 DefaultMaxConcurrentPlaylists = 4;
+
+	/**
+	 * Requests the user's library, serving unchanged playlists from the store.
+	 * The playlist list is always requested, but tracks are only refetched for playlists whose
+	 * snapshot_id differs from the stored one. Playlists the user no longer has are dropped and
+	 * the store is saved to disk on a background task once complete, if anything changed.
+	 * @param Cache The store to read from and update.
+	 * @param UserToken The access token for the Spotify user.
+	 * @param UserId The ID of the Spotify user.
+	 * @param Callback A function that will be called with the user's playlists and the IDs that had to be refetched.
+	 * @param MaxConcurrentPlaylists The maximum number of playlists whose tracks are refetched at once.
+	 * @param OnFailure An optional function that will be called with the error if the playlist list could not be requested.
+	 * @param OnPageDecoded An optional function that will be called on a task graph worker with every refetched tracks page as soon as it is decoded.
+	 * @return A handle to cancel the request, playlists already refetched stay updated in the store.
+	 */
+	static FSpotifyRequestHandle RequestLibrary(const TSharedRef<FSpotifyLibraryCache, ESPMode::ThreadSafe>& Cache, const FString& UserToken, const FString& UserId, TFunction<void(const TArray<FPlaylistProfile>& Playlists, const TArray<FString>& RefetchedPlaylistIds)> Callback, const int MaxConcurrentPlaylists = DefaultMaxConcurrentPlaylists, TFunction<void(const FSpotifyError& Error)> OnFailure = nullptr, TFunction<void(const FString& PlaylistId, const FPlaylistTracksPage& Page)> OnPageDecoded = nullptr)
+	{
+		FCancellationTokenRef Token = MakeShared<FCancellationToken, ESPMode::ThreadSafe>();
+
+		FSpotifyPlaylists::RequestUserPlaylistPages(UserToken, UserId, TPair<int, int>(50, 0), MaxConcurrentPlaylistPages, FFieldProjection::UserPlaylists(EPlaylistFields::All), Token, [=](const TArray<FPlaylistProfile>& Playlists)
+		{
+			TSharedRef<TArray<FPlaylistProfile>> ChangedPlaylists = MakeShared<TArray<FPlaylistProfile>>();
+			TSet<FString> PlaylistIds;
+
+			for (const FPlaylistProfile& Profile : Playlists)
+			{
+				PlaylistIds.Add(Profile.PlaylistId);
+				if (!Cache->IsUpToDate(Profile))
+				{
+					ChangedPlaylists->Add(Profile);
+				}
+			}
+
+			Cache->RetainPlaylists(PlaylistIds);
+
+			// Each task only writes its own slot.
+			TSharedRef<TArray<bool>, ESPMode::ThreadSafe> bRefetched = MakeShared<TArray<bool>, ESPMode::ThreadSafe>();
+			bRefetched->SetNumZeroed(ChangedPlaylists->Num());
+
+			FRequestBatcher::Run(ChangedPlaylists->Num(), MaxConcurrentPlaylists, [=](int32 Index, TFunction<void()> Done)
+			{
+				if (Token->IsCancelled())
+				{
+					return;
+				}
+
+				const FPlaylistProfile& Profile = (*ChangedPlaylists)[Index];
+				FSpotifyPlaylists::RequestAllPlaylistTracks(UserToken, Profile.PlaylistId, TPair<int, int>(100, 0), MaxConcurrentTrackPages, ETrackFields::All, Token, [=](const FPlaylistData& PlaylistData)
+				{
+					Cache->Update(Profile, PlaylistData);
+					(*bRefetched)[Index] = true;
+					Done();
+				},
+				[=](const FSpotifyError& Error)
+				{
+					Done();
+				},
+				MakePageHook(Profile.PlaylistId, OnPageDecoded));
+			},
+			[=]()
+			{
+				SaveChangesAsync(Cache);
+
+				TArray<FString> RefetchedPlaylistIds;
+				RefetchedPlaylistIds.Reserve(ChangedPlaylists->Num());
+				for (int32 Index = 0; Index < ChangedPlaylists->Num(); ++Index)
+				{
+					// Playlists whose tracks failed to refetch keep their old snapshot and are retried next time.
+					if ((*bRefetched)[Index])
+					{
+						RefetchedPlaylistIds.Add((*ChangedPlaylists)[Index].PlaylistId);
+					}
+				}
+
+				if (!Token->IsCancelled())
+				{
+					Callback(Playlists, RefetchedPlaylistIds);
+				}
+			});
+		},
+		[OnFailure, Token](const FSpotifyError& Error)
+		{
+			if (OnFailure && !Token->IsCancelled())
+			{
+				OnFailure(Error);
+			}
+		});
+
+		return FSpotifyRequestHandle(Token);
+	}
+
+	/**
+	 * Binds a playlist to a library wide page callback, or returns null if there is none.
+	 */
+	static TFunction<void(const FPlaylistTracksPage& Page)> MakePageHook(const FString& PlaylistId, const TFunction<void(const FString& PlaylistId, const FPlaylistTracksPage& Page)>& OnPageDecoded)
+	{
+		if (!OnPageDecoded)
+		{
+			return nullptr;
+		}
+		return [PlaylistId, OnPageDecoded](const FPlaylistTracksPage& Page) { OnPageDecoded(PlaylistId, Page); };
+	}
+
+private:
+	// Bump FileVersion whenever the record layout below changes, older files are then ignored.
+	static constexpr uint32 FileMagic = 0x53504C43; // 'SPLC'
+	static constexpr uint32 FileVersion = 4;
+	static constexpr int32 MinCompactSize = 1024;
+
+	static void SerializeProfile(FArchive& Ar, FCachedPlaylist& Playlist)
+	{
+		FPlaylistProfile& Profile = Playlist.Profile;
+		Ar << Profile.Name << Profile.Description << Profile.TrackCount << Profile.PlaylistId << Profile.ImgUrl << Profile.SnapshotId;
+		Ar << Playlist.TrackCount;
+	}
+
+	static void SerializeTrack(FArchive& Ar, FTrackProfile& Track)
+	{
+		Ar << Track.Name << Track.TrackId << Track.DurationMs << Track.Artists << Track.AlbumReleaseDate << Track.AlbumId << Track.ImgUrl << Track.AlbumName;
+	}
+
+	TArray<FTrackProfileRef> ShareTracksLocked(const TArray<FTrackProfile>& Tracks)
+	{
+		TArray<FTrackProfileRef> Shared;
+		Shared.Reserve(Tracks.Num());
+		for (const FTrackProfile& Track : Tracks)
+		{
+			TWeakPtr<const FTrackProfile, ESPMode::ThreadSafe>& SharedTrack = SharedTracks.FindOrAdd(Track.TrackId);
+			TSharedPtr<const FTrackProfile, ESPMode::ThreadSafe> Existing = SharedTrack.Pin();
+			if (Existing.IsValid() && Existing->HasSameMetadata(Track))
+			{
+				Shared.Add(Existing.ToSharedRef());
+				continue;
+			}
+
+			// Playlists stored before a track changed keep the old version until they are refetched.
+			FTrackProfileRef NewTrack = MakeShared<const FTrackProfile, ESPMode::ThreadSafe>(Track);
+			SharedTrack = NewTrack;
+			Shared.Add(NewTrack);
+		}
+		return Shared;
+	}
+
+	mutable FCriticalSection Mutex;
+	TMap<FString, FCachedPlaylist> Playlists;
+	// Whether the records changed since they were loaded or last saved.
+	bool bDirty = false;
+	uint64 SaveGeneration = 0;
+	// The newest instance of every track, weak so tracks are freed with the last playlist (or index entry) holding them.
+	TMap<FString, TWeakPtr<const FTrackProfile, ESPMode::ThreadSafe>> SharedTracks;
+	int32 NumSharedTracksAfterCompact = 0;
+
+	// Serializes file writes, so an older snapshot never overwrites a newer one.
+	FCriticalSection FileMutex;
+	uint64 WrittenGeneration = 0;
+};
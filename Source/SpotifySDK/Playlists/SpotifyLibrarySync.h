@@ -0,0 +1,289 @@
+﻿// Copyright (c) Harris Barra. (MIT License)
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Algo/BinarySearch.h"
+#include "RequestBatcher.h"
+#include "SpotifySDK/Playlists/SpotifyLibraryCache.h"
+#include "SpotifySDK/Playlists/SpotifyPlaylists.h"
+
+/**
+ * A track that was inserted into a playlist, Index is its position in the new track list.
+ */
+struct FPlaylistTrackAdded
+{
+	FTrackProfile Track;
+	int32 Index = INDEX_NONE;
+};
+
+/**
+ * A track that was taken out of a playlist, Index is its position in the old track list.
+ */
+struct FPlaylistTrackRemoved
+{
+	FString TrackId;
+	int32 Index = INDEX_NONE;
+};
+
+/**
+ * A track that is still in the playlist but changed position relative to the other kept tracks.
+ */
+struct FPlaylistTrackMoved
+{
+	FString TrackId;
+	int32 FromIndex = INDEX_NONE;
+	int32 ToIndex = INDEX_NONE;
+};
+
+struct FPlaylistDiff
+{
+	FPlaylistProfile Profile;
+	TArray<FPlaylistTrackAdded> Added;
+	TArray<FPlaylistTrackRemoved> Removed;
+	TArray<FPlaylistTrackMoved> Moved;
+};
+
+struct FLibrarySyncResult
+{
+	// Playlists that were not in the store yet, their tracks are in the store once the sync completes.
+	TArray<FPlaylistProfile> AddedPlaylists;
+	// Playlists the user no longer has.
+	TArray<FString> RemovedPlaylistIds;
+	// Playlists whose snapshot changed, with the track level changes.
+	TArray<FPlaylistDiff> ChangedPlaylists;
+	// Playlists whose snapshot changed but whose tracks could not be refetched, they are retried next sync.
+	TArray<FString> FailedPlaylistIds;
+	int32 NumUnchangedPlaylists = 0;
+};
+
+class FSpotifyLibrarySync
+{
+public:
+	// This is an incremental sync engine over the persistent library store.
+	// A sync requests the playlist list, compares every snapshot_id with the stored one and only
+	// refetches tracks of changed playlists. Instead of replacing those playlists wholesale it reports
+	// which tracks were added, removed or moved, so a refresh costs O(changed playlists) and callers
+	// only have to patch what changed.
+
+	/**
+	 * Syncs the library store with the user's current library.
+	 * @param Cache The store to diff against and update, it is saved to disk on a background task once complete if anything changed.
+	 * @param UserToken The access token for the Spotify user.
+	 * @param UserId The ID of the Spotify user.
+	 * @param Callback A function that will be called with the changes.
+	 * @param MaxConcurrentPlaylists The maximum number of playlists whose tracks are refetched at once.
+	 * @param OnFailure An optional function that will be called with the error if the playlist list could not be requested, the store is then left untouched.
+	 * @param OnPageDecoded An optional function that will be called on a task graph worker with every refetched tracks page as soon as it is decoded.
+	 * @return A handle to cancel the sync, the store is then left partially updated but consistent per playlist.
+	 */
+	static FSpotifyRequestHandle Sync(const TSharedRef<FSpotifyLibraryCache, ESPMode::ThreadSafe>& Cache, const FString& UserToken, const FString& UserId, TFunction<void(const FLibrarySyncResult& Result)> Callback, const int MaxConcurrentPlaylists = FSpotifyLibraryCache::DefaultMaxConcurrentPlaylists, TFunction<void(const FSpotifyError& Error)> OnFailure = nullptr, TFunction<void(const FString& PlaylistId, const FPlaylistTracksPage& Page)> OnPageDecoded = nullptr)
+	{
+		FCancellationTokenRef Token = MakeShared<FCancellationToken, ESPMode::ThreadSafe>();
+
+		FSpotifyPlaylists::RequestUserPlaylistPages(UserToken, UserId, TPair<int, int>(50, 0), FSpotifyLibraryCache::MaxConcurrentPlaylistPages, FFieldProjection::UserPlaylists(EPlaylistFields::All), Token, [=](const TArray<FPlaylistProfile>& Playlists)
+		{
+			TSharedRef<FLibrarySyncResult, ESPMode::ThreadSafe> Result = MakeShared<FLibrarySyncResult, ESPMode::ThreadSafe>();
+
+			// Snapshot the stored tracks of every changed playlist before any of them is overwritten.
+			TSharedRef<TArray<FPlaylistProfile>, ESPMode::ThreadSafe> ChangedPlaylists = MakeShared<TArray<FPlaylistProfile>, ESPMode::ThreadSafe>();
+			TSharedRef<TArray<TOptional<TArray<FTrackProfileRef>>>, ESPMode::ThreadSafe> OldTracks = MakeShared<TArray<TOptional<TArray<FTrackProfileRef>>>, ESPMode::ThreadSafe>();
+
+			TSet<FString> PlaylistIds;
+			for (const FPlaylistProfile& Profile : Playlists)
+			{
+				PlaylistIds.Add(Profile.PlaylistId);
+				if (Cache->IsUpToDate(Profile))
+				{
+					Result->NumUnchangedPlaylists++;
+					continue;
+				}
+
+				ChangedPlaylists->Add(Profile);
+				TOptional<TArray<FTrackProfileRef>>& Tracks = OldTracks->AddDefaulted_GetRef();
+				FCachedPlaylist Playlist;
+				if (Cache->Find(Profile.PlaylistId, Playlist))
+				{
+					Tracks = MoveTemp(Playlist.Tracks);
+				}
+			}
+
+			Result->RemovedPlaylistIds = Cache->RetainPlaylists(PlaylistIds);
+
+			// Each task only writes its own slot.
+			TSharedRef<TArray<TOptional<TArray<FTrackProfileRef>>>, ESPMode::ThreadSafe> NewTracks = MakeShared<TArray<TOptional<TArray<FTrackProfileRef>>>, ESPMode::ThreadSafe>();
+			NewTracks->SetNum(ChangedPlaylists->Num());
+
+			FRequestBatcher::Run(ChangedPlaylists->Num(), MaxConcurrentPlaylists, [=](int32 Index, TFunction<void()> Done)
+			{
+				if (Token->IsCancelled())
+				{
+					return;
+				}
+
+				const FPlaylistProfile& Profile = (*ChangedPlaylists)[Index];
+				FSpotifyPlaylists::RequestAllPlaylistTracks(UserToken, Profile.PlaylistId, TPair<int, int>(100, 0), FSpotifyLibraryCache::MaxConcurrentTrackPages, ETrackFields::All, Token, [=](const FPlaylistData& PlaylistData)
+				{
+					(*NewTracks)[Index] = Cache->Update(Profile, PlaylistData);
+					Done();
+				},
+				[=](const FSpotifyError& Error)
+				{
+					// Left unset, so the playlist is reported as failed and keeps its stored tracks.
+					Done();
+				},
+				FSpotifyLibraryCache::MakePageHook(Profile.PlaylistId, OnPageDecoded));
+			},
+			[=]()
+			{
+				for (int32 Index = 0; Index < ChangedPlaylists->Num(); ++Index)
+				{
+					const FPlaylistProfile& Profile = (*ChangedPlaylists)[Index];
+					if (!(*NewTracks)[Index].IsSet())
+					{
+						Result->FailedPlaylistIds.Add(Profile.PlaylistId);
+					}
+					else if (!(*OldTracks)[Index].IsSet())
+					{
+						Result->AddedPlaylists.Add(Profile);
+					}
+					else
+					{
+						FPlaylistDiff& Diff = Result->ChangedPlaylists.AddDefaulted_GetRef();
+						Diff.Profile = Profile;
+						DiffTracks((*OldTracks)[Index].GetValue(), (*NewTracks)[Index].GetValue(), Diff);
+					}
+				}
+
+				FSpotifyLibraryCache::SaveChangesAsync(Cache);
+
+				FAsyncDecode::Deliver([Callback, Token, Result]()
+				{
+					if (!Token->IsCancelled())
+					{
+						Callback(*Result);
+					}
+				});
+			});
+		},
+		[OnFailure, Token](const FSpotifyError& Error)
+		{
+			if (OnFailure && !Token->IsCancelled())
+			{
+				OnFailure(Error);
+			}
+		});
+
+		return FSpotifyRequestHandle(Token);
+	}
+
+	/**
+	 * Computes the track level changes between two versions of a playlist.
+	 * Repeated tracks are matched by occurrence, and of the kept tracks only the fewest that have to
+	 * move to turn the old order into the new one (those off the longest increasing run) are reported as moved.
+	 * @param OldTracks The stored track list.
+	 * @param NewTracks The current track list.
+	 * @param OutDiff The diff the changes are written to.
+	 */
+	static void DiffTracks(const TArray<FTrackProfile>& OldTracks, const TArray<FTrackProfile>& NewTracks, FPlaylistDiff& OutDiff)
+	{
+		DiffTracksImpl(OldTracks, NewTracks, OutDiff);
+	}
+
+	/**
+	 * Computes the track level changes between two versions of a stored playlist, see the FTrackProfile overload.
+	 */
+	static void DiffTracks(const TArray<FTrackProfileRef>& OldTracks, const TArray<FTrackProfileRef>& NewTracks, FPlaylistDiff& OutDiff)
+	{
+		DiffTracksImpl(OldTracks, NewTracks, OutDiff);
+	}
+
+private:
+	static const FTrackProfile& GetTrack(const FTrackProfile& Track) { return Track; }
+	static const FTrackProfile& GetTrack(const FTrackProfileRef& Track) { return *Track; }
+
+	template <typename TrackType>
+	static void DiffTracksImpl(const TArray<TrackType>& OldTracks, const TArray<TrackType>& NewTracks, FPlaylistDiff& OutDiff)
+	{
+		// Queue of the old positions of every track id, consumed in order so repeats match by occurrence.
+		TMap<FString, TArray<int32>> OldPositions;
+		OldPositions.Reserve(OldTracks.Num());
+		for (int32 Index = 0; Index < OldTracks.Num(); ++Index)
+		{
+			OldPositions.FindOrAdd(GetTrack(OldTracks[Index]).TrackId).Add(Index);
+		}
+
+		TMap<FString, int32> NumConsumed;
+		TArray<bool> bOldKept;
+		bOldKept.SetNumZeroed(OldTracks.Num());
+
+		// (new index, old index) of every kept track, in new order.
+		TArray<TPair<int32, int32>> Kept;
+		Kept.Reserve(NewTracks.Num());
+
+		for (int32 Index = 0; Index < NewTracks.Num(); ++Index)
+		{
+			const FString& TrackId = GetTrack(NewTracks[Index]).TrackId;
+			const TArray<int32>* Positions = OldPositions.Find(TrackId);
+			int32& Consumed = NumConsumed.FindOrAdd(TrackId);
+
+			if (Positions && Consumed < Positions->Num())
+			{
+				const int32 OldIndex = (*Positions)[Consumed++];
+				bOldKept[OldIndex] = true;
+				Kept.Emplace(Index, OldIndex);
+			}
+			else
+			{
+				OutDiff.Added.Add({ GetTrack(NewTracks[Index]), Index });
+			}
+		}
+
+		for (int32 Index = 0; Index < OldTracks.Num(); ++Index)
+		{
+			if (!bOldKept[Index])
+			{
+				OutDiff.Removed.Add({ GetTrack(OldTracks[Index]).TrackId, Index });
+			}
+		}
+
+		// Longest increasing subsequence of the old indices (patience sorting), everything off it moved.
+		TArray<int32> TailIndices;
+		TArray<int32> Previous;
+		Previous.Init(INDEX_NONE, Kept.Num());
+
+		for (int32 KeptIndex = 0; KeptIndex < Kept.Num(); ++KeptIndex)
+		{
+			const int32 OldIndex = Kept[KeptIndex].Value;
+			const int32 Position = Algo::LowerBoundBy(TailIndices, OldIndex, [&Kept](const int32 TailIndex) { return Kept[TailIndex].Value; });
+			if (Position > 0)
+			{
+				Previous[KeptIndex] = TailIndices[Position - 1];
+			}
+
+			if (Position == TailIndices.Num())
+			{
+				TailIndices.Add(KeptIndex);
+			}
+			else
+			{
+				TailIndices[Position] = KeptIndex;
+			}
+		}
+
+		TArray<bool> bInOrder;
+		bInOrder.SetNumZeroed(Kept.Num());
+		for (int32 KeptIndex = TailIndices.Num() > 0 ? TailIndices.Last() : INDEX_NONE; KeptIndex != INDEX_NONE; KeptIndex = Previous[KeptIndex])
+		{
+			bInOrder[KeptIndex] = true;
+		}
+
+		for (int32 KeptIndex = 0; KeptIndex < Kept.Num(); ++KeptIndex)
+		{
+			if (!bInOrder[KeptIndex])
+			{
+				OutDiff.Moved.Add({ GetTrack(NewTracks[Kept[KeptIndex].Key]).TrackId, Kept[KeptIndex].Value, Kept[KeptIndex].Key });
+			}
+		}
+	}
+};
@@ -0,0 +1,494 @@
+﻿// Copyright (c) Harris Barra. (MIT License)
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/Ticker.h"
+#include "FieldProjection.h"
+#include "Misc/ScopeLock.h"
+#include "RequestHandle.h"
+#include "RequestScheduler.h"
+#include "RequestUtils.h"
+#include "SpotifySDK/Playlists/SpotifyPlaylists.h"
+
+struct FPrefetchBudget
+{
+	// Maximum number of prefetch requests in flight, Web API pages also share the scheduler's Background slots.
+	int32 MaxConcurrentRequests = 2;
+	// Bytes a single prefetch run may download, the remaining work is dropped once they are spent.
+	int64 MaxBytes = 4 * 1024 * 1024;
+	// Sustained download rate of a run, further requests wait until the run is back under it.
+	int64 MaxBytesPerSecond = 512 * 1024;
+	// Byte budget of the prefetched cover images, the oldest images are dropped first.
+	int64 ImageByteBudget = 8 * 1024 * 1024;
+};
+
+struct FPrefetchStats
+{
+	int64 NumRequests = 0;
+	int64 BytesReceived = 0;
+	// Runs that stopped early because their byte budget was spent.
+	int64 NumBudgetExhausted = 0;
+	int64 NumImageHits = 0;
+	int64 NumImageMisses = 0;
+};
+
+class FSpotifyPlaylistPrefetcher
+{
+public:
+	// This is a predictive warmer for playlist navigation.
+	// Once the playlist list is shown the next action is nearly always opening one of the first few
+	// playlists, so the first tracks page and the cover image of the most likely ones are requested
+	// ahead of time. Tracks pages go through the scheduler's Background lane into the response cache with
+	// the server's own freshness, so opening the playlist is served from memory or at worst revalidated
+	// with a 304 instead of transferring the page. Covers are kept in a small byte bounded store, see FindImage.
+	// A run never uses the slots reserved for Interactive requests, yields while interactive work is queued
+	// and stops once its byte budget is spent.
+
+	/**
+	 * Records that the user opened a playlist, frequently and recently opened playlists are predicted first.
+	 */
+	void RecordPlaylistOpened(const FString& PlaylistId)
+	{
+		FScopeLock Lock(&Mutex);
+
+		const double Now = FPlatformTime::Seconds();
+		FOpenScore& OpenScore = OpenScores.FindOrAdd(PlaylistId);
+		OpenScore.Score = GetDecayedScore(OpenScore, Now) + 1.0;
+		OpenScore.LastOpened = Now;
+	}
+
+	/**
+	 * Ranks the playlists by how likely the user is to open them next.
+	 * Previously opened playlists come first, the rest keep list order as the top of the list is what is on screen.
+	 * @param Playlists The playlist list, in display order.
+	 * @param NumPlaylists The number of playlists to return.
+	 * @return The most likely playlists, most likely first.
+	 */
+	TArray<FPlaylistProfile> PredictNextPlaylists(const TArray<FPlaylistProfile>& Playlists, const int32 NumPlaylists) const
+	{
+		// (score, list index) of every playlist.
+		TArray<TPair<double, int32>> Ranked;
+		Ranked.Reserve(Playlists.Num());
+		{
+			FScopeLock Lock(&Mutex);
+
+			const double Now = FPlatformTime::Seconds();
+			for (int32 Index = 0; Index < Playlists.Num(); ++Index)
+			{
+				const FOpenScore* OpenScore = OpenScores.Find(Playlists[Index].PlaylistId);
+				Ranked.Emplace(OpenScore ? GetDecayedScore(*OpenScore, Now) : 0.0, Index);
+			}
+		}
+
+		Ranked.Sort([](const TPair<double, int32>& A, const TPair<double, int32>& B)
+		{
+			return A.Key != B.Key ? A.Key > B.Key : A.Value < B.Value;
+		});
+
+		const int32 NumPredicted = FMath::Clamp(NumPlaylists, 0, Ranked.Num());
+		TArray<FPlaylistProfile> Predicted;
+		Predicted.Reserve(NumPredicted);
+		for (int32 Index = 0; Index < NumPredicted; ++Index)
+		{
+			Predicted.Add(Playlists[Ranked[Index].Value]);
+		}
+		return Predicted;
+	}
+
+	/**
+	 * Prefetches the first tracks page and the cover image of the most likely playlists.
+	 * Starting a run cancels the previous one, its prediction is superseded.
+	 * Only the pages RequestPlaylistTracks requests with a LimitOffset of (100, 0) and the same Fields benefit.
+	 * @param UserToken The access token for the Spotify user.
+	 * @param Playlists The playlist list, in display order.
+	 * @param NumPlaylists The number of playlists to prefetch.
+	 * @param Fields The track members the playlists will be opened with.
+	 * @return A handle to cancel the run, in-flight image downloads are aborted.
+	 */
+	FSpotifyRequestHandle Prefetch(const FString& UserToken, const TArray<FPlaylistProfile>& Playlists, const int32 NumPlaylists = 3, const ETrackFields Fields = ETrackFields::All)
+	{
+		Cancel();
+
+		TSharedRef<FRun, ESPMode::ThreadSafe> Run = MakeShared<FRun, ESPMode::ThreadSafe>();
+		Run->UserToken = UserToken;
+		Run->Store = Store;
+		Run->StartTime = FPlatformTime::Seconds();
+		{
+			FScopeLock Lock(&Mutex);
+			Run->Budget = Budget;
+			CurrentToken = Run->Token;
+		}
+
+		const FString FieldsQuery = FFieldProjection::PlaylistTracks(Fields);
+		for (const FPlaylistProfile& Profile : PredictNextPlaylists(Playlists, NumPlaylists))
+		{
+			if (!Profile.PlaylistId.IsEmpty())
+			{
+				Run->Tasks.Add({ FSpotifyPlaylists::MakePlaylistTracksUrl(Profile.PlaylistId, TPair<int, int>(PrefetchPageLimit, 0), FieldsQuery), false });
+			}
+			if (!Profile.ImgUrl.IsEmpty() && !Store->ContainsImage(Profile.ImgUrl))
+			{
+				Run->Tasks.Add({ Profile.ImgUrl, true });
+			}
+		}
+
+		// Queued API pages are dropped by the scheduler, in-flight image downloads have to be aborted here.
+		Run->Token->SetOnCancelled([WeakRun = TWeakPtr<FRun, ESPMode::ThreadSafe>(Run)]()
+		{
+			if (TSharedPtr<FRun, ESPMode::ThreadSafe> PinnedRun = WeakRun.Pin())
+			{
+				TArray<TSharedRef<IHttpRequest>> ImageRequests;
+				{
+					FScopeLock Lock(&PinnedRun->Mutex);
+					ImageRequests = MoveTemp(PinnedRun->ImageRequests);
+				}
+				for (const TSharedRef<IHttpRequest>& ImageRequest : ImageRequests)
+				{
+					ImageRequest->CancelRequest();
+				}
+			}
+		});
+
+		Pump(Run);
+
+		return FSpotifyRequestHandle(Run->Token);
+	}
+
+	/**
+	 * Cancels the current run, if any.
+	 */
+	void Cancel()
+	{
+		FCancellationTokenPtr Token;
+		{
+			FScopeLock Lock(&Mutex);
+			Token = MoveTemp(CurrentToken);
+		}
+
+		if (Token.IsValid())
+		{
+			Token->Cancel();
+		}
+	}
+
+	/**
+	 * Get a prefetched cover image.
+	 * @param Url The image url, e.g. FPlaylistProfile::ImgUrl.
+	 * @return The encoded image (JPEG), or null if it was not prefetched.
+	 */
+	TSharedPtr<const TArray<uint8>, ESPMode::ThreadSafe> FindImage(const FString& Url) const
+	{
+		return Store->FindImage(Url);
+	}
+
+	/**
+	 * Sets the budget of future runs, the running one keeps the budget it was started with.
+	 */
+	void SetBudget(const FPrefetchBudget& InBudget)
+	{
+		{
+			FScopeLock Lock(&Mutex);
+			Budget = InBudget;
+			Budget.MaxConcurrentRequests = FMath::Max(1, Budget.MaxConcurrentRequests);
+			Budget.MaxBytesPerSecond = FMath::Max<int64>(1, Budget.MaxBytesPerSecond);
+		}
+		Store->SetByteBudget(InBudget.ImageByteBudget);
+	}
+
+	FPrefetchBudget GetBudget() const
+	{
+		FScopeLock Lock(&Mutex);
+		return Budget;
+	}
+
+	FPrefetchStats GetStats() const { return Store->GetStats(); }
+
+private:
+	struct FOpenScore
+	{
+		double Score = 0.0;
+		double LastOpened = 0.0;
+	};
+
+	/**
+	 * Prefetched images (oldest first) and the stats shared by every run.
+	 */
+	class FStore
+	{
+	public:
+		bool ContainsImage(const FString& Url) const
+		{
+			FScopeLock Lock(&Mutex);
+			return Images.Contains(Url);
+		}
+
+		TSharedPtr<const TArray<uint8>, ESPMode::ThreadSafe> FindImage(const FString& Url) const
+		{
+			FScopeLock Lock(&Mutex);
+
+			const TSharedRef<const TArray<uint8>, ESPMode::ThreadSafe>* Image = Images.Find(Url);
+			if (!Image)
+			{
+				Stats.NumImageMisses++;
+				return nullptr;
+			}
+
+			Stats.NumImageHits++;
+			return *Image;
+		}
+
+		void AddImage(const FString& Url, const TSharedRef<const TArray<uint8>, ESPMode::ThreadSafe>& Image)
+		{
+			FScopeLock Lock(&Mutex);
+
+			if (Images.Contains(Url) || Image->Num() > ByteBudget)
+			{
+				return;
+			}
+
+			Images.Add(Url, Image);
+			ImageOrder.Add(Url);
+			BytesUsed += Image->Num();
+			EvictLocked();
+		}
+
+		void RecordRequest(const int64 Bytes)
+		{
+			FScopeLock Lock(&Mutex);
+			Stats.NumRequests++;
+			Stats.BytesReceived += Bytes;
+		}
+
+		void RecordBudgetExhausted()
+		{
+			FScopeLock Lock(&Mutex);
+			Stats.NumBudgetExhausted++;
+		}
+
+		void SetByteBudget(const int64 InByteBudget)
+		{
+			FScopeLock Lock(&Mutex);
+			ByteBudget = FMath::Max<int64>(0, InByteBudget);
+			EvictLocked();
+		}
+
+		FPrefetchStats GetStats() const
+		{
+			FScopeLock Lock(&Mutex);
+			return Stats;
+		}
+
+	private:
+		void EvictLocked()
+		{
+			int32 NumEvicted = 0;
+			while (BytesUsed > ByteBudget && NumEvicted < ImageOrder.Num())
+			{
+				TSharedRef<const TArray<uint8>, ESPMode::ThreadSafe> Image = Images.FindAndRemoveChecked(ImageOrder[NumEvicted++]);
+				BytesUsed -= Image->Num();
+			}
+			ImageOrder.RemoveAt(0, NumEvicted);
+		}
+
+		mutable FCriticalSection Mutex;
+		TMap<FString, TSharedRef<const TArray<uint8>, ESPMode::ThreadSafe>> Images;
+		TArray<FString> ImageOrder;
+		int64 BytesUsed = 0;
+		int64 ByteBudget = FPrefetchBudget().ImageByteBudget;
+		mutable FPrefetchStats Stats;
+	};
+
+	struct FTask
+	{
+		FString Url;
+		bool bImage = false;
+	};
+
+	struct FRun
+	{
+		FCancellationTokenRef Token = MakeShared<FCancellationToken, ESPMode::ThreadSafe>();
+		FString UserToken;
+		FPrefetchBudget Budget;
+		TSharedPtr<FStore, ESPMode::ThreadSafe> Store;
+		double StartTime = 0.0;
+
+		FCriticalSection Mutex;
+		TArray<FTask> Tasks;
+		int32 NextTask = 0;
+		int32 NumInFlight = 0;
+		int64 BytesReceived = 0;
+		bool bPumpScheduled = false;
+		TArray<TSharedRef<IHttpRequest>> ImageRequests;
+	};
+
+	/**
+	 * Starts as many tasks as the run's concurrency, byte and rate budget allow, and retries later if it has to wait.
+	 */
+	static void Pump(const TSharedRef<FRun, ESPMode::ThreadSafe>& Run)
+	{
+		// Prefetching only ever fills idle time, so it steps aside while the user is waiting on something.
+		const bool bInteractiveQueued = FRequestScheduler::Get().GetNumQueued(ERequestPriority::Interactive) > 0;
+
+		TArray<FTask, TInlineAllocator<4>> TasksToStart;
+		double RetryDelay = 0.0;
+		bool bBudgetExhausted = false;
+		{
+			FScopeLock Lock(&Run->Mutex);
+
+			if (Run->Token->IsCancelled())
+			{
+				return;
+			}
+
+			const FPrefetchBudget& RunBudget = Run->Budget;
+			while (Run->NumInFlight < RunBudget.MaxConcurrentRequests && Run->NextTask < Run->Tasks.Num())
+			{
+				// Sizes are only known once a response arrives, so a run overshoots by at most the responses in flight.
+				if (Run->BytesReceived >= RunBudget.MaxBytes)
+				{
+					Run->NextTask = Run->Tasks.Num();
+					bBudgetExhausted = true;
+					break;
+				}
+
+				// Allow a one second burst, then hold the run to the sustained rate.
+				const double Elapsed = FPlatformTime::Seconds() - Run->StartTime;
+				const double AllowedBytes = static_cast<double>(RunBudget.MaxBytesPerSecond) * (Elapsed + 1.0);
+				if (Run->BytesReceived > AllowedBytes)
+				{
+					RetryDelay = (Run->BytesReceived - AllowedBytes) / RunBudget.MaxBytesPerSecond;
+					break;
+				}
+
+				if (bInteractiveQueued)
+				{
+					RetryDelay = YieldDelaySeconds;
+					break;
+				}
+
+				TasksToStart.Add(Run->Tasks[Run->NextTask++]);
+				Run->NumInFlight++;
+			}
+
+			if (RetryDelay > 0.0 && !Run->bPumpScheduled)
+			{
+				Run->bPumpScheduled = true;
+			}
+			else
+			{
+				RetryDelay = 0.0;
+			}
+		}
+
+		if (bBudgetExhausted)
+		{
+			Run->Store->RecordBudgetExhausted();
+		}
+
+		if (RetryDelay > 0.0)
+		{
+			FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateLambda([Run](float DeltaTime)
+			{
+				{
+					FScopeLock Lock(&Run->Mutex);
+					Run->bPumpScheduled = false;
+				}
+				Pump(Run);
+				return false;
+			}), static_cast<float>(RetryDelay));
+		}
+
+		for (const FTask& Task : TasksToStart)
+		{
+			if (Task.bImage)
+			{
+				StartImageTask(Run, Task.Url);
+			}
+			else
+			{
+				StartPageTask(Run, Task.Url);
+			}
+		}
+	}
+
+	static void StartPageTask(const TSharedRef<FRun, ESPMode::ThreadSafe>& Run, const FString& Url)
+	{
+		// The request caches the page like any other, only the bytes actually transferred count against the budget.
+		FRequestUtils::ProcessGETRequest(Url, Run->UserToken, [Run](int ResponseCode, const FString& ResponseStr, int64 ContentLength)
+		{
+			OnTaskDone(Run, ContentLength);
+		},
+		ERequestPriority::Background,
+		Run->Token);
+	}
+
+	static void StartImageTask(const TSharedRef<FRun, ESPMode::ThreadSafe>& Run, const FString& Url)
+	{
+		// Covers are served by the image CDN, not the Web API, so they bypass the scheduler's rate limit.
+		TSharedRef<IHttpRequest> HttpRequest = FRequestUtils::CreateGETRequest(Url);
+		{
+			FScopeLock Lock(&Run->Mutex);
+			if (Run->Token->IsCancelled())
+			{
+				return;
+			}
+			Run->ImageRequests.Add(HttpRequest);
+		}
+
+		HttpRequest->OnProcessRequestComplete().BindLambda(
+			[Run, Url](FHttpRequestPtr Request, FHttpResponsePtr Response, bool bConnectedSuccessfully)
+			{
+				{
+					FScopeLock Lock(&Run->Mutex);
+					Run->ImageRequests.RemoveAll([&Request](const TSharedRef<IHttpRequest>& ImageRequest) { return &ImageRequest.Get() == Request.Get(); });
+				}
+
+				if (Run->Token->IsCancelled())
+				{
+					return;
+				}
+
+				int64 Bytes = 0;
+				if (bConnectedSuccessfully && Response.IsValid() && Response->GetResponseCode() == 200)
+				{
+					Bytes = Response->GetContent().Num();
+					Run->Store->AddImage(Url, MakeShared<const TArray<uint8>, ESPMode::ThreadSafe>(Response->GetContent()));
+				}
+				OnTaskDone(Run, Bytes);
+			}
+		);
+
+		HttpRequest->ProcessRequest();
+	}
+
+	static void OnTaskDone(const TSharedRef<FRun, ESPMode::ThreadSafe>& Run, const int64 Bytes)
+	{
+		{
+			FScopeLock Lock(&Run->Mutex);
+			Run->NumInFlight--;
+			Run->BytesReceived += Bytes;
+		}
+		Run->Store->RecordRequest(Bytes);
+
+		Pump(Run);
+	}
+
+	static double GetDecayedScore(const FOpenScore& OpenScore, const double Now)
+	{
+		return OpenScore.Score * FMath::Pow(0.5, (Now - OpenScore.LastOpened) / OpenScoreHalfLifeSeconds);
+	}
+
+	// Matches the first page RequestPlaylistTracks requests with a LimitOffset of (100, 0).
+	static constexpr int PrefetchPageLimit = 100;
+	// Opens count half as much after this long.
+	static constexpr double OpenScoreHalfLifeSeconds = 30.0 * 60.0;
+	// How often a run checks whether interactive work has drained.
+	static constexpr double YieldDelaySeconds = 0.25;
+
+	mutable FCriticalSection Mutex;
+	TMap<FString, FOpenScore> OpenScores;
+	FPrefetchBudget Budget;
+	FCancellationTokenPtr CurrentToken;
+	TSharedRef<FStore, ESPMode::ThreadSafe> Store = MakeShared<FStore, ESPMode::ThreadSafe>();
+};
@@ -2,7 +2,14 @@
 
 #pragma once
 
+#include "FieldProjection.h"
+#include "HAL/ThreadSafeCounter.h"
+#include "RequestBatcher.h"
+#include "RequestCoalescer.h"
+#include "RequestHandle.h"
 #include "RequestUtils.h"
+#include "SpotifyResult.h"
+#include "SpotifySDK/Tracks/SpotifyTrackDecoder.h"
 #include "SpotifySDK/Tracks/SpotifyTracks.h"
 #include "SpotifyPlaylists.generated.h"
 
@@ -22,6 +29,9 @@ public:
 	FString PlaylistId;
 	UPROPERTY(BlueprintReadWrite)
 	FString ImgUrl;
+	// Version identifier of the playlist, changes whenever its tracks change.
+	UPROPERTY(BlueprintReadWrite)
+	FString SnapshotId;
 };
 
 USTRUCT(BlueprintType)
@@ -36,9 +46,41 @@ public:
 	int TrackCount;
 };
 
+/**
+ * A single decoded page of a playlist's tracks, see FSpotifyPlaylists::RequestPlaylistTracksStreamed.
+ */
+struct FPlaylistTracksPage
+{
+	TArray<FTrackProfile> Tracks;
+	// Index of this page and the number of pages the request was split into.
+	int32 PageIndex = 0;
+	int32 NumPages = 0;
+	// Playlist offset of the first item in this page.
+	int Offset = 0;
+	// Total number of items reported by the playlist.
+	int TotalTracks = 0;
+	// Number of tracks delivered so far, including this page.
+	int NumTracksReceived = 0;
+};
+
+/**
+ * A single decoded page of a user's playlists, see FSpotifyPlaylists::RequestUserPlaylistsImpl.
+ */
+struct FUserPlaylistsPage
+{
+	TArray<FPlaylistProfile> Playlists;
+	// Total number of playlists reported by the user.
+	int TotalPlaylists = 0;
+};
+
 class FSpotifyPlaylists
 {
 public:
+	// Every request returns a handle, cancelling it stops the request (and its pagination) and
+	// suppresses its callbacks. Identical concurrent requests (same endpoint, params and token) are
+	// coalesced into a single in-flight operation whose result fans out to every caller.
+	// Failures are reported through OnFailure, the *Async variants return a TSpotifyFuture instead.
+
 	/**
 	 * Requests the playlist metadata of a Spotify playlist.
 	 * This function will retrieve playlist information.
@@ -46,310 +88,684 @@ public:
 	 * @param UserToken The access token for the Spotify user.
 	 * @param PlaylistId The ID of the Spotify playlist.
 	 * @param Callback A function that will be called with the retrieved playlists.
+	 * @param OnFailure An optional function that will be called with the error if the request fails.
+	 * @return A handle to cancel the request.
 	 */
-	static void RequestPlaylist(const FString& UserToken, const FString& PlaylistId, TFunction<void(const FPlaylistProfile& Playlist)> Callback)
+	static FSpotifyRequestHandle RequestPlaylist(const FString& UserToken, const FString& PlaylistId, TFunction<void(const FPlaylistProfile& Playlist)> Callback, TFunction<void(const FSpotifyError& Error)> OnFailure = nullptr)
+	{
+		static TRequestCoalescer<TSpotifyResult<FPlaylistProfile>> Coalescer;
+
+		return Coalescer.Run(TRequestCoalescer<TSpotifyResult<FPlaylistProfile>>::MakeKey(TEXT("Playlist"), UserToken, PlaylistId),
+			TSpotifyResult<FPlaylistProfile>::Dispatch(Callback, OnFailure),
+			[UserToken, PlaylistId](const FCancellationTokenRef& Token, TFunction<void(const TSpotifyResult<FPlaylistProfile>& Result)> Complete)
+			{
+				RequestPlaylistImpl(UserToken, PlaylistId, Token, [Complete](const TSpotifyResult<FPlaylistProfile>& Result)
+				{
+					FAsyncDecode::Deliver([Complete, Result]() { Complete(Result); });
+				});
+			}
+		);
+	}
+
+	/**
+	 * Future based variant of RequestPlaylist, cancelling the future cancels the request.
+	 */
+	static TSpotifyFuture<FPlaylistProfile> RequestPlaylistAsync(const FString& UserToken, const FString& PlaylistId)
+	{
+		TSpotifyPromise<FPlaylistProfile> Promise;
+		Promise.SetCancelHandler(RequestPlaylist(UserToken, PlaylistId, Promise.GetValueCallback(), Promise.GetErrorCallback()));
+		return Promise.GetFuture();
+	}
+
+	/**
+	 * Internal implementation of the RequestPlaylist function.
+	 * Its callback runs on a task graph worker and is always called, unless the request is cancelled.
+	 */
+	static void RequestPlaylistImpl(const FString& UserToken, const FString& PlaylistId, const FCancellationTokenPtr& CancellationToken, TFunction<void(const TSpotifyResult<FPlaylistProfile>& Result)> Callback)
 	{
 		FString BaseUrl = FString::Printf(
-			TEXT("https://api.spotify.com/v1/playlists/%s%ls"),
+			TEXT("%s/playlists/%s?fields=%s"),
+			*FRequestUtils::GetApiBaseUrl(),
 			*PlaylistId,
 			// We need to specify a field for this query to reduce payload size.
 			// Payload can exceed 10K lines, and can incur performance issues.
-			*FString("?fields=name%2Cid%2Cimages%2Cdescription%2Ctracks%28total%29")
+			*FFieldProjection::SinglePlaylist(EPlaylistFields::All)
 		);
 
-		TMap<FString, FString> Headers;
-		Headers.Add(TEXT("Authorization"), FString::Printf(TEXT("Bearer %s"), *UserToken));
-		TSharedRef<IHttpRequest> HttpRequest = FRequestUtils::CreateGETRequest(BaseUrl, Headers);
-
-		HttpRequest->OnProcessRequestComplete().BindLambda(
-			[&, Callback](FHttpRequestPtr Request, FHttpResponsePtr Response, bool bConnectedSuccessfully)
+		FRequestUtils::ProcessDecodedGETRequest<FPlaylistProfile>(BaseUrl, UserToken, &ParsePlaylist,
+			[Callback](int ResponseCode, const FString& ResponseStr, const FPlaylistProfile* Profile, const FString& RetryAfter)
 			{
-				if (bConnectedSuccessfully && Response.IsValid() && Response->GetResponseCode() == 200)
+				if (Profile)
 				{
-					FPlaylistProfile Profile;
-					FString ResponseStr = Response->GetContentAsString();
-
-					FRequestUtils::GetFieldEntry(*ResponseStr, "name", Profile.Name);
-					FRequestUtils::GetFieldEntry(*ResponseStr, "description", Profile.Description);
-					FRequestUtils::GetFieldEntry(*ResponseStr, "id", Profile.PlaylistId);
-
-					TSharedPtr<FJsonObject> TrackObject;
-					FRequestUtils::GetObjectEntry(*ResponseStr, "tracks", TrackObject);
-					FRequestUtils::GetFieldEntry(TrackObject, "total", Profile.TrackCount);
-
-					TArray<TSharedPtr<FJsonValue>> ImagesArray;
-					FRequestUtils::GetArrayEntry(*ResponseStr, "images", ImagesArray);
-					if (!FRequestUtils::GetFieldEntryAtIndex(ImagesArray, "url", 0, Profile.ImgUrl))
-					{
-						Profile.ImgUrl = TEXT_EMPTY;
-					}
-
-					Callback(Profile);
+					Callback(*Profile);
+				}
+				else if (ResponseCode == 200)
+				{
+					UE_LOG(LogTemp, Error, TEXT("Spotify Playlist response could not be decoded!!!"));
+					Callback(FSpotifyError::Make(ESpotifyErrorType::Decode, ResponseStr));
 				}
 				else
 				{
 					FString ErrorStr = TEXT("Spotify Playlist request failed!!!");
 					UE_LOG(LogTemp, Error, TEXT("%s"), *ErrorStr);
-					UE_LOG(LogTemp, Error, TEXT("Request Error: %s"), *Response->GetContentAsString());
+					UE_LOG(LogTemp, Error, TEXT("Request Error (%d): %s"), ResponseCode, *ResponseStr);
+
+					Callback(FSpotifyError::FromResponse(ResponseCode, ResponseStr, RetryAfter));
 				}
-			}
+			},
+			ERequestPriority::Interactive,
+			CancellationToken
 		);
+	}
+
+	/**
+	 * Parses the response of the playlist endpoint.
+	 * @param ResponseStr The raw response body.
+	 * @param OutProfile The parsed playlist.
+	 * @return True if the response was valid JSON.
+	 */
+	static bool ParsePlaylist(const FString& ResponseStr, FPlaylistProfile& OutProfile)
+	{
+		TSharedPtr<FJsonObject> ResponseObject;
+		if (!FRequestUtils::ParseResponseString(ResponseStr, ResponseObject))
+		{
+			return false;
+		}
 
-		HttpRequest->ProcessRequest();
+		FRequestUtils::GetFieldEntry(ResponseObject, "name", OutProfile.Name);
+		FRequestUtils::GetFieldEntry(ResponseObject, "description", OutProfile.Description);
+		FRequestUtils::GetFieldEntry(ResponseObject, "id", OutProfile.PlaylistId);
+		FRequestUtils::GetFieldEntry(ResponseObject, "snapshot_id", OutProfile.SnapshotId);
+
+		TSharedPtr<FJsonObject> TrackObject;
+		FRequestUtils::GetObjectEntry(ResponseObject, "tracks", TrackObject);
+		FRequestUtils::GetFieldEntry(TrackObject, "total", OutProfile.TrackCount);
+
+		TArray<TSharedPtr<FJsonValue>> ImagesArray;
+		FRequestUtils::GetArrayEntry(ResponseObject, "images", ImagesArray);
+		if (!FRequestUtils::GetFieldEntryAtIndex(ImagesArray, "url", 0, OutProfile.ImgUrl))
+		{
+			OutProfile.ImgUrl = TEXT_EMPTY;
+		}
+
+		return true;
 	}
 
 	/**
 	 * Requests multiple playlists in a batch.
-	 * This function will retrieve multiple playlists by their IDs.
+	 * This function will retrieve multiple playlists by their IDs, running up to MaxConcurrentRequests at once.
+	 * A failed playlist does not stall the batch, its ID is reported back instead.
 	 * @param UserToken The access token for the Spotify user.
 	 * @param PlaylistIds An array of playlist IDs to request.
-	 * @param Callback A function that will be called with the retrieved playlists.
+	 * @param Callback A function that will be called with the retrieved playlists (in the same order as PlaylistIds) and the IDs that failed.
+	 * @param MaxConcurrentRequests The maximum number of playlist requests in flight.
+	 * @return A handle to cancel the whole batch.
 	 */
-	static void BatchRequestPlaylists(const FString& UserToken, const TArray<FString>& PlaylistIds, TFunction<void(const TArray<FPlaylistProfile>& Playlists)> Callback)
+	static FSpotifyRequestHandle BatchRequestPlaylists(const FString& UserToken, const TArray<FString>& PlaylistIds, TFunction<void(const TArray<FPlaylistProfile>& Playlists, const TArray<FString>& FailedPlaylistIds)> Callback, const int MaxConcurrentRequests = 8)
 	{
-		TSharedRef<TArray<FPlaylistProfile>> Playlists = MakeShareable(new TArray<FPlaylistProfile>());
-		TSharedRef<TArray<FString>> RemainingPlaylistIds = MakeShareable(new TArray(PlaylistIds));
-		TSharedPtr<TFunction<void()>> Expand = MakeShared<TFunction<void()>>();
+		FCancellationTokenRef Token = MakeShared<FCancellationToken, ESPMode::ThreadSafe>();
+		TSharedRef<TArray<TOptional<FPlaylistProfile>>, ESPMode::ThreadSafe> Results = MakeShared<TArray<TOptional<FPlaylistProfile>>, ESPMode::ThreadSafe>();
+		Results->SetNum(PlaylistIds.Num());
 
-		*Expand = [=]()
+		FRequestBatcher::Run(PlaylistIds.Num(), MaxConcurrentRequests, [=](int32 Index, TFunction<void()> Done)
 		{
-			FString PlaylistId = RemainingPlaylistIds->Pop();
-			RequestPlaylist(UserToken, PlaylistId, [=](const FPlaylistProfile& Profile)
+			// Once cancelled no further entries are requested and the batch never completes.
+			RequestPlaylistImpl(UserToken, PlaylistIds[Index], Token, [=](const TSpotifyResult<FPlaylistProfile>& Result)
 			{
-				Playlists->Add(Profile);
-				if (RemainingPlaylistIds->Num() > 0) { (*Expand)(); }
-				else { Callback(*Playlists); }
+				if (Result.IsOk())
+				{
+					(*Results)[Index] = Result.GetValue();
+				}
+				Done();
 			});
-		};
+		},
+		[=]()
+		{
+			TArray<FPlaylistProfile> Playlists;
+			TArray<FString> FailedPlaylistIds;
+			Playlists.Reserve(Results->Num());
+
+			for (int32 Index = 0; Index < Results->Num(); ++Index)
+			{
+				if ((*Results)[Index].IsSet())
+				{
+					Playlists.Add(MoveTemp((*Results)[Index].GetValue()));
+				}
+				else
+				{
+					FailedPlaylistIds.Add(PlaylistIds[Index]);
+				}
+			}
+
+			FAsyncDecode::Deliver([Callback, Token, Playlists = MoveTemp(Playlists), FailedPlaylistIds = MoveTemp(FailedPlaylistIds)]()
+			{
+				if (!Token->IsCancelled())
+				{
+					Callback(Playlists, FailedPlaylistIds);
+				}
+			});
+		});
 
-		(*Expand)();
+		return FSpotifyRequestHandle(Token);
 	}
 
 	/**
 	 * Requests the playlists of a Spotify user.
-	 * This function will retrieve all playlists of the user, handling pagination
+	 * This function will retrieve all playlists of the user, handling pagination.
+	 * The first page reports the total, after which the remaining pages are requested concurrently
+	 * (up to MaxConcurrentPages in flight) and reassembled in playlist order.
 	 * ENDPOINT: https://developer.spotify.com/documentation/web-api/reference/get-list-users-playlists
 	 * @param UserToken The access token for the Spotify user.
 	 * @param UserId The ID of the Spotify user.
 	 * @param LimitOffset A pair containing the limit and offset for pagination.
 	 * @param Callback A function that will be called with the retrieved playlists.
+	 * @param MaxConcurrentPages The maximum number of page requests in flight, 1 fetches pages sequentially.
+	 * @param Fields The playlist members to request, everything else is projected out server-side.
+	 * @param OnFailure An optional function that will be called with the error if any page fails.
+	 * @return A handle to cancel the request and its remaining pages.
 	 */
-	static void RequestUserPlaylists(const FString& UserToken, const FString& UserId, const TPair<int, int> LimitOffset, TFunction<void(const TArray<FPlaylistProfile>& Playlists)> Callback)
+	static FSpotifyRequestHandle RequestUserPlaylists(const FString& UserToken, const FString& UserId, const TPair<int, int> LimitOffset, TFunction<void(const TArray<FPlaylistProfile>& Playlists)> Callback, const int MaxConcurrentPages = 1, const EPlaylistFields Fields = EPlaylistFields::All, TFunction<void(const FSpotifyError& Error)> OnFailure = nullptr)
 	{
-		TSharedRef<TArray<FPlaylistProfile>> Playlists = MakeShareable(new TArray<FPlaylistProfile>());
-		TSharedPtr<TFunction<void(TPair<int, int>)>> ExpandProfile = MakeShared<TFunction<void(TPair<int, int>)>>();
+		static TRequestCoalescer<TSpotifyResult<TArray<FPlaylistProfile>>> Coalescer;
 
-		*ExpandProfile = [=](TPair<int, int> LambdaLimitOffset)
-		{
-			RequestUserPlaylistsImpl(UserToken, UserId, LambdaLimitOffset, [=](const FString& ResponseStr)
-			{
-				int TotalPlaylists;
-				FRequestUtils::GetFieldEntry(*ResponseStr, "total", TotalPlaylists);
+		const FString FieldsQuery = FFieldProjection::UserPlaylists(Fields);
+		const FString Params = FString::Printf(TEXT("%s|%d|%d|%s"), *UserId, LimitOffset.Key, LimitOffset.Value, *FieldsQuery);
 
-				TArray<TSharedPtr<FJsonValue>> PlaylistsArray;
-				FRequestUtils::GetArrayEntry(*ResponseStr, "items", PlaylistsArray);
-
-				for (const TSharedPtr<FJsonValue>& PlaylistValue : PlaylistsArray)
-				{
-					FPlaylistProfile Profile;
+		return Coalescer.Run(TRequestCoalescer<TSpotifyResult<TArray<FPlaylistProfile>>>::MakeKey(TEXT("UserPlaylists"), UserToken, Params),
+			TSpotifyResult<TArray<FPlaylistProfile>>::Dispatch(Callback, OnFailure),
+			[=](const FCancellationTokenRef& Token, TFunction<void(const TSpotifyResult<TArray<FPlaylistProfile>>& Result)> Complete)
+			{
+				RequestUserPlaylistPages(UserToken, UserId, LimitOffset, MaxConcurrentPages, FieldsQuery, Token,
+					[Complete](const TArray<FPlaylistProfile>& Playlists) { Complete(Playlists); },
+					[Complete](const FSpotifyError& Error) { Complete(Error); });
+			}
+		);
+	}
 
-					FRequestUtils::GetFieldEntry(PlaylistValue, "name", Profile.Name);
-					FRequestUtils::GetFieldEntry(PlaylistValue, "description", Profile.Description);
+	/**
+	 * Future based variant of RequestUserPlaylists, cancelling the future cancels the request.
+	 */
+	static TSpotifyFuture<TArray<FPlaylistProfile>> RequestUserPlaylistsAsync(const FString& UserToken, const FString& UserId, const TPair<int, int> LimitOffset, const int MaxConcurrentPages = 1, const EPlaylistFields Fields = EPlaylistFields::All)
+	{
+		TSpotifyPromise<TArray<FPlaylistProfile>> Promise;
+		Promise.SetCancelHandler(RequestUserPlaylists(UserToken, UserId, LimitOffset, Promise.GetValueCallback(), MaxConcurrentPages, Fields, Promise.GetErrorCallback()));
+		return Promise.GetFuture();
+	}
 
-					TSharedPtr<FJsonObject> TrackObject;
-					FRequestUtils::GetObjectEntry(PlaylistValue, "tracks", TrackObject);
-					FRequestUtils::GetFieldEntry(TrackObject, "total", Profile.TrackCount);
+	/**
+	 * Internal driver of the user playlists pagination, both callbacks are delivered through FAsyncDecode::Deliver.
+	 * If any page fails OnFailure is called with the first error instead of Callback.
+	 * Once the token is cancelled no further pages are requested and neither callback is called.
+	 */
+	static void RequestUserPlaylistPages(const FString& UserToken, const FString& UserId, const TPair<int, int> LimitOffset, const int MaxConcurrentPages, const FString& FieldsQuery, const FCancellationTokenPtr& CancellationToken, TFunction<void(const TArray<FPlaylistProfile>& Playlists)> Callback, TFunction<void(const FSpotifyError& Error)> OnFailure = nullptr)
+	{
+		TFunction<void(const FSpotifyError& Error)> DeliverFailure = [OnFailure](const FSpotifyError& Error)
+		{
+			if (OnFailure)
+			{
+				FAsyncDecode::Deliver([OnFailure, Error]() { OnFailure(Error); });
+			}
+		};
 
-					FRequestUtils::GetFieldEntry(PlaylistValue, "id", Profile.PlaylistId);
+		RequestUserPlaylistsImpl(UserToken, UserId, LimitOffset, FieldsQuery, [=](const FUserPlaylistsPage& FirstPage)
+		{
+			TSharedRef<TArray<TArray<FPlaylistProfile>>> Pages = MakeShared<TArray<TArray<FPlaylistProfile>>>();
+			Pages->Add(FirstPage.Playlists);
+			const int TotalPlaylists = FirstPage.TotalPlaylists;
 
-					TArray<TSharedPtr<FJsonValue>> ImagesArray;
-					FRequestUtils::GetArrayEntry(PlaylistValue, "images", ImagesArray);
-					if (!FRequestUtils::GetFieldEntryAtIndex(ImagesArray, "url", 0, Profile.ImgUrl))
-					{
-						Profile.ImgUrl = TEXT_EMPTY;
-					}
+			// Spotify limits the number of playlists returned per request, it is limited to 50 playlists.
+			// So we can derive the remaining offset windows from the reported maximum (total playlists)
+			// and request them all at once.
+			const int FirstOffset = LimitOffset.Key + LimitOffset.Value;
+			const int NumPages = FMath::Max(0, FMath::DivideAndRoundUp(TotalPlaylists - FirstOffset, UserPlaylistsPageLimit));
+			Pages->AddDefaulted(NumPages);
 
-					Playlists->Add(Profile);
-				}
+			TSharedRef<FSpotifyFirstError, ESPMode::ThreadSafe> PageError = MakeShared<FSpotifyFirstError, ESPMode::ThreadSafe>();
 
-				// Spotify limits the number of tracks returned per request, it is limited to 100 tracks.
-				// So we can check against the reported maximum (total playlists) and keep requesting until
-				// we have all the users' playlists.
-				int CurrentTrackIndex = LambdaLimitOffset.Key + LambdaLimitOffset.Value;
-				if (CurrentTrackIndex < TotalPlaylists)
+			FRequestBatcher::Run(NumPages, MaxConcurrentPages, [=](int32 PageIndex, TFunction<void()> Done)
+			{
+				const TPair<int, int> PageLimitOffset(UserPlaylistsPageLimit, FirstOffset + PageIndex * UserPlaylistsPageLimit);
+				RequestUserPlaylistsImpl(UserToken, UserId, PageLimitOffset, FieldsQuery, [=](const FUserPlaylistsPage& Page)
+				{
+					(*Pages)[PageIndex + 1] = Page.Playlists;
+					Done();
+				}, CancellationToken,
+				[=](const FSpotifyError& Error)
 				{
-					(*ExpandProfile)(TPair<int, int>(50, CurrentTrackIndex));
+					// A failed page must not stall the batch, the error is reported once every page settled.
+					PageError->Set(Error);
+					Done();
+				});
+			},
+			[=]()
+			{
+				const TOptional<FSpotifyError> Error = PageError->Get();
+				if (Error.IsSet())
+				{
+					DeliverFailure(Error.GetValue());
+					return;
 				}
-				else
+
+				TArray<FPlaylistProfile> Playlists;
+				Playlists.Reserve(TotalPlaylists);
+				for (TArray<FPlaylistProfile>& Page : *Pages)
 				{
-					Callback(*Playlists);
+					Playlists.Append(MoveTemp(Page));
 				}
+				FAsyncDecode::Deliver([Callback, Playlists = MoveTemp(Playlists)]() { Callback(Playlists); });
 			});
-		};
+		}, CancellationToken, DeliverFailure);
+	}
+
+	/**
+	 * Parses a single page of the user playlists endpoint.
+	 * @param ResponseStr The raw response body of the page.
+	 * @param OutPlaylists The array the parsed playlists are appended to.
+	 * @return The total number of playlists reported by the endpoint, or -1 if the page was malformed.
+	 */
+	static int ParseUserPlaylistsPage(const FString& ResponseStr, TArray<FPlaylistProfile>& OutPlaylists)
+	{
+		TSharedPtr<FJsonObject> ResponseObject;
+		int TotalPlaylists = -1;
+		if (!FRequestUtils::ParseResponseString(ResponseStr, ResponseObject) || !FRequestUtils::GetFieldEntry(ResponseObject, "total", TotalPlaylists))
+		{
+			UE_LOG(LogTemp, Error, TEXT("Spotify User Playlists page could not be decoded!!!"));
+			return -1;
+		}
+
+		TArray<TSharedPtr<FJsonValue>> PlaylistsArray;
+		FRequestUtils::GetArrayEntry(ResponseObject, "items", PlaylistsArray);
+		OutPlaylists.Reserve(OutPlaylists.Num() + PlaylistsArray.Num());
+
+		for (const TSharedPtr<FJsonValue>& PlaylistValue : PlaylistsArray)
+		{
+			FPlaylistProfile Profile;
+
+			FRequestUtils::GetFieldEntry(PlaylistValue, "name", Profile.Name);
+			FRequestUtils::GetFieldEntry(PlaylistValue, "description", Profile.Description);
+
+			TSharedPtr<FJsonObject> TrackObject;
+			FRequestUtils::GetObjectEntry(PlaylistValue, "tracks", TrackObject);
+			FRequestUtils::GetFieldEntry(TrackObject, "total", Profile.TrackCount);
+
+			FRequestUtils::GetFieldEntry(PlaylistValue, "id", Profile.PlaylistId);
+			FRequestUtils::GetFieldEntry(PlaylistValue, "snapshot_id", Profile.SnapshotId);
+
+			TArray<TSharedPtr<FJsonValue>> ImagesArray;
+			FRequestUtils::GetArrayEntry(PlaylistValue, "images", ImagesArray);
+			if (!FRequestUtils::GetFieldEntryAtIndex(ImagesArray, "url", 0, Profile.ImgUrl))
+			{
+				Profile.ImgUrl = TEXT_EMPTY;
+			}
 
-		(*ExpandProfile)(LimitOffset);
+			OutPlaylists.Add(MoveTemp(Profile));
+		}
+
+		return TotalPlaylists;
 	}
 
 	/**
 	 * Internal implementation of the RequestUserPlaylists function.
-	 * This function is used to make the actual HTTP request.
+	 * This function is used to make the actual HTTP request, both callbacks run on a task graph worker.
+	 * Pages are decoded once and cached next to their body, a page that cannot be decoded is reported through OnFailure.
+	 * FieldsQuery is an (already url-encoded) `fields=` filter, see FFieldProjection.
 	 */
-	static void RequestUserPlaylistsImpl(const FString& UserToken, const FString& UserId, const TPair<int, int> LimitOffset, TFunction<void(const FString& Response)> Callback)
+	static void RequestUserPlaylistsImpl(const FString& UserToken, const FString& UserId, const TPair<int, int> LimitOffset, const FString& FieldsQuery, TFunction<void(const FUserPlaylistsPage& Page)> Callback, const FCancellationTokenPtr& CancellationToken = nullptr, TFunction<void(const FSpotifyError& Error)> OnFailure = nullptr)
 	{
 		FString BaseUrl = FString::Printf(
-			TEXT("https://api.spotify.com/v1/users/%s/playlists?limit=%d&offset=%d"),
+			TEXT("%s/users/%s/playlists?limit=%d&offset=%d"),
+			*FRequestUtils::GetApiBaseUrl(),
 			*UserId,
 			LimitOffset.Key,
 			LimitOffset.Value
 		);
+		if (!FieldsQuery.IsEmpty())
+		{
+			BaseUrl += FString::Printf(TEXT("&fields=%s"), *FieldsQuery);
+		}
 
-		TMap<FString, FString> Headers;
-		Headers.Add(TEXT("Authorization"), FString::Printf(TEXT("Bearer %s"), *UserToken));
-		TSharedRef<IHttpRequest> HttpRequest = FRequestUtils::CreateGETRequest(BaseUrl, Headers);
-
-		HttpRequest->OnProcessRequestComplete().BindLambda(
-			[Callback](FHttpRequestPtr Request, FHttpResponsePtr Response, bool bConnectedSuccessfully)
+		FRequestUtils::ProcessDecodedGETRequest<FUserPlaylistsPage>(BaseUrl, UserToken,
+			[](const FString& ResponseStr, FUserPlaylistsPage& OutPage)
+			{
+				OutPage.TotalPlaylists = ParseUserPlaylistsPage(ResponseStr, OutPage.Playlists);
+				return OutPage.TotalPlaylists >= 0;
+			},
+			[Callback, OnFailure](int ResponseCode, const FString& ResponseStr, const FUserPlaylistsPage* Page, const FString& RetryAfter)
 			{
-				if (bConnectedSuccessfully && Response.IsValid() && Response->GetResponseCode() == 200)
+				if (Page)
 				{
-					FString ResponseStr = Response->GetContentAsString();
-					Callback(ResponseStr);
+					Callback(*Page);
+				}
+				else if (ResponseCode == 200)
+				{
+					if (OnFailure)
+					{
+						OnFailure(FSpotifyError::Make(ESpotifyErrorType::Decode, ResponseStr));
+					}
 				}
 				else
 				{
 					FString ErrorStr = TEXT("Spotify User Playlists request failed!!!");
 					UE_LOG(LogTemp, Error, TEXT("%s"), *ErrorStr);
-					UE_LOG(LogTemp, Error, TEXT("Request Error: %s"), *Response->GetContentAsString());
+					UE_LOG(LogTemp, Error, TEXT("Request Error (%d): %s"), ResponseCode, *ResponseStr);
+
+					if (OnFailure)
+					{
+						OnFailure(FSpotifyError::FromResponse(ResponseCode, ResponseStr, RetryAfter));
+					}
 				}
-			}
+			},
+			ERequestPriority::Interactive,
+			CancellationToken
 		);
-
-		HttpRequest->ProcessRequest();
 	}
 
 	/**
 	 * Requests the playlists tracks of a Spotify playlist.
 	 * This function will retrieve all tracks of the playlist, handling pagination.
+	 * The first page reports the total, after which the remaining pages are requested concurrently
+	 * (up to MaxConcurrentPages in flight) and reassembled in playlist order.
+	 * Pages are decoded on task graph workers as they arrive.
 	 * Note: This function retrieves TRACKS and IGNORES Episodes
 	 * ENDPOINT: https://developer.spotify.com/documentation/web-api/reference/get-playlists-tracks
 	 * @param UserToken The access token for the Spotify user.
 	 * @param PlaylistId The ID of the Spotify playlist.
 	 * @param LimitOffset A pair containing the limit and offset for pagination.
 	 * @param Callback A function that will be called with the retrieved playlist tracks struct.
+	 * @param MaxConcurrentPages The maximum number of page requests in flight, 1 fetches pages sequentially.
+	 * @param Fields The track members to request, everything else is projected out server-side.
+	 * @param OnFailure An optional function that will be called with the error if any page fails.
+	 * @param OnPageDecoded An optional function that will be called on a task graph worker with every page as soon as it is decoded,
+	 * e.g. to index it. Only the caller that starts the request sees its pages, callers coalesced into it do not.
+	 * @return A handle to cancel the request and its remaining pages.
+	 */
+	static FSpotifyRequestHandle RequestPlaylistTracks(const FString& UserToken, const FString& PlaylistId, const TPair<int, int> LimitOffset, TFunction<void(const FPlaylistData& PlaylistData)> Callback, const int MaxConcurrentPages = 1, const ETrackFields Fields = ETrackFields::All, TFunction<void(const FSpotifyError& Error)> OnFailure = nullptr, TFunction<void(const FPlaylistTracksPage& Page)> OnPageDecoded = nullptr)
+	{
+		static TRequestCoalescer<TSpotifyResult<FPlaylistData>> Coalescer;
+
+		const FString Params = FString::Printf(TEXT("%s|%d|%d|%d"), *PlaylistId, LimitOffset.Key, LimitOffset.Value, static_cast<int32>(Fields));
+
+		return Coalescer.Run(TRequestCoalescer<TSpotifyResult<FPlaylistData>>::MakeKey(TEXT("PlaylistTracks"), UserToken, Params),
+			TSpotifyResult<FPlaylistData>::Dispatch(Callback, OnFailure),
+			[=](const FCancellationTokenRef& Token, TFunction<void(const TSpotifyResult<FPlaylistData>& Result)> Complete)
+			{
+				RequestAllPlaylistTracks(UserToken, PlaylistId, LimitOffset, MaxConcurrentPages, Fields, Token,
+					[Complete](const FPlaylistData& PlaylistData) { Complete(PlaylistData); },
+					[Complete](const FSpotifyError& Error) { Complete(Error); },
+					OnPageDecoded);
+			}
+		);
+	}
+
+	/**
+	 * Future based variant of RequestPlaylistTracks, cancelling the future cancels the request.
+	 */
+	static TSpotifyFuture<FPlaylistData> RequestPlaylistTracksAsync(const FString& UserToken, const FString& PlaylistId, const TPair<int, int> LimitOffset, const int MaxConcurrentPages = 1, const ETrackFields Fields = ETrackFields::All)
+	{
+		TSpotifyPromise<FPlaylistData> Promise;
+		Promise.SetCancelHandler(RequestPlaylistTracks(UserToken, PlaylistId, LimitOffset, Promise.GetValueCallback(), MaxConcurrentPages, Fields, Promise.GetErrorCallback()));
+		return Promise.GetFuture();
+	}
+
+	/**
+	 * Internal implementation of the RequestPlaylistTracks function, both callbacks are delivered through FAsyncDecode::Deliver.
+	 * OnPageDecoded runs on the decoding worker, see RequestPlaylistTrackPages for the order pages arrive in.
 	 */
-	static void RequestPlaylistTracks(const FString& UserToken, const FString& PlaylistId, const TPair<int, int> LimitOffset, TFunction<void(const FPlaylistData& PlaylistData)> Callback)
+	static void RequestAllPlaylistTracks(const FString& UserToken, const FString& PlaylistId, const TPair<int, int> LimitOffset, const int MaxConcurrentPages, const ETrackFields Fields, const FCancellationTokenPtr& CancellationToken, TFunction<void(const FPlaylistData& PlaylistData)> Callback, TFunction<void(const FSpotifyError& Error)> OnFailure = nullptr, TFunction<void(const FPlaylistTracksPage& Page)> OnPageDecoded = nullptr)
 	{
-		TSharedRef<FPlaylistData> PlaylistData = MakeShareable(new FPlaylistData());
-		TSharedPtr<TFunction<void(TPair<int, int>)>> ExpandPlaylist = MakeShared<TFunction<void(TPair<int, int>)>>();
+		TSharedRef<TArray<TArray<FTrackProfile>>, ESPMode::ThreadSafe> Pages = MakeShared<TArray<TArray<FTrackProfile>>, ESPMode::ThreadSafe>();
 
-		*ExpandPlaylist = [=](TPair<int, int> LambdaLimitOffset)
+		RequestPlaylistTrackPages(UserToken, PlaylistId, LimitOffset, MaxConcurrentPages, Fields, [Pages, OnPageDecoded](FPlaylistTracksPage&& Page)
 		{
-			RequestPlaylistTracksImpl(UserToken, PlaylistId, LambdaLimitOffset, [=](const FString& ResponseStr)
+			if (OnPageDecoded)
 			{
-				int TotalTracks;
-				FRequestUtils::GetFieldEntry(*ResponseStr, "total", TotalTracks);
+				OnPageDecoded(Page);
+			}
 
-				TArray<TSharedPtr<FJsonValue>> ItemsArray;
-				FRequestUtils::GetArrayEntry(*ResponseStr, "items", ItemsArray);
+			// The first page always lands before any other page is requested, so sizing here is race free
+			// and every later page writes to its own slot.
+			if (Page.PageIndex == 0)
+			{
+				Pages->SetNum(Page.NumPages);
+			}
+			(*Pages)[Page.PageIndex] = MoveTemp(Page.Tracks);
+		},
+		[Pages, Callback](int TotalTracks)
+		{
+			FPlaylistData PlaylistData;
+			PlaylistData.Tracks.Reserve(TotalTracks);
+			for (TArray<FTrackProfile>& Page : *Pages)
+			{
+				PlaylistData.Tracks.Append(MoveTemp(Page));
+			}
+			PlaylistData.TrackCount = PlaylistData.Tracks.Num();
+			FAsyncDecode::Deliver([Callback, PlaylistData = MoveTemp(PlaylistData)]() { Callback(PlaylistData); });
+		}, CancellationToken,
+		[OnFailure](const FSpotifyError& Error)
+		{
+			if (OnFailure)
+			{
+				FAsyncDecode::Deliver([OnFailure, Error]() { OnFailure(Error); });
+			}
+		});
+	}
 
-				for (const TSharedPtr<FJsonValue>& ItemsValue : ItemsArray)
+	/**
+	 * Requests the playlists tracks of a Spotify playlist, delivering each page as soon as it is decoded.
+	 * Unlike RequestPlaylistTracks nothing is retained, so callers can render progressively and drop
+	 * pages they no longer need. With more than one page in flight pages may arrive out of order,
+	 * use FPlaylistTracksPage::Offset to place them.
+	 * ENDPOINT: https://developer.spotify.com/documentation/web-api/reference/get-playlists-tracks
+	 * @param UserToken The access token for the Spotify user.
+	 * @param PlaylistId The ID of the Spotify playlist.
+	 * @param LimitOffset A pair containing the limit and offset for pagination.
+	 * @param OnPage A function that will be called with every decoded page.
+	 * @param OnComplete A function that will be called with the reported total once every page has been delivered.
+	 * @param MaxConcurrentPages The maximum number of page requests in flight, 1 fetches pages sequentially (and in order).
+	 * @param Fields The track members to request, everything else is projected out server-side.
+	 * @param OnFailure An optional function that will be called with the first error instead of OnComplete if any page fails.
+	 * @return A handle to cancel the request, no further pages are delivered once it is cancelled.
+	 */
+	static FSpotifyRequestHandle RequestPlaylistTracksStreamed(const FString& UserToken, const FString& PlaylistId, const TPair<int, int> LimitOffset, TFunction<void(const FPlaylistTracksPage& Page)> OnPage, TFunction<void(int TotalTracks)> OnComplete, const int MaxConcurrentPages = 1, const ETrackFields Fields = ETrackFields::All, TFunction<void(const FSpotifyError& Error)> OnFailure = nullptr)
+	{
+		// Streamed requests are not coalesced, a late subscriber would miss the pages already delivered.
+		FCancellationTokenRef Token = MakeShared<FCancellationToken, ESPMode::ThreadSafe>();
+
+		RequestPlaylistTrackPages(UserToken, PlaylistId, LimitOffset, MaxConcurrentPages, Fields, [OnPage, Token](FPlaylistTracksPage&& Page)
+		{
+			FAsyncDecode::Deliver([OnPage, Token, Page = MoveTemp(Page)]()
+			{
+				if (!Token->IsCancelled())
+				{
+					OnPage(Page);
+				}
+			});
+		},
+		[OnComplete, Token](int TotalTracks)
+		{
+			// Queued behind the delivery of the last page, so completion is always observed last.
+			FAsyncDecode::Deliver([OnComplete, Token, TotalTracks]()
+			{
+				if (!Token->IsCancelled())
+				{
+					OnComplete(TotalTracks);
+				}
+			});
+		}, Token,
+		[OnFailure, Token](const FSpotifyError& Error)
+		{
+			if (OnFailure)
+			{
+				FAsyncDecode::Deliver([OnFailure, Token, Error]()
 				{
-					// We need to verify that the track is not a locally added track as there are no preview URLs
-					// for those tracks.
-					bool bIsLocalTrack = false;
-					FRequestUtils::GetFieldEntry(ItemsValue, "is_local", bIsLocalTrack);
-					if (!bIsLocalTrack)
+					if (!Token->IsCancelled())
 					{
-						FTrackProfile Profile;
-
-						TSharedPtr<FJsonObject> TrackObject;
-						FRequestUtils::GetObjectEntry(ItemsValue, "track", TrackObject);
+						OnFailure(Error);
+					}
+				});
+			}
+		});
 
-						FRequestUtils::GetFieldEntry(TrackObject, "name", Profile.Name);
-						FRequestUtils::GetFieldEntry(TrackObject, "id", Profile.TrackId);
-						FRequestUtils::GetFieldEntry(TrackObject, "duration_ms", Profile.DurationMs);
+		return FSpotifyRequestHandle(Token);
+	}
 
-						TArray<TSharedPtr<FJsonValue>> ArtistsArray;
-						FRequestUtils::GetArrayEntry(TrackObject, "artists", ArtistsArray);
+	/**
+	 * Internal driver of the playlist tracks pagination.
+	 * Every callback runs on task graph workers. OnPage is called for page 0 before any other page is
+	 * requested, after which it may be called concurrently for the remaining pages. A page that fails
+	 * is not delivered, and once every page settled OnFailure is called with the first error instead of OnComplete.
+	 * Once the token is cancelled no further pages are requested and neither OnComplete nor OnFailure is called.
+	 */
+	static void RequestPlaylistTrackPages(const FString& UserToken, const FString& PlaylistId, const TPair<int, int> LimitOffset, const int MaxConcurrentPages, const ETrackFields Fields, TFunction<void(FPlaylistTracksPage&& Page)> OnPage, TFunction<void(int TotalTracks)> OnComplete, const FCancellationTokenPtr& CancellationToken = nullptr, TFunction<void(const FSpotifyError& Error)> OnFailure = nullptr)
+	{
+		const FString FieldsQuery = FFieldProjection::PlaylistTracks(Fields);
 
-						for (const TSharedPtr<FJsonValue>& ArtistValue : ArtistsArray)
-						{
-							TArray<FString>& Artists = Profile.Artists;
-							FString Artist;
+		RequestPlaylistTracksImpl(UserToken, PlaylistId, LimitOffset, FieldsQuery, [=](const FPlaylistTracksPage& DecodedFirstPage)
+		{
+			// The decoded page is shared with the response cache, every delivery gets its own copy.
+			FPlaylistTracksPage FirstPage = DecodedFirstPage;
+			const int TotalTracks = FirstPage.TotalTracks;
 
-							FRequestUtils::GetFieldEntry(ArtistValue, "name", Artist);
-							Artists.Add(Artist);
-						}
+			// Spotify limits the number of tracks returned per request, it is limited to 100 tracks.
+			// So we can derive the remaining offset windows from the reported maximum (total tracks)
+			// and request them all at once.
+			const int FirstOffset = LimitOffset.Key + LimitOffset.Value;
+			const int NumPages = FMath::Max(0, FMath::DivideAndRoundUp(TotalTracks - FirstOffset, PlaylistTracksPageLimit));
 
-						TSharedPtr<FJsonObject> AlbumObject;
-						FRequestUtils::GetObjectEntry(TrackObject, "album", AlbumObject);
+			TSharedRef<FThreadSafeCounter, ESPMode::ThreadSafe> NumTracksReceived = MakeShared<FThreadSafeCounter, ESPMode::ThreadSafe>(FirstPage.Tracks.Num());
 
-						FRequestUtils::GetFieldEntry(AlbumObject, "id", Profile.AlbumId);
-						FRequestUtils::GetFieldEntry(AlbumObject, "release_date", Profile.AlbumReleaseDate);
+			FirstPage.PageIndex = 0;
+			FirstPage.NumPages = NumPages + 1;
+			FirstPage.Offset = LimitOffset.Value;
+			FirstPage.NumTracksReceived = FirstPage.Tracks.Num();
+			OnPage(MoveTemp(FirstPage));
 
-						TArray<TSharedPtr<FJsonValue>> ImagesArray;
-						FRequestUtils::GetArrayEntry(AlbumObject, "images", ImagesArray);
-						FRequestUtils::GetFieldEntryAtIndex(ImagesArray, "url", 0, Profile.ImgUrl);
+			TSharedRef<FSpotifyFirstError, ESPMode::ThreadSafe> PageError = MakeShared<FSpotifyFirstError, ESPMode::ThreadSafe>();
 
-						PlaylistData->Tracks.Add(Profile);
-					}
-				}
-
-				// Spotify limits the number of tracks returned per request, it is limited to 100 tracks.
-				// So we can check against the reported maximum (total tracks) and keep requesting until
-				// we have all the tracks.
-				int CurrentTrackIndex = LambdaLimitOffset.Key + LambdaLimitOffset.Value;
-				if (CurrentTrackIndex < TotalTracks)
+			FRequestBatcher::Run(NumPages, MaxConcurrentPages, [=](int32 PageIndex, TFunction<void()> Done)
+			{
+				const TPair<int, int> PageLimitOffset(PlaylistTracksPageLimit, FirstOffset + PageIndex * PlaylistTracksPageLimit);
+				RequestPlaylistTracksImpl(UserToken, PlaylistId, PageLimitOffset, FieldsQuery, [=](const FPlaylistTracksPage& DecodedPage)
 				{
-					(*ExpandPlaylist)(TPair<int, int>(100, CurrentTrackIndex));
+					FPlaylistTracksPage Page = DecodedPage;
+					Page.PageIndex = PageIndex + 1;
+					Page.NumPages = NumPages + 1;
+					Page.Offset = PageLimitOffset.Value;
+					Page.TotalTracks = TotalTracks;
+					Page.NumTracksReceived = NumTracksReceived->Add(Page.Tracks.Num()) + Page.Tracks.Num();
+					OnPage(MoveTemp(Page));
+
+					Done();
+				}, CancellationToken,
+				[=](const FSpotifyError& Error)
+				{
+					// A failed page must not stall the batch, the error is reported once every page settled.
+					PageError->Set(Error);
+					Done();
+				});
+			},
+			[=]()
+			{
+				const TOptional<FSpotifyError> Error = PageError->Get();
+				if (!Error.IsSet())
+				{
+					OnComplete(TotalTracks);
 				}
-				else
+				else if (OnFailure)
 				{
-					PlaylistData->TrackCount = PlaylistData->Tracks.Num();
-					Callback(*PlaylistData);
+					OnFailure(Error.GetValue());
 				}
 			});
-		};
-
-		(*ExpandPlaylist)(LimitOffset);
+		}, CancellationToken, OnFailure);
 	}
 
 	/**
-	 * Internal implementation of the RequestPlaylistTracks function.
-	 * This function is used to make the actual HTTP request.
+	 * Parses a single page of the playlist tracks endpoint.
+	 * Locally added tracks are skipped.
+	 * The page is decoded in a single streaming pass (see FSpotifyTrackDecoder), no JSON DOM is built.
+	 * @param ResponseStr The raw response body of the page.
+	 * @param OutTracks The array the parsed tracks are appended to.
+	 * @return The total number of tracks reported by the endpoint, or -1 if the page was malformed.
 	 */
-	static void RequestPlaylistTracksImpl(const FString& UserToken, const FString& PlaylistId, const TPair<int, int> LimitOffset, TFunction<void(const FString& Response)> Callback)
+	static int ParsePlaylistTracksPage(const FString& ResponseStr, TArray<FTrackProfile>& OutTracks)
 	{
-		FString BaseUrl = FString::Printf(
-			TEXT("https://api.spotify.com/v1/playlists/%s/tracks?limit=%d&offset=%d"),
-			*PlaylistId,
-			LimitOffset.Key,
-			LimitOffset.Value
-		);
+		OutTracks.Reserve(OutTracks.Num() + PlaylistTracksPageLimit);
+
+		const int TotalTracks = FSpotifyTrackDecoder::DecodePlaylistTracksPage(ResponseStr, OutTracks);
+		if (TotalTracks < 0)
+		{
+			UE_LOG(LogTemp, Error, TEXT("Spotify Playlist Tracks page could not be decoded!!!"));
+		}
 
-		TMap<FString, FString> Headers;
-		Headers.Add(TEXT("Authorization"), FString::Printf(TEXT("Bearer %s"), *UserToken));
-		TSharedRef<IHttpRequest> HttpRequest = FRequestUtils::CreateGETRequest(BaseUrl, Headers);
+		return TotalTracks;
+	}
 
-		HttpRequest->OnProcessRequestComplete().BindLambda(
-			[&, Callback](FHttpRequestPtr Request, FHttpResponsePtr Response, bool bConnectedSuccessfully)
+	/**
+	 * Internal implementation of the RequestPlaylistTracks function.
+	 * This function is used to make the actual HTTP request, both callbacks run on a task graph worker.
+	 * Pages are decoded once (only Tracks and TotalTracks are set) and cached next to their body,
+	 * a page that cannot be decoded is reported through OnFailure.
+	 * FieldsQuery is an (already url-encoded) `fields=` filter, see FFieldProjection.
+	 */
+	static void RequestPlaylistTracksImpl(const FString& UserToken, const FString& PlaylistId, const TPair<int, int> LimitOffset, const FString& FieldsQuery, TFunction<void(const FPlaylistTracksPage& Page)> Callback, const FCancellationTokenPtr& CancellationToken = nullptr, TFunction<void(const FSpotifyError& Error)> OnFailure = nullptr)
+	{
+		FRequestUtils::ProcessDecodedGETRequest<FPlaylistTracksPage>(MakePlaylistTracksUrl(PlaylistId, LimitOffset, FieldsQuery), UserToken,
+			[](const FString& ResponseStr, FPlaylistTracksPage& OutPage)
+			{
+				OutPage.TotalTracks = ParsePlaylistTracksPage(ResponseStr, OutPage.Tracks);
+				return OutPage.TotalTracks >= 0;
+			},
+			[Callback, OnFailure](int ResponseCode, const FString& ResponseStr, const FPlaylistTracksPage* Page, const FString& RetryAfter)
 			{
-				if (bConnectedSuccessfully && Response.IsValid() && Response->GetResponseCode() == 200)
+				if (Page)
 				{
-					FString ResponseStr = Response->GetContentAsString();
-					Callback(ResponseStr);
+					Callback(*Page);
+				}
+				else if (ResponseCode == 200)
+				{
+					if (OnFailure)
+					{
+						OnFailure(FSpotifyError::Make(ESpotifyErrorType::Decode, ResponseStr));
+					}
 				}
 				else
 				{
 					FString ErrorStr = TEXT("Spotify Playlist Tracks request failed!!!");
 					UE_LOG(LogTemp, Error, TEXT("%s"), *ErrorStr);
-					UE_LOG(LogTemp, Error, TEXT("Request Error: %s"), *Response->GetContentAsString());
+					UE_LOG(LogTemp, Error, TEXT("Request Error (%d): %s"), ResponseCode, *ResponseStr);
+
+					if (OnFailure)
+					{
+						OnFailure(FSpotifyError::FromResponse(ResponseCode, ResponseStr, RetryAfter));
+					}
 				}
-			}
+			},
+			ERequestPriority::Interactive,
+			CancellationToken
 		);
+	}
 
-		HttpRequest->ProcessRequest();
+	/**
+	 * Builds the url of a single playlist tracks page, identical requests share their response cache entry.
+	 */
+	static FString MakePlaylistTracksUrl(const FString& PlaylistId, const TPair<int, int> LimitOffset, const FString& FieldsQuery)
+	{
+		FString BaseUrl = FString::Printf(
+			TEXT("%s/playlists/%s/tracks?limit=%d&offset=%d"),
+			*FRequestUtils::GetApiBaseUrl(),
+			*PlaylistId,
+			LimitOffset.Key,
+			LimitOffset.Value
+		);
+		if (!FieldsQuery.IsEmpty())
+		{
+			BaseUrl += FString::Printf(TEXT("&fields=%s"), *FieldsQuery);
+		}
+		return BaseUrl;
 	}
 
 private:
+	// Maximum page sizes accepted by the paginated endpoints.
+	static constexpr int UserPlaylistsPageLimit = 50;
+	static constexpr int PlaylistTracksPageLimit = 100;
 };
@@ -0,0 +1,82 @@
+﻿// Copyright (c) Harris Barra. (MIT License)
+
+#include <SpotifySDK.h>
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include "Misc/AutomationTest.h"
+#include "HAL/FileManager.h"
+
+// Tests of the on-disk format of FSpotifyLibraryCache.
+// Playlists are compared by the names of their tracks, in playlist order.
+
+namespace SpotifyLibraryCacheTests
+{
+	static void Store(FSpotifyLibraryCache& Cache, const FString& PlaylistId, const TArray<TPair<FString, FString>>& Tracks)
+	{
+		FPlaylistProfile Profile;
+		Profile.PlaylistId = PlaylistId;
+		Profile.SnapshotId = PlaylistId;
+		Profile.TrackCount = Tracks.Num();
+
+		FPlaylistData Data;
+		Data.TrackCount = Tracks.Num();
+		for (const TPair<FString, FString>& Track : Tracks)
+		{
+			FTrackProfile& TrackProfile = Data.Tracks.AddDefaulted_GetRef();
+			TrackProfile.TrackId = Track.Key;
+			TrackProfile.Name = Track.Value;
+			TrackProfile.DurationMs = 0;
+		}
+		Cache.Update(Profile, Data);
+	}
+
+	static FString TrackNames(const FSpotifyLibraryCache& Cache, const FString& PlaylistId)
+	{
+		FCachedPlaylist Playlist;
+		if (!Cache.Find(PlaylistId, Playlist))
+		{
+			return TEXT("<missing>");
+		}
+
+		TArray<FString> Names;
+		for (const FTrackProfileRef& Track : Playlist.Tracks)
+		{
+			Names.Add(Track->Name);
+		}
+		return FString::Join(Names, TEXT(" "));
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FSpotifyLibraryCacheRoundTripTest, "SpotifySDK.LibraryCache.RoundTrip", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FSpotifyLibraryCacheRoundTripTest::RunTest(const FString& Parameters)
+{
+	using namespace SpotifyLibraryCacheTests;
+
+	const FString Path = FPaths::Combine(FPaths::AutomationTransientDir(), TEXT("SpotifyLibraryCache.bin"));
+	ON_SCOPE_EXIT { IFileManager::Get().Delete(*Path); };
+
+	// A playlist stored before a track changed keeps the old version, local tracks all have an empty id.
+	FSpotifyLibraryCache Saved;
+	Store(Saved, TEXT("before"), { { TEXT("t"), TEXT("Old") }, { TEXT("u"), TEXT("Same") } });
+	Store(Saved, TEXT("after"), { { TEXT("u"), TEXT("Same") }, { TEXT("t"), TEXT("New") } });
+	Store(Saved, TEXT("local"), { { FString(), TEXT("LocalA") }, { FString(), TEXT("LocalB") }, { FString(), TEXT("LocalA") } });
+	if (!TestTrue(TEXT("Saved"), Saved.Save(Path)))
+	{
+		return false;
+	}
+
+	FSpotifyLibraryCache Loaded;
+	if (!TestTrue(TEXT("Loaded"), Loaded.Load(Path)))
+	{
+		return false;
+	}
+	TestEqual(TEXT("Old version"), TrackNames(Loaded, TEXT("before")), FString(TEXT("Old Same")));
+	TestEqual(TEXT("New version"), TrackNames(Loaded, TEXT("after")), FString(TEXT("Same New")));
+	TestEqual(TEXT("Empty ids"), TrackNames(Loaded, TEXT("local")), FString(TEXT("LocalA LocalB LocalA")));
+	TestFalse(TEXT("Clean after load"), Loaded.HasUnsavedChanges());
+	return true;
+}
+
+#endif
@@ -0,0 +1,115 @@
+﻿// Copyright (c) Harris Barra. (MIT License)
+
+#include <SpotifySDK.h>
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include "Misc/AutomationTest.h"
+
+// Tests of the track level diff reported by FSpotifyLibrarySync.
+// Diffs are compared in a compact form: "+id@new" per added, "-id@old" per removed and "~id:old>new" per moved track,
+// each group in the order FSpotifyLibrarySync::DiffTracks reports it.
+
+namespace SpotifyLibrarySyncTests
+{
+	static TArray<FTrackProfile> MakeTracks(const TArray<FString>& TrackIds)
+	{
+		TArray<FTrackProfile> Tracks;
+		for (const FString& TrackId : TrackIds)
+		{
+			FTrackProfile& Track = Tracks.AddDefaulted_GetRef();
+			Track.TrackId = TrackId;
+			Track.Name = TrackId;
+			Track.DurationMs = 0;
+		}
+		return Tracks;
+	}
+
+	static FString Diff(const TArray<FString>& OldTrackIds, const TArray<FString>& NewTrackIds)
+	{
+		FPlaylistDiff PlaylistDiff;
+		FSpotifyLibrarySync::DiffTracks(MakeTracks(OldTrackIds), MakeTracks(NewTrackIds), PlaylistDiff);
+
+		TArray<FString> Changes;
+		for (const FPlaylistTrackAdded& Added : PlaylistDiff.Added)
+		{
+			Changes.Add(FString::Printf(TEXT("+%s@%d"), *Added.Track.TrackId, Added.Index));
+		}
+		for (const FPlaylistTrackRemoved& Removed : PlaylistDiff.Removed)
+		{
+			Changes.Add(FString::Printf(TEXT("-%s@%d"), *Removed.TrackId, Removed.Index));
+		}
+		for (const FPlaylistTrackMoved& Moved : PlaylistDiff.Moved)
+		{
+			Changes.Add(FString::Printf(TEXT("~%s:%d>%d"), *Moved.TrackId, Moved.FromIndex, Moved.ToIndex));
+		}
+		return FString::Join(Changes, TEXT(" "));
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FSpotifyLibrarySyncDiffAddTest, "SpotifySDK.LibrarySync.DiffTracks.Add", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FSpotifyLibrarySyncDiffAddTest::RunTest(const FString& Parameters)
+{
+	using namespace SpotifyLibrarySyncTests;
+
+	TestEqual(TEXT("Unchanged"), Diff({ TEXT("a"), TEXT("b") }, { TEXT("a"), TEXT("b") }), FString());
+	TestEqual(TEXT("Inserted"), Diff({ TEXT("a"), TEXT("b"), TEXT("c") }, { TEXT("a"), TEXT("x"), TEXT("b"), TEXT("c") }), FString(TEXT("+x@1")));
+	TestEqual(TEXT("Appended"), Diff({ TEXT("a") }, { TEXT("a"), TEXT("x"), TEXT("y") }), FString(TEXT("+x@1 +y@2")));
+	TestEqual(TEXT("Into empty"), Diff({}, { TEXT("a"), TEXT("b") }), FString(TEXT("+a@0 +b@1")));
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FSpotifyLibrarySyncDiffRemoveTest, "SpotifySDK.LibrarySync.DiffTracks.Remove", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FSpotifyLibrarySyncDiffRemoveTest::RunTest(const FString& Parameters)
+{
+	using namespace SpotifyLibrarySyncTests;
+
+	TestEqual(TEXT("Removed"), Diff({ TEXT("a"), TEXT("b"), TEXT("c") }, { TEXT("a"), TEXT("c") }), FString(TEXT("-b@1")));
+	TestEqual(TEXT("Cleared"), Diff({ TEXT("a"), TEXT("b") }, {}), FString(TEXT("-a@0 -b@1")));
+	TestEqual(TEXT("Replaced"), Diff({ TEXT("a"), TEXT("b") }, { TEXT("a"), TEXT("x") }), FString(TEXT("+x@1 -b@1")));
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FSpotifyLibrarySyncDiffMoveTest, "SpotifySDK.LibrarySync.DiffTracks.Move", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FSpotifyLibrarySyncDiffMoveTest::RunTest(const FString& Parameters)
+{
+	using namespace SpotifyLibrarySyncTests;
+
+	// Only the track that left the longest in-order run is reported, not the ones it shifted.
+	TestEqual(TEXT("Moved to the end"), Diff({ TEXT("a"), TEXT("b"), TEXT("c"), TEXT("d") }, { TEXT("a"), TEXT("c"), TEXT("d"), TEXT("b") }), FString(TEXT("~b:1>3")));
+	TestEqual(TEXT("Moved to the front"), Diff({ TEXT("a"), TEXT("b"), TEXT("c"), TEXT("d") }, { TEXT("d"), TEXT("a"), TEXT("b"), TEXT("c") }), FString(TEXT("~d:3>0")));
+	TestEqual(TEXT("Moved with an insert and a removal"), Diff({ TEXT("a"), TEXT("b"), TEXT("c") }, { TEXT("c"), TEXT("x"), TEXT("a") }), FString(TEXT("+x@1 -b@1 ~c:2>0")));
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FSpotifyLibrarySyncDiffRepeatedTest, "SpotifySDK.LibrarySync.DiffTracks.Repeated", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FSpotifyLibrarySyncDiffRepeatedTest::RunTest(const FString& Parameters)
+{
+	using namespace SpotifyLibrarySyncTests;
+
+	// Repeats are matched by occurrence, the first new copy takes the first old one.
+	TestEqual(TEXT("Unchanged repeats"), Diff({ TEXT("a"), TEXT("a"), TEXT("b") }, { TEXT("a"), TEXT("a"), TEXT("b") }), FString());
+	TestEqual(TEXT("Added repeat"), Diff({ TEXT("a"), TEXT("b") }, { TEXT("a"), TEXT("b"), TEXT("a") }), FString(TEXT("+a@2")));
+	TestEqual(TEXT("Removed repeats"), Diff({ TEXT("a"), TEXT("a"), TEXT("a") }, { TEXT("a") }), FString(TEXT("-a@1 -a@2")));
+	TestEqual(TEXT("Moved repeat"), Diff({ TEXT("a"), TEXT("b"), TEXT("a") }, { TEXT("a"), TEXT("a"), TEXT("b") }), FString(TEXT("~a:2>1")));
+	TestEqual(TEXT("Moved around repeats"), Diff({ TEXT("a"), TEXT("b"), TEXT("a") }, { TEXT("b"), TEXT("a"), TEXT("a"), TEXT("a") }), FString(TEXT("+a@3 ~b:1>0")));
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FSpotifyLibrarySyncDiffReverseTest, "SpotifySDK.LibrarySync.DiffTracks.Reverse", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FSpotifyLibrarySyncDiffReverseTest::RunTest(const FString& Parameters)
+{
+	using namespace SpotifyLibrarySyncTests;
+
+	// Every run of a reversed list has length one, all but one track move.
+	TestEqual(TEXT("Reversed"), Diff({ TEXT("a"), TEXT("b"), TEXT("c"), TEXT("d") }, { TEXT("d"), TEXT("c"), TEXT("b"), TEXT("a") }), FString(TEXT("~d:3>0 ~c:2>1 ~b:1>2")));
+	TestEqual(TEXT("Swapped"), Diff({ TEXT("a"), TEXT("b") }, { TEXT("b"), TEXT("a") }), FString(TEXT("~b:1>0")));
+	return true;
+}
+
+#endif
@@ -10,10 +10,17 @@ void FSpotifySDKModule::StartupModule()
 {
 	// This will execute at runtime as soon as the module is loaded into mem
 	Singleton = this;
+
+	FRequestScheduler::Get().SetUnauthorizedHandler([this](TFunction<void(bool bRefreshed)> OnRefreshed)
+	{
+		GetSpotifyAuth().RefreshAccessToken(MoveTemp(OnRefreshed));
+	});
 }
 
 void FSpotifySDKModule::ShutdownModule()
 {
+	PlaylistPrefetcher->Cancel();
+	FRequestScheduler::Get().Shutdown();
 	Singleton = nullptr;
 }
 
@@ -0,0 +1,546 @@
+﻿// Copyright (c) Harris Barra. (MIT License)
+
+#include <SpotifySDK.h>
+
+#if WITH_SPOTIFYSDK_BENCHMARK
+
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformMemory.h"
+#include "HttpPath.h"
+#include "HttpServerModule.h"
+#include "HttpServerRequest.h"
+#include "HttpServerResponse.h"
+#include "IHttpRouter.h"
+#include "Math/RandomStream.h"
+
+// Offline benchmark of the request and decode paths.
+// A local HTTP server replays Spotify shaped payloads and every SDK request is redirected to it, so the
+// full scheduler -> HTTP -> decode -> delivery path is measured without network access.
+// Usage: SpotifySDK.Benchmark [Scenario=all|user|playlists500|tracks1k|tracks10k|tracks50k|preview]
+//        [Iterations=3] [Concurrency=4] [LatencyMs=0] [ThrottleRate=0] [RateLimit=1000] [TimeoutSeconds=60] [Port=8089]
+
+struct FSpotifyBenchmarkConfig
+{
+	FString Scenario = TEXT("all");
+	int32 Iterations = 3;
+	int32 Concurrency = 4;
+	// Delay added to every mock response.
+	float LatencyMs = 0.0f;
+	// Fraction (0-1) of mock responses answered with a 429.
+	float ThrottleRate = 0.0f;
+	// Scheduler rate limit while the benchmark runs, the default would dominate every measurement.
+	float RateLimit = 1000.0f;
+	// An iteration still running after this long fails its scenario, e.g. when throttling outlasts the retries.
+	float TimeoutSeconds = 60.0f;
+	int32 Port = 8089;
+};
+
+class FSpotifyMockServer
+{
+public:
+	// Payloads are generated in the shape of the Web API responses on first use and replayed afterwards.
+	// Sizes are encoded in the ids, e.g. user "bench500" owns 500 playlists and playlist "bench10000" has 10000 tracks.
+
+	bool Start(const FSpotifyBenchmarkConfig& InConfig)
+	{
+		Config = InConfig;
+		Random.Initialize(0x5EED);
+
+		Router = FHttpServerModule::Get().GetHttpRouter(Config.Port);
+		if (!Router.IsValid())
+		{
+			UE_LOG(LogTemp, Error, TEXT("Spotify benchmark could not bind port %d"), Config.Port);
+			return false;
+		}
+
+		Bind(TEXT("/v1/me"), [this](const FHttpServerRequest& Request, const FHttpResultCallback& OnComplete)
+		{
+			Respond(TEXT("me"), [this]() { return MakeUserPayload(); }, OnComplete);
+		});
+
+		Bind(TEXT("/v1/users"), [this](const FHttpServerRequest& Request, const FHttpResultCallback& OnComplete)
+		{
+			// /{user_id}/playlists
+			const TArray<FString> Segments = GetSegments(Request);
+			const int32 NumPlaylists = Segments.Num() > 0 ? GetSize(Segments[0]) : 0;
+			const int32 Limit = GetQueryParam(Request, TEXT("limit"), 20);
+			const int32 Offset = GetQueryParam(Request, TEXT("offset"), 0);
+
+			Respond(FString::Printf(TEXT("users/%d/%d/%d"), NumPlaylists, Limit, Offset), [=]() { return MakeUserPlaylistsPayload(NumPlaylists, Limit, Offset); }, OnComplete);
+		});
+
+		Bind(TEXT("/v1/playlists"), [this](const FHttpServerRequest& Request, const FHttpResultCallback& OnComplete)
+		{
+			// /{playlist_id} or /{playlist_id}/tracks
+			const TArray<FString> Segments = GetSegments(Request);
+			const FString PlaylistId = Segments.Num() > 0 ? Segments[0] : FString();
+			const int32 NumTracks = GetSize(PlaylistId);
+
+			if (Segments.Num() > 1)
+			{
+				const int32 Limit = GetQueryParam(Request, TEXT("limit"), 100);
+				const int32 Offset = GetQueryParam(Request, TEXT("offset"), 0);
+				Respond(FString::Printf(TEXT("tracks/%s/%d/%d"), *PlaylistId, Limit, Offset), [=]() { return MakePlaylistTracksPayload(PlaylistId, NumTracks, Limit, Offset); }, OnComplete);
+			}
+			else
+			{
+				Respond(FString::Printf(TEXT("playlist/%s"), *PlaylistId), [=]() { return MakePlaylistPayload(PlaylistId, NumTracks); }, OnComplete);
+			}
+		});
+
+		Bind(TEXT("/embed/track"), [this](const FHttpServerRequest& Request, const FHttpResultCallback& OnComplete)
+		{
+			const TArray<FString> Segments = GetSegments(Request);
+			const FString TrackId = Segments.Num() > 0 ? Segments[0] : FString();
+			Respond(FString::Printf(TEXT("embed/%s"), *TrackId), [=]() { return MakeEmbedPayload(TrackId); }, OnComplete);
+		});
+
+		FHttpServerModule::Get().StartAllListeners();
+		return true;
+	}
+
+	void Stop()
+	{
+		if (Router.IsValid())
+		{
+			for (const FHttpRouteHandle& Route : Routes)
+			{
+				Router->UnbindRoute(Route);
+			}
+		}
+		Routes.Reset();
+		Router.Reset();
+
+		FHttpServerModule::Get().StopAllListeners();
+	}
+
+	FString GetApiBaseUrl() const { return FString::Printf(TEXT("http://127.0.0.1:%d/v1"), Config.Port); }
+	FString GetEmbedBaseUrl() const { return FString::Printf(TEXT("http://127.0.0.1:%d/embed"), Config.Port); }
+
+	int32 GetNumThrottled() const { return NumThrottled; }
+
+private:
+	void Bind(const TCHAR* Path, TFunction<void(const FHttpServerRequest& Request, const FHttpResultCallback& OnComplete)> Handler)
+	{
+		Routes.Add(Router->BindRoute(FHttpPath(Path), EHttpServerRequestVerbs::VERB_GET, FHttpRequestHandler::CreateLambda(
+			[Handler](const FHttpServerRequest& Request, const FHttpResultCallback& OnComplete)
+			{
+				Handler(Request, OnComplete);
+				return true;
+			}
+		)));
+	}
+
+	void Respond(const FString& Key, TFunction<FString()> MakePayload, const FHttpResultCallback& OnComplete)
+	{
+		FString* Payload = Payloads.Find(Key);
+		if (!Payload)
+		{
+			Payload = &Payloads.Add(Key, MakePayload());
+		}
+
+		const bool bThrottle = Config.ThrottleRate > 0.0f && Random.FRand() < Config.ThrottleRate;
+		NumThrottled += bThrottle ? 1 : 0;
+
+		auto Complete = [OnComplete, Body = bThrottle ? FString() : *Payload, bThrottle]()
+		{
+			TUniquePtr<FHttpServerResponse> Response = FHttpServerResponse::Create(Body, TEXT("application/json"));
+			if (bThrottle)
+			{
+				Response->Code = EHttpServerResponseCodes::TooManyRequests;
+				Response->Headers.Add(TEXT("Retry-After"), { TEXT("0") });
+			}
+			OnComplete(MoveTemp(Response));
+		};
+
+		if (Config.LatencyMs <= 0.0f)
+		{
+			Complete();
+			return;
+		}
+
+		FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateLambda([Complete](float DeltaTime)
+		{
+			Complete();
+			return false;
+		}), Config.LatencyMs / 1000.0f);
+	}
+
+	static TArray<FString> GetSegments(const FHttpServerRequest& Request)
+	{
+		TArray<FString> Segments;
+		Request.RelativePath.GetPath().ParseIntoArray(Segments, TEXT("/"));
+		return Segments;
+	}
+
+	static int32 GetQueryParam(const FHttpServerRequest& Request, const TCHAR* Name, const int32 DefaultValue)
+	{
+		const FString* Value = Request.QueryParams.Find(Name);
+		return Value ? FCString::Atoi(**Value) : DefaultValue;
+	}
+
+	// The trailing number of an id, e.g. bench10000 -> 10000.
+	static int32 GetSize(const FString& Id)
+	{
+		int32 Index = Id.Len();
+		while (Index > 0 && FChar::IsDigit(Id[Index - 1]))
+		{
+			Index--;
+		}
+		return FCString::Atoi(*Id.Mid(Index));
+	}
+
+	static FString MakeUserPayload()
+	{
+		return TEXT("{\"display_name\":\"Benchmark\",\"id\":\"bench500\",\"email\":\"bench@example.com\",\"uri\":\"spotify:user:bench500\",\"images\":[{\"url\":\"https://i.scdn.co/image/bench\"}]}");
+	}
+
+	static FString MakeUserPlaylistsPayload(const int32 NumPlaylists, const int32 Limit, const int32 Offset)
+	{
+		FString Items;
+		for (int32 Index = Offset; Index < FMath::Min(NumPlaylists, Offset + Limit); ++Index)
+		{
+			Items += FString::Printf(TEXT("%s{\"name\":\"Playlist %d\",\"description\":\"Benchmark playlist %d\",\"id\":\"bench%d\",\"snapshot_id\":\"snapshot%d\",\"tracks\":{\"total\":%d},\"images\":[{\"url\":\"https://i.scdn.co/image/playlist%d\"}]}"),
+				Items.IsEmpty() ? TEXT("") : TEXT(","), Index, Index, 100 + Index, Index, 100 + Index, Index);
+		}
+		return FString::Printf(TEXT("{\"total\":%d,\"items\":[%s]}"), NumPlaylists, *Items);
+	}
+
+	static FString MakePlaylistPayload(const FString& PlaylistId, const int32 NumTracks)
+	{
+		return FString::Printf(TEXT("{\"name\":\"%s\",\"description\":\"Benchmark playlist\",\"id\":\"%s\",\"snapshot_id\":\"snapshot%d\",\"tracks\":{\"total\":%d},\"images\":[{\"url\":\"https://i.scdn.co/image/%s\"}]}"),
+			*PlaylistId, *PlaylistId, NumTracks, NumTracks, *PlaylistId);
+	}
+
+	static FString MakePlaylistTracksPayload(const FString& PlaylistId, const int32 NumTracks, const int32 Limit, const int32 Offset)
+	{
+		FString Items;
+		Items.Reserve(Limit * 400);
+		for (int32 Index = Offset; Index < FMath::Min(NumTracks, Offset + Limit); ++Index)
+		{
+			// Ids are 22 characters like real base62 ids, albums and artists repeat like in a real library.
+			Items += FString::Printf(TEXT("%s{\"is_local\":false,\"track\":{\"name\":\"Track %d\",\"id\":\"BenchTrack%012d\",\"duration_ms\":%d,")
+				TEXT("\"artists\":[{\"name\":\"Artist %d\"},{\"name\":\"Artist %d\"}],")
+				TEXT("\"album\":{\"name\":\"Album %d\",\"release_date\":\"20%02d-01-01\",\"id\":\"BenchAlbum%012d\",\"images\":[{\"url\":\"https://i.scdn.co/image/album%d\"}]}}}"),
+				Items.IsEmpty() ? TEXT("") : TEXT(","), Index, Index, 120000 + Index % 180000,
+				Index % 500, (Index * 7) % 500,
+				Index / 12, Index % 25, Index / 12, Index / 12);
+		}
+		return FString::Printf(TEXT("{\"total\":%d,\"items\":[%s]}"), NumTracks, *Items);
+	}
+
+	static FString MakeEmbedPayload(const FString& TrackId)
+	{
+		// The embed page is a few hundred KB of markup with the preview url buried near the end.
+		FString Html = TEXT("<!DOCTYPE html><html><head><title>Spotify Embed</title></head><body><script id=\"__NEXT_DATA__\" type=\"application/json\">");
+		Html.Reserve(256 * 1024);
+		while (Html.Len() < 200 * 1024)
+		{
+			Html += TEXT("{\"type\":\"track\",\"uri\":\"spotify:track:filler\",\"coverArt\":{\"sources\":[{\"url\":\"https://i.scdn.co/image/filler\"}]}},");
+		}
+		Html += FString::Printf(TEXT("{\"audioPreview\":{\"url\":\"https://p.scdn.co/mp3-preview/%s\"}}</script></body></html>"), *TrackId);
+		return Html;
+	}
+
+	FSpotifyBenchmarkConfig Config;
+	FRandomStream Random;
+	TSharedPtr<IHttpRouter> Router;
+	TArray<FHttpRouteHandle> Routes;
+	TMap<FString, FString> Payloads;
+	int32 NumThrottled = 0;
+};
+
+class FSpotifyBenchmark : public TSharedFromThis<FSpotifyBenchmark>
+{
+public:
+	explicit FSpotifyBenchmark(const FSpotifyBenchmarkConfig& InConfig) : Config(InConfig) {}
+
+	bool Start()
+	{
+		AddScenario(TEXT("user"), [](TFunction<void(int32 NumItems)> Done, TFunction<void(const FSpotifyError& Error)> Fail)
+		{
+			return FSpotifyUser::RequestUserProfile(BenchmarkToken, [Done](const FUserProfile& Profile) { Done(1); }, Fail);
+		});
+		AddScenario(TEXT("playlists500"), [this](TFunction<void(int32 NumItems)> Done, TFunction<void(const FSpotifyError& Error)> Fail)
+		{
+			return FSpotifyPlaylists::RequestUserPlaylists(BenchmarkToken, TEXT("bench500"), TPair<int, int>(50, 0), [Done](const TArray<FPlaylistProfile>& Playlists) { Done(Playlists.Num()); }, Config.Concurrency, EPlaylistFields::All, Fail);
+		});
+		for (const int32 NumTracks : { 1000, 10000, 50000 })
+		{
+			AddScenario(FString::Printf(TEXT("tracks%dk"), NumTracks / 1000), [this, NumTracks](TFunction<void(int32 NumItems)> Done, TFunction<void(const FSpotifyError& Error)> Fail)
+			{
+				return FSpotifyPlaylists::RequestPlaylistTracks(BenchmarkToken, FString::Printf(TEXT("bench%d"), NumTracks), TPair<int, int>(100, 0), [Done](const FPlaylistData& PlaylistData) { Done(PlaylistData.Tracks.Num()); }, Config.Concurrency, ETrackFields::All, Fail);
+			});
+		}
+		AddScenario(TEXT("preview"), [this](TFunction<void(int32 NumItems)> Done, TFunction<void(const FSpotifyError& Error)> Fail)
+		{
+			constexpr int32 NumPreviews = 50;
+			FCancellationTokenRef Token = MakeShared<FCancellationToken, ESPMode::ThreadSafe>();
+			FRequestBatcher::Run(NumPreviews, Config.Concurrency, [Token, Fail](int32 Index, TFunction<void()> TaskDone)
+			{
+				if (!Token->IsCancelled())
+				{
+					FSpotifyTracks::RequestTrackPreviewUrl(FString::Printf(TEXT("BenchTrack%012d"), Index), [TaskDone](const FString& Url) { TaskDone(); }, Fail);
+				}
+			},
+			[Done]() { Done(NumPreviews); });
+			return FSpotifyRequestHandle(Token);
+		});
+
+		if (Scenarios.Num() == 0)
+		{
+			UE_LOG(LogTemp, Error, TEXT("Spotify benchmark: unknown scenario %s"), *Config.Scenario);
+			return false;
+		}
+
+		if (!Server.Start(Config))
+		{
+			return false;
+		}
+
+		FRequestUtils::SetBaseUrls(Server.GetApiBaseUrl(), Server.GetEmbedBaseUrl());
+		FRequestScheduler::Get().GetRateLimit(PreviousRateLimit, PreviousBurstSize);
+		FRequestScheduler::Get().SetRateLimit(Config.RateLimit, FMath::CeilToInt(Config.RateLimit));
+
+		// The runner is only safe to drive from the game thread.
+		PreviousCallbackThread = FAsyncDecode::GetCallbackThread();
+		FAsyncDecode::SetCallbackThread(ECallbackThread::GameThread);
+
+		// Samples memory every frame and fails iterations that never complete.
+		TickerHandle = FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateLambda([WeakThis = TWeakPtr<FSpotifyBenchmark>(AsShared())](float DeltaTime)
+		{
+			TSharedPtr<FSpotifyBenchmark> This = WeakThis.Pin();
+			if (!This.IsValid())
+			{
+				return false;
+			}
+
+			This->SampleMemory();
+			if (This->IsRunning() && FPlatformTime::Seconds() - This->IterationStartTime > This->Config.TimeoutSeconds)
+			{
+				This->FailIteration(FString::Printf(TEXT("timed out after %.0fs"), This->Config.TimeoutSeconds));
+			}
+			return true;
+		}));
+
+		UE_LOG(LogTemp, Log, TEXT("Spotify benchmark: %d scenario(s), %d iteration(s), concurrency %d, latency %.0fms, throttle rate %.2f, timeout %.0fs"),
+			Scenarios.Num(), Config.Iterations, Config.Concurrency, Config.LatencyMs, Config.ThrottleRate, Config.TimeoutSeconds);
+		UE_LOG(LogTemp, Log, TEXT("Spotify benchmark: for allocation counts run with -trace=memory and inspect the SpotifySDK_ scopes in Insights"));
+
+		RunNext();
+		return true;
+	}
+
+	bool IsRunning() const { return ScenarioIndex < Scenarios.Num(); }
+
+private:
+	struct FScenario
+	{
+		FString Name;
+		TFunction<FSpotifyRequestHandle(TFunction<void(int32 NumItems)> Done, TFunction<void(const FSpotifyError& Error)> Fail)> Run;
+		TArray<double> Durations;
+		int32 NumItems = 0;
+		int64 NumRequests = 0;
+		int64 BytesReceived = 0;
+		// Largest growth over the iteration's starting memory, at completion and at any sampled frame.
+		int64 UsedPhysicalDelta = 0;
+		int64 PeakUsedPhysicalDelta = 0;
+	};
+
+	void AddScenario(const FString& Name, TFunction<FSpotifyRequestHandle(TFunction<void(int32 NumItems)> Done, TFunction<void(const FSpotifyError& Error)> Fail)> Run)
+	{
+		if (Config.Scenario == TEXT("all") || Config.Scenario == Name)
+		{
+			Scenarios.Add({ Name, MoveTemp(Run) });
+		}
+	}
+
+	void RunNext()
+	{
+		if (ScenarioIndex >= Scenarios.Num())
+		{
+			Finish();
+			return;
+		}
+
+		FScenario& Scenario = Scenarios[ScenarioIndex];
+
+		// Every iteration must go over the (mock) network.
+		FResponseCache::Get().Clear();
+		FRequestStats::Get().Reset();
+
+		// Callbacks of an iteration that has since completed, failed or timed out are ignored.
+		const int32 IterationId = ++CurrentIterationId;
+		UsedPhysicalBefore = FPlatformMemory::GetStats().UsedPhysical;
+		PeakUsedPhysical = UsedPhysicalBefore;
+		IterationStartTime = FPlatformTime::Seconds();
+
+		const TWeakPtr<FSpotifyBenchmark> WeakThis = AsShared();
+		FSpotifyRequestHandle Handle = Scenario.Run(
+			[WeakThis, IterationId](int32 NumItems)
+			{
+				TSharedPtr<FSpotifyBenchmark> This = WeakThis.Pin();
+				if (This.IsValid() && This->CurrentIterationId == IterationId)
+				{
+					This->CompleteIteration(NumItems);
+				}
+			},
+			[WeakThis, IterationId](const FSpotifyError& Error)
+			{
+				TSharedPtr<FSpotifyBenchmark> This = WeakThis.Pin();
+				if (This.IsValid() && This->CurrentIterationId == IterationId)
+				{
+					This->FailIteration(FString::Printf(TEXT("request failed (%d): %s"), Error.HttpStatus, *Error.Message));
+				}
+			});
+
+		// Callbacks may be delivered before Run returns, the iteration is then already over.
+		if (CurrentIterationId == IterationId)
+		{
+			IterationHandle = Handle;
+		}
+	}
+
+	void CompleteIteration(const int32 NumItems)
+	{
+		FScenario& Scenario = Scenarios[ScenarioIndex];
+		Scenario.Durations.Add(FPlatformTime::Seconds() - IterationStartTime);
+		Scenario.NumItems = NumItems;
+
+		SampleMemory();
+		const int64 UsedPhysical = static_cast<int64>(FPlatformMemory::GetStats().UsedPhysical);
+		Scenario.UsedPhysicalDelta = FMath::Max<int64>(Scenario.UsedPhysicalDelta, UsedPhysical - static_cast<int64>(UsedPhysicalBefore));
+		Scenario.PeakUsedPhysicalDelta = FMath::Max<int64>(Scenario.PeakUsedPhysicalDelta, static_cast<int64>(PeakUsedPhysical) - static_cast<int64>(UsedPhysicalBefore));
+
+		int64 NumRequests = 0;
+		int64 BytesReceived = 0;
+		for (const TPair<FString, FSpotifyEndpointStats>& Pair : FRequestStats::Get().GetStats())
+		{
+			NumRequests += Pair.Value.NumRequests;
+			BytesReceived += Pair.Value.BytesReceived;
+		}
+		Scenario.NumRequests = NumRequests;
+		Scenario.BytesReceived = BytesReceived;
+
+		IterationHandle = FSpotifyRequestHandle();
+		if (Scenario.Durations.Num() >= Config.Iterations)
+		{
+			Report(Scenario);
+			ScenarioIndex++;
+		}
+		RunNext();
+	}
+
+	/**
+	 * Abandons the current iteration and skips the rest of its scenario.
+	 */
+	void FailIteration(const FString& Reason)
+	{
+		CurrentIterationId++;
+		IterationHandle.Cancel();
+		IterationHandle = FSpotifyRequestHandle();
+
+		const FScenario& Scenario = Scenarios[ScenarioIndex];
+		UE_LOG(LogTemp, Error, TEXT("Spotify benchmark [%s]: iteration %d %s, skipping the scenario"), *Scenario.Name, Scenario.Durations.Num() + 1, *Reason);
+		if (Scenario.Durations.Num() > 0)
+		{
+			Report(Scenario);
+		}
+		NumFailedScenarios++;
+
+		ScenarioIndex++;
+		RunNext();
+	}
+
+	void SampleMemory()
+	{
+		PeakUsedPhysical = FMath::Max<uint64>(PeakUsedPhysical, FPlatformMemory::GetStats().UsedPhysical);
+	}
+
+	void Report(const FScenario& Scenario) const
+	{
+		double Min = TNumericLimits<double>::Max();
+		double Max = 0.0;
+		double Total = 0.0;
+		for (const double Duration : Scenario.Durations)
+		{
+			Min = FMath::Min(Min, Duration);
+			Max = FMath::Max(Max, Duration);
+			Total += Duration;
+		}
+		const double Average = Total / FMath::Max(1, Scenario.Durations.Num());
+
+		UE_LOG(LogTemp, Log, TEXT("Spotify benchmark [%s]: %d items, %lld requests, %.1f KB | e2e %.1fms avg (%.1f min, %.1f max) | %.0f items/s, %.1f requests/s | memory +%.1f MB, peak +%.1f MB"),
+			*Scenario.Name, Scenario.NumItems, Scenario.NumRequests, Scenario.BytesReceived / 1024.0,
+			Average * 1000.0, Min * 1000.0, Max * 1000.0,
+			Scenario.NumItems / FMath::Max(Average, UE_DOUBLE_SMALL_NUMBER), Scenario.NumRequests / FMath::Max(Average, UE_DOUBLE_SMALL_NUMBER),
+			Scenario.UsedPhysicalDelta / (1024.0 * 1024.0), Scenario.PeakUsedPhysicalDelta / (1024.0 * 1024.0));
+	}
+
+	void Finish()
+	{
+		UE_LOG(LogTemp, Log, TEXT("Spotify benchmark finished, %d scenario(s) failed, %d mock responses were throttled"), NumFailedScenarios, Server.GetNumThrottled());
+
+		FTSTicker::GetCoreTicker().RemoveTicker(TickerHandle);
+		TickerHandle.Reset();
+
+		Server.Stop();
+		FRequestUtils::SetBaseUrls(FString(), FString());
+		FRequestScheduler::Get().SetRateLimit(PreviousRateLimit, PreviousBurstSize);
+		FAsyncDecode::SetCallbackThread(PreviousCallbackThread);
+		FResponseCache::Get().Clear();
+	}
+
+	static constexpr const TCHAR* BenchmarkToken = TEXT("benchmark");
+
+	FSpotifyBenchmarkConfig Config;
+	FSpotifyMockServer Server;
+	TArray<FScenario> Scenarios;
+	int32 ScenarioIndex = 0;
+	int32 NumFailedScenarios = 0;
+	int32 CurrentIterationId = 0;
+	FSpotifyRequestHandle IterationHandle;
+	double IterationStartTime = 0.0;
+	uint64 UsedPhysicalBefore = 0;
+	uint64 PeakUsedPhysical = 0;
+	FTSTicker::FDelegateHandle TickerHandle;
+	float PreviousRateLimit = 0.0f;
+	int32 PreviousBurstSize = 0;
+	ECallbackThread PreviousCallbackThread = ECallbackThread::GameThread;
+};
+
+static TSharedPtr<FSpotifyBenchmark> ActiveBenchmark;
+
+static FAutoConsoleCommand SpotifyBenchmarkCommand(
+	TEXT("SpotifySDK.Benchmark"),
+	TEXT("Benchmarks the SDK against a local mock server. Args: Scenario=all|user|playlists500|tracks1k|tracks10k|tracks50k|preview Iterations=3 Concurrency=4 LatencyMs=0 ThrottleRate=0 RateLimit=1000 TimeoutSeconds=60 Port=8089"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		if (ActiveBenchmark.IsValid() && ActiveBenchmark->IsRunning())
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Spotify benchmark is already running"));
+			return;
+		}
+
+		const FString ArgsStr = FString::Join(Args, TEXT(" "));
+		FSpotifyBenchmarkConfig Config;
+		FParse::Value(*ArgsStr, TEXT("Scenario="), Config.Scenario);
+		FParse::Value(*ArgsStr, TEXT("Iterations="), Config.Iterations);
+		FParse::Value(*ArgsStr, TEXT("Concurrency="), Config.Concurrency);
+		FParse::Value(*ArgsStr, TEXT("LatencyMs="), Config.LatencyMs);
+		FParse::Value(*ArgsStr, TEXT("ThrottleRate="), Config.ThrottleRate);
+		FParse::Value(*ArgsStr, TEXT("RateLimit="), Config.RateLimit);
+		FParse::Value(*ArgsStr, TEXT("TimeoutSeconds="), Config.TimeoutSeconds);
+		FParse::Value(*ArgsStr, TEXT("Port="), Config.Port);
+		Config.Iterations = FMath::Max(1, Config.Iterations);
+		Config.Concurrency = FMath::Max(1, Config.Concurrency);
+
+		ActiveBenchmark = MakeShared<FSpotifyBenchmark>(Config);
+		if (!ActiveBenchmark->Start())
+		{
+			ActiveBenchmark.Reset();
+		}
+	})
+);
+
+#endif
@@ -0,0 +1,60 @@
+﻿// Copyright (c) Harris Barra. (MIT License)
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Async/Async.h"
+#include <atomic>
+
+/**
+ * The thread endpoint callbacks are delivered on.
+ * WorkerThread skips the hop back to the game thread, but callbacks may then run concurrently
+ * with each other and with the game thread.
+ */
+enum class ECallbackThread : uint8
+{
+	GameThread,
+	WorkerThread
+};
+
+class FAsyncDecode
+{
+public:
+	// This is a utility class for moving response decoding off the game thread.
+	// Response handling (string conversion, JSON parsing, struct building) runs on a task graph
+	// worker, and only the final endpoint callback is marshalled back to the game thread.
+
+	/**
+	 * Runs decoding work on a task graph worker.
+	 * @param Work The work to run.
+	 */
+	static void Launch(TUniqueFunction<void()> Work)
+	{
+		AsyncTask(ENamedThreads::AnyBackgroundThreadNormalTask, MoveTemp(Work));
+	}
+
+	/**
+	 * Delivers an endpoint callback on the configured callback thread.
+	 * @param Callback The function invoking the endpoint callback.
+	 */
+	static void Deliver(TUniqueFunction<void()> Callback)
+	{
+		if (GetCallbackThread() == ECallbackThread::WorkerThread || IsInGameThread())
+		{
+			Callback();
+			return;
+		}
+
+		AsyncTask(ENamedThreads::GameThread, MoveTemp(Callback));
+	}
+
+	static ECallbackThread GetCallbackThread() { return CallbackThreadSetting().load(std::memory_order_relaxed); }
+	static void SetCallbackThread(const ECallbackThread CallbackThread) { CallbackThreadSetting().store(CallbackThread, std::memory_order_relaxed); }
+
+private:
+	static std::atomic<ECallbackThread>& CallbackThreadSetting()
+	{
+		static std::atomic<ECallbackThread> CallbackThread { ECallbackThread::GameThread };
+		return CallbackThread;
+	}
+};
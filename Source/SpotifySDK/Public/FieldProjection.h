@@ -0,0 +1,120 @@
+﻿// Copyright (c) Harris Barra. (MIT License)
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "PlatformHttp.h"
+
+/**
+ * The FTrackProfile members a caller wants populated.
+ * Used to derive the server-side `fields=` projection of track payloads.
+ */
+enum class ETrackFields : uint8
+{
+	None				= 0,
+	Name				= 1 << 0,
+	TrackId				= 1 << 1,
+	DurationMs			= 1 << 2,
+	Artists				= 1 << 3,
+	AlbumReleaseDate	= 1 << 4,
+	AlbumId				= 1 << 5,
+	ImgUrl				= 1 << 6,
+	AlbumName			= 1 << 7,
+	All					= Name | TrackId | DurationMs | Artists | AlbumReleaseDate | AlbumId | ImgUrl | AlbumName
+};
+ENUM_CLASS_FLAGS(ETrackFields);
+
+/**
+ * The FPlaylistProfile members a caller wants populated.
+ * Used to derive the server-side `fields=` projection of playlist payloads.
+ */
+enum class EPlaylistFields : uint8
+{
+	None				= 0,
+	Name				= 1 << 0,
+	Description			= 1 << 1,
+	TrackCount			= 1 << 2,
+	PlaylistId			= 1 << 3,
+	ImgUrl				= 1 << 4,
+	SnapshotId			= 1 << 5,
+	All					= Name | Description | TrackCount | PlaylistId | ImgUrl | SnapshotId
+};
+ENUM_CLASS_FLAGS(EPlaylistFields);
+
+class FFieldProjection
+{
+public:
+	// This is a utility class for building Spotify `fields=` filters from the struct members a caller needs.
+	// Full item objects carry every available_markets array, which is most of the payload, so
+	// every paged request should be projected down to what is actually decoded.
+	// SEE: https://developer.spotify.com/documentation/web-api/reference/get-playlists-tracks
+
+	/**
+	 * Builds the (url-encoded) fields filter for a playlist tracks page.
+	 * Pagination and local-track filtering fields are always included.
+	 * @param Fields The track members to request.
+	 * @return The url-encoded filter, to be used as the value of the `fields` query parameter.
+	 */
+	static FString PlaylistTracks(const ETrackFields Fields)
+	{
+		return FPlatformHttp::UrlEncode(FString::Printf(TEXT("total,items(is_local,track(%s))"), *Track(Fields)));
+	}
+
+	/**
+	 * Builds the (url-encoded) fields filter for a user playlists page.
+	 * The pagination total is always included.
+	 * @param Fields The playlist members to request.
+	 * @return The url-encoded filter, to be used as the value of the `fields` query parameter.
+	 */
+	static FString UserPlaylists(const EPlaylistFields Fields)
+	{
+		return FPlatformHttp::UrlEncode(FString::Printf(TEXT("total,items(%s)"), *Playlist(Fields)));
+	}
+
+	/**
+	 * Builds the (url-encoded) fields filter for a single playlist.
+	 * @param Fields The playlist members to request.
+	 * @return The url-encoded filter, to be used as the value of the `fields` query parameter.
+	 */
+	static FString SinglePlaylist(const EPlaylistFields Fields)
+	{
+		return FPlatformHttp::UrlEncode(Playlist(Fields));
+	}
+
+private:
+	static FString Track(const ETrackFields Fields)
+	{
+		TArray<FString, TInlineAllocator<6>> Parts;
+		if (EnumHasAnyFlags(Fields, ETrackFields::Name)) { Parts.Add(TEXT("name")); }
+		// The id is always requested as it is the identity of the record.
+		Parts.Add(TEXT("id"));
+		if (EnumHasAnyFlags(Fields, ETrackFields::DurationMs)) { Parts.Add(TEXT("duration_ms")); }
+		if (EnumHasAnyFlags(Fields, ETrackFields::Artists)) { Parts.Add(TEXT("artists(name)")); }
+
+		TArray<FString, TInlineAllocator<4>> AlbumParts;
+		if (EnumHasAnyFlags(Fields, ETrackFields::AlbumId)) { AlbumParts.Add(TEXT("id")); }
+		if (EnumHasAnyFlags(Fields, ETrackFields::AlbumName)) { AlbumParts.Add(TEXT("name")); }
+		if (EnumHasAnyFlags(Fields, ETrackFields::AlbumReleaseDate)) { AlbumParts.Add(TEXT("release_date")); }
+		if (EnumHasAnyFlags(Fields, ETrackFields::ImgUrl)) { AlbumParts.Add(TEXT("images(url)")); }
+		if (AlbumParts.Num() > 0)
+		{
+			Parts.Add(FString::Printf(TEXT("album(%s)"), *FString::Join(AlbumParts, TEXT(","))));
+		}
+
+		return FString::Join(Parts, TEXT(","));
+	}
+
+	static FString Playlist(const EPlaylistFields Fields)
+	{
+		TArray<FString, TInlineAllocator<6>> Parts;
+		if (EnumHasAnyFlags(Fields, EPlaylistFields::Name)) { Parts.Add(TEXT("name")); }
+		if (EnumHasAnyFlags(Fields, EPlaylistFields::Description)) { Parts.Add(TEXT("description")); }
+		// The id is always requested as it is the identity of the record.
+		Parts.Add(TEXT("id"));
+		if (EnumHasAnyFlags(Fields, EPlaylistFields::ImgUrl)) { Parts.Add(TEXT("images(url)")); }
+		if (EnumHasAnyFlags(Fields, EPlaylistFields::TrackCount)) { Parts.Add(TEXT("tracks(total)")); }
+		if (EnumHasAnyFlags(Fields, EPlaylistFields::SnapshotId)) { Parts.Add(TEXT("snapshot_id")); }
+
+		return FString::Join(Parts, TEXT(","));
+	}
+};
@@ -0,0 +1,147 @@
+﻿// Copyright (c) Harris Barra. (MIT License)
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GenericPlatform/GenericPlatformHttp.h"
+#include "RequestBatcher.h"
+#include "RequestHandle.h"
+#include "RequestUtils.h"
+#include "SpotifyResult.h"
+
+class FMultiIdRequest
+{
+public:
+	// This is a utility class for the multi-id endpoints (e.g. /v1/tracks?ids=).
+	// Arbitrary id lists are deduplicated and split into chunks of the endpoint's maximum batch size,
+	// the chunks are requested concurrently and the results are merged back in id order.
+
+	/**
+	 * Requests every id through a multi-id endpoint.
+	 * @param UserToken The access token for the Spotify user.
+	 * @param Endpoint The endpoint path below the api base url, e.g. "tracks".
+	 * @param Ids The ids to request, in the order results should be returned.
+	 * @param ChunkSize The maximum number of ids the endpoint accepts per request.
+	 * @param MaxConcurrentRequests The maximum number of chunk requests in flight.
+	 * @param DecodeChunk Decodes a response (on a task graph worker) into one entry per id of the chunk, unknown ids left unset. Returns false if the payload was malformed.
+	 * @param Callback A function that will be called with the results (in the same order as Ids) and the ids that failed or were not found.
+	 * @param OnFailure An optional function that will be called with the first error before Callback if any chunk failed, the ids of failed chunks are still reported in FailedIds.
+	 * @return A handle to cancel the remaining chunks, neither callback is then called.
+	 */
+	template <typename ResultType>
+	static FSpotifyRequestHandle Run(const FString& UserToken, const FString& Endpoint, const TArray<FString>& Ids, const int32 ChunkSize, const int32 MaxConcurrentRequests, TFunction<bool(const FString& ResponseStr, TArray<TOptional<ResultType>>& OutResults)> DecodeChunk, TFunction<void(const TArray<ResultType>& Results, const TArray<FString>& FailedIds)> Callback, TFunction<void(const FSpotifyError& Error)> OnFailure = nullptr)
+	{
+		FCancellationTokenRef Token = MakeShared<FCancellationToken, ESPMode::ThreadSafe>();
+
+		TSharedRef<TArray<FString>, ESPMode::ThreadSafe> UniqueIds = MakeShared<TArray<FString>, ESPMode::ThreadSafe>();
+		{
+			TSet<FString> SeenIds;
+			SeenIds.Reserve(Ids.Num());
+			for (const FString& Id : Ids)
+			{
+				bool bAlreadySeen = false;
+				SeenIds.Add(Id, &bAlreadySeen);
+				if (!bAlreadySeen)
+				{
+					UniqueIds->Add(Id);
+				}
+			}
+		}
+
+		// One slot per unique id, each chunk only writes its own range.
+		TSharedRef<TArray<TOptional<ResultType>>, ESPMode::ThreadSafe> Results = MakeShared<TArray<TOptional<ResultType>>, ESPMode::ThreadSafe>();
+		Results->SetNum(UniqueIds->Num());
+
+		TSharedRef<FSpotifyFirstError, ESPMode::ThreadSafe> ChunkError = MakeShared<FSpotifyFirstError, ESPMode::ThreadSafe>();
+
+		const int32 NumChunks = FMath::DivideAndRoundUp(UniqueIds->Num(), ChunkSize);
+		FRequestBatcher::Run(NumChunks, MaxConcurrentRequests, [=](int32 ChunkIndex, TFunction<void()> Done)
+		{
+			const int32 First = ChunkIndex * ChunkSize;
+			const int32 Num = FMath::Min(ChunkSize, UniqueIds->Num() - First);
+
+			FString IdsQuery;
+			for (int32 Index = First; Index < First + Num; ++Index)
+			{
+				IdsQuery += (Index > First ? TEXT(",") : TEXT("")) + FGenericPlatformHttp::UrlEncode((*UniqueIds)[Index]);
+			}
+
+			const FString Url = FString::Printf(TEXT("%s/%s?ids=%s"), *FRequestUtils::GetApiBaseUrl(), *Endpoint, *IdsQuery);
+			FRequestUtils::ProcessDecodedGETRequest<TArray<TOptional<ResultType>>>(Url, UserToken, [DecodeChunk, Num](const FString& ResponseStr, TArray<TOptional<ResultType>>& OutChunkResults)
+			{
+				OutChunkResults.Reserve(Num);
+				return DecodeChunk(ResponseStr, OutChunkResults);
+			},
+			[=](int ResponseCode, const FString& ResponseStr, const TArray<TOptional<ResultType>>* ChunkResults, const FString& RetryAfter)
+			{
+				if (ResponseCode == 200)
+				{
+					if (ChunkResults)
+					{
+						for (int32 Index = 0; Index < FMath::Min(Num, ChunkResults->Num()); ++Index)
+						{
+							(*Results)[First + Index] = (*ChunkResults)[Index];
+						}
+					}
+					else
+					{
+						UE_LOG(LogTemp, Error, TEXT("Spotify %s response could not be decoded!!!"), *Endpoint);
+						ChunkError->Set(FSpotifyError::Make(ESpotifyErrorType::Decode, ResponseStr));
+					}
+				}
+				else
+				{
+					FString ErrorStr = FString::Printf(TEXT("Spotify %s request failed!!!"), *Endpoint);
+					UE_LOG(LogTemp, Error, TEXT("%s"), *ErrorStr);
+					UE_LOG(LogTemp, Error, TEXT("Request Error (%d): %s"), ResponseCode, *ResponseStr);
+					ChunkError->Set(FSpotifyError::FromResponse(ResponseCode, ResponseStr, RetryAfter));
+				}
+				// A failed chunk must not stall the batch, the error is reported once every chunk settled.
+				Done();
+			},
+			ERequestPriority::Interactive,
+			Token);
+		},
+		[=]()
+		{
+			TMap<FString, int32> IdToSlot;
+			IdToSlot.Reserve(UniqueIds->Num());
+			for (int32 Index = 0; Index < UniqueIds->Num(); ++Index)
+			{
+				IdToSlot.Add((*UniqueIds)[Index], Index);
+			}
+
+			TArray<ResultType> OrderedResults;
+			TArray<FString> FailedIds;
+			OrderedResults.Reserve(Ids.Num());
+
+			for (const FString& Id : Ids)
+			{
+				const TOptional<ResultType>& Result = (*Results)[IdToSlot.FindChecked(Id)];
+				if (Result.IsSet())
+				{
+					OrderedResults.Add(Result.GetValue());
+				}
+				else
+				{
+					FailedIds.Add(Id);
+				}
+			}
+
+			FAsyncDecode::Deliver([Callback, OnFailure, Token, Error = ChunkError->Get(), OrderedResults = MoveTemp(OrderedResults), FailedIds = MoveTemp(FailedIds)]()
+			{
+				if (Token->IsCancelled())
+				{
+					return;
+				}
+				if (Error.IsSet() && OnFailure)
+				{
+					OnFailure(Error.GetValue());
+				}
+				Callback(OrderedResults, FailedIds);
+			});
+		});
+
+		return FSpotifyRequestHandle(Token);
+	}
+};
@@ -0,0 +1,90 @@
+﻿// Copyright (c) Harris Barra. (MIT License)
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Misc/ScopeLock.h"
+
+class FRequestBatcher
+{
+public:
+	// This is a utility class for running many asynchronous requests with a bounded number in flight.
+	// Tasks are started in index order, completion order is arbitrary, so callers should write
+	// results into index-addressed slots to keep a stable output order.
+
+	/**
+	 * Runs NumTasks asynchronous tasks, keeping at most MaxInFlight of them running at once.
+	 * @param NumTasks The total number of tasks to run.
+	 * @param MaxInFlight The maximum number of tasks running concurrently (clamped to at least 1).
+	 * @param StartTask Called with the task index and a completion function that MUST be called exactly once when the task finishes.
+	 * @param OnComplete Called once every task has completed.
+	 */
+	static void Run(const int32 NumTasks, const int32 MaxInFlight, TFunction<void(int32 Index, TFunction<void()> Done)> StartTask, TFunction<void()> OnComplete)
+	{
+		if (NumTasks <= 0)
+		{
+			OnComplete();
+			return;
+		}
+
+		TSharedRef<FBatchState, ESPMode::ThreadSafe> State = MakeShared<FBatchState, ESPMode::ThreadSafe>();
+		State->NumTasks = NumTasks;
+		State->MaxInFlight = FMath::Max(1, MaxInFlight);
+		State->StartTask = MoveTemp(StartTask);
+		State->OnComplete = MoveTemp(OnComplete);
+
+		Pump(State);
+	}
+
+private:
+	struct FBatchState
+	{
+		FCriticalSection Mutex;
+		int32 NumTasks = 0;
+		int32 MaxInFlight = 1;
+		int32 NextIndex = 0;
+		int32 NumInFlight = 0;
+		int32 NumCompleted = 0;
+		TFunction<void(int32 Index, TFunction<void()> Done)> StartTask;
+		TFunction<void()> OnComplete;
+	};
+
+	static void Pump(const TSharedRef<FBatchState, ESPMode::ThreadSafe>& State)
+	{
+		// Claim the task slots under the lock, but start them outside of it as tasks may complete synchronously.
+		TArray<int32, TInlineAllocator<16>> TasksToStart;
+		{
+			FScopeLock Lock(&State->Mutex);
+			while (State->NumInFlight < State->MaxInFlight && State->NextIndex < State->NumTasks)
+			{
+				TasksToStart.Add(State->NextIndex++);
+				State->NumInFlight++;
+			}
+		}
+
+		for (const int32 Index : TasksToStart)
+		{
+			State->StartTask(Index, [State]() { OnTaskDone(State); });
+		}
+	}
+
+	static void OnTaskDone(const TSharedRef<FBatchState, ESPMode::ThreadSafe>& State)
+	{
+		bool bAllCompleted;
+		{
+			FScopeLock Lock(&State->Mutex);
+			State->NumInFlight--;
+			State->NumCompleted++;
+			bAllCompleted = State->NumCompleted == State->NumTasks;
+		}
+
+		if (bAllCompleted)
+		{
+			State->OnComplete();
+		}
+		else
+		{
+			Pump(State);
+		}
+	}
+};
@@ -0,0 +1,133 @@
+﻿// Copyright (c) Harris Barra. (MIT License)
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Misc/ScopeLock.h"
+#include "RequestHandle.h"
+#include "SpotifyHttpClient.h"
+
+template <typename ResultType>
+class TRequestCoalescer
+{
+public:
+	// This is a utility class for merging identical concurrent requests into one in-flight operation.
+	// The first caller starts the operation, later callers with the same key subscribe to it, and the
+	// result fans out to every subscriber. The operation itself is only cancelled once every
+	// subscriber has cancelled.
+
+	/**
+	 * Builds a coalescing key from the token identity (see FSpotifyHttpClient::GetTokenIdentity),
+	 * so raw bearer tokens are never kept as keys and two users can never share a result.
+	 */
+	static FString MakeKey(const TCHAR* Endpoint, const FString& UserToken, const FString& Params)
+	{
+		return FString::Printf(TEXT("%s|%llu|%s"), Endpoint, FSpotifyHttpClient::Get().GetTokenIdentity(UserToken), *Params);
+	}
+
+	/**
+	 * Subscribes to the in-flight operation for Key, starting it if there is none.
+	 * @param Key The coalescing key (endpoint, params and token identity).
+	 * @param Callback A function that will be called with the result, unless the returned handle is cancelled.
+	 * @param Start Starts the operation, called with the operation's cancellation token and the function to complete it with.
+	 * @return The subscriber's handle.
+	 */
+	FSpotifyRequestHandle Run(const FString& Key, TFunction<void(const ResultType& Result)> Callback, TFunction<void(const FCancellationTokenRef& Token, TFunction<void(const ResultType& Result)> Complete)> Start)
+	{
+		FCancellationTokenRef SubscriberToken = MakeShared<FCancellationToken, ESPMode::ThreadSafe>();
+		TSharedPtr<FOperation, ESPMode::ThreadSafe> NewOperation;
+		{
+			FScopeLock Lock(&Mutex);
+
+			TSharedPtr<FOperation, ESPMode::ThreadSafe> Operation = Operations.FindRef(Key);
+			if (!Operation.IsValid())
+			{
+				Operation = NewOperation = MakeShared<FOperation, ESPMode::ThreadSafe>();
+				Operations.Add(Key, Operation);
+			}
+			Operation->Subscribers.Add({ SubscriberToken, MoveTemp(Callback) });
+
+			SubscriberToken->SetOnCancelled([this, Key, WeakOperation = TWeakPtr<FOperation, ESPMode::ThreadSafe>(Operation), SubscriberToken = TWeakPtr<FCancellationToken, ESPMode::ThreadSafe>(SubscriberToken)]()
+			{
+				Unsubscribe(Key, WeakOperation.Pin(), SubscriberToken.Pin());
+			});
+		}
+
+		if (NewOperation.IsValid())
+		{
+			Start(NewOperation->Token, [this, Key, WeakOperation = TWeakPtr<FOperation, ESPMode::ThreadSafe>(NewOperation)](const ResultType& Result)
+			{
+				Complete(Key, WeakOperation.Pin(), Result);
+			});
+		}
+
+		return FSpotifyRequestHandle(SubscriberToken);
+	}
+
+private:
+	struct FSubscriber
+	{
+		FCancellationTokenRef Token;
+		TFunction<void(const ResultType& Result)> Callback;
+	};
+
+	struct FOperation
+	{
+		FCancellationTokenRef Token = MakeShared<FCancellationToken, ESPMode::ThreadSafe>();
+		TArray<FSubscriber> Subscribers;
+	};
+
+	void Complete(const FString& Key, const TSharedPtr<FOperation, ESPMode::ThreadSafe>& Operation, const ResultType& Result)
+	{
+		if (!Operation.IsValid())
+		{
+			return;
+		}
+
+		TArray<FSubscriber> Subscribers;
+		{
+			FScopeLock Lock(&Mutex);
+			if (Operations.FindRef(Key) == Operation)
+			{
+				Operations.Remove(Key);
+			}
+			Subscribers = MoveTemp(Operation->Subscribers);
+		}
+
+		for (const FSubscriber& Subscriber : Subscribers)
+		{
+			if (!Subscriber.Token->IsCancelled())
+			{
+				Subscriber.Callback(Result);
+			}
+		}
+	}
+
+	void Unsubscribe(const FString& Key, const TSharedPtr<FOperation, ESPMode::ThreadSafe>& Operation, const FCancellationTokenPtr& SubscriberToken)
+	{
+		if (!Operation.IsValid())
+		{
+			return;
+		}
+
+		bool bCancelOperation = false;
+		{
+			FScopeLock Lock(&Mutex);
+			Operation->Subscribers.RemoveAll([&SubscriberToken](const FSubscriber& Subscriber) { return Subscriber.Token == SubscriberToken; });
+
+			if (Operation->Subscribers.Num() == 0 && Operations.FindRef(Key) == Operation)
+			{
+				Operations.Remove(Key);
+				bCancelOperation = true;
+			}
+		}
+
+		if (bCancelOperation)
+		{
+			Operation->Token->Cancel();
+		}
+	}
+
+	FCriticalSection Mutex;
+	TMap<FString, TSharedPtr<FOperation, ESPMode::ThreadSafe>> Operations;
+};
@@ -0,0 +1,80 @@
+﻿// Copyright (c) Harris Barra. (MIT License)
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Misc/ScopeLock.h"
+#include <atomic>
+
+/**
+ * Shared cancellation state of a request and every request it spawns (pagination, batches).
+ */
+class FCancellationToken
+{
+public:
+	bool IsCancelled() const { return bCancelled.load(std::memory_order_acquire); }
+
+	void Cancel()
+	{
+		if (bCancelled.exchange(true, std::memory_order_acq_rel))
+		{
+			return;
+		}
+
+		TFunction<void()> Listener;
+		{
+			FScopeLock Lock(&Mutex);
+			Listener = MoveTemp(OnCancelled);
+		}
+
+		if (Listener)
+		{
+			Listener();
+		}
+	}
+
+	/**
+	 * Sets a function that will be called once when the token is cancelled.
+	 */
+	void SetOnCancelled(TFunction<void()> InOnCancelled)
+	{
+		FScopeLock Lock(&Mutex);
+		OnCancelled = MoveTemp(InOnCancelled);
+	}
+
+private:
+	std::atomic<bool> bCancelled { false };
+	FCriticalSection Mutex;
+	TFunction<void()> OnCancelled;
+};
+
+using FCancellationTokenPtr = TSharedPtr<FCancellationToken, ESPMode::ThreadSafe>;
+using FCancellationTokenRef = TSharedRef<FCancellationToken, ESPMode::ThreadSafe>;
+
+/**
+ * A handle to a request returned by the endpoint functions.
+ * Cancelling it stops any further pages or batch entries from being requested, drops queued requests
+ * and guarantees the callback is never invoked.
+ */
+class FSpotifyRequestHandle
+{
+public:
+	FSpotifyRequestHandle() = default;
+	explicit FSpotifyRequestHandle(const FCancellationTokenRef& InToken) : Token(InToken) {}
+
+	void Cancel() const
+	{
+		if (Token.IsValid())
+		{
+			Token->Cancel();
+		}
+	}
+
+	bool IsCancelled() const { return Token.IsValid() && Token->IsCancelled(); }
+	bool IsValid() const { return Token.IsValid(); }
+
+	const FCancellationTokenPtr& GetToken() const { return Token; }
+
+private:
+	FCancellationTokenPtr Token;
+};
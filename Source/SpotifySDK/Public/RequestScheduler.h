@@ -0,0 +1,437 @@
+﻿// Copyright (c) Harris Barra. (MIT License)
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/RingBuffer.h"
+#include "Containers/Ticker.h"
+#include "Interfaces/IHttpRequest.h"
+#include "Interfaces/IHttpResponse.h"
+#include "Misc/EngineVersionComparison.h"
+#include "Misc/ScopeLock.h"
+#include "RequestHandle.h"
+#include "RequestStats.h"
+#include "SpotifyResult.h"
+
+/**
+ * The lane a request is scheduled on.
+ * Interactive requests are always dispatched before Background ones, and Background requests
+ * can never take the last slots reserved for Interactive requests.
+ */
+enum class ERequestPriority : uint8
+{
+	Interactive,
+	Background
+};
+
+class FRequestScheduler
+{
+public:
+	// This is the central dispatcher for every Web API request.
+	// Requests are released through a token bucket so we stay under the API's rate limit, and a
+	// 429 Too Many Requests pauses dispatching for the Retry-After period and requeues the request
+	// at the front of its lane instead of dropping it.
+	// A 401 Unauthorized parks the request while the token is refreshed (one refresh for every parked
+	// request) and replays it with the new token, so an expired token never breaks a pagination chain.
+	// The lanes are ring buffers so dequeuing and requeuing at the front are O(1), and the scheduler
+	// only ticks while requests are waiting.
+
+	static FRequestScheduler& Get()
+	{
+		static FRequestScheduler Instance;
+		return Instance;
+	}
+
+	/**
+	 * Enqueues a request.
+	 * The HTTP request is only created once it is dispatched, so every retry gets a fresh request.
+	 * @param MakeRequest A function that creates the (unsent) HTTP request.
+	 * @param OnComplete A function that will be called with the final response, after any retries.
+	 * @param Priority The lane the request is scheduled on.
+	 * @param CancellationToken If cancelled, the request is dropped from the queue and OnComplete is never called.
+	 */
+	void Enqueue(TFunction<TSharedRef<IHttpRequest>()> MakeRequest, TFunction<void(FHttpResponsePtr Response, bool bConnectedSuccessfully)> OnComplete, const ERequestPriority Priority = ERequestPriority::Interactive, const FCancellationTokenPtr& CancellationToken = nullptr)
+	{
+		TSharedRef<FQueuedRequest, ESPMode::ThreadSafe> QueuedRequest = MakeShared<FQueuedRequest, ESPMode::ThreadSafe>();
+		QueuedRequest->MakeRequest = MoveTemp(MakeRequest);
+		QueuedRequest->OnComplete = MoveTemp(OnComplete);
+		QueuedRequest->Priority = Priority;
+		QueuedRequest->CancellationToken = CancellationToken;
+
+		{
+			FScopeLock Lock(&Mutex);
+			GetLane(Priority).Add(QueuedRequest);
+			EnsureTickerLocked();
+		}
+
+		Pump();
+	}
+
+	/**
+	 * Configures the token bucket.
+	 * @param InRequestsPerSecond The sustained dispatch rate.
+	 * @param InBurstSize The number of requests that may be dispatched at once after an idle period.
+	 */
+	void SetRateLimit(const float InRequestsPerSecond, const int32 InBurstSize)
+	{
+		FScopeLock Lock(&Mutex);
+		RequestsPerSecond = FMath::Max(0.1f, InRequestsPerSecond);
+		BurstSize = FMath::Max(1, InBurstSize);
+		Tokens = FMath::Min(Tokens, static_cast<double>(BurstSize));
+	}
+
+	void GetRateLimit(float& OutRequestsPerSecond, int32& OutBurstSize) const
+	{
+		FScopeLock Lock(&Mutex);
+		OutRequestsPerSecond = RequestsPerSecond;
+		OutBurstSize = BurstSize;
+	}
+
+	/**
+	 * Configures the in-flight limits.
+	 * @param InMaxConcurrentRequests The maximum number of requests in flight.
+	 * @param InInteractiveReservedSlots The number of those slots Background requests may never use.
+	 */
+	void SetConcurrencyLimits(const int32 InMaxConcurrentRequests, const int32 InInteractiveReservedSlots)
+	{
+		FScopeLock Lock(&Mutex);
+		MaxConcurrentRequests = FMath::Max(1, InMaxConcurrentRequests);
+		InteractiveReservedSlots = FMath::Clamp(InInteractiveReservedSlots, 0, MaxConcurrentRequests - 1);
+	}
+
+	/**
+	 * Sets the function that refreshes the access token after a 401, see FSpotifyAuth.
+	 * Without a handler unauthorized responses are delivered as they are.
+	 * @param Handler A function that refreshes the token and calls OnRefreshed with the outcome.
+	 */
+	void SetUnauthorizedHandler(TFunction<void(TFunction<void(bool bRefreshed)> OnRefreshed)> Handler)
+	{
+		FScopeLock Lock(&Mutex);
+		UnauthorizedHandler = MoveTemp(Handler);
+	}
+
+	/**
+	 * Called whenever the token changes outside of a 401 (e.g. a proactive refresh), so requests that
+	 * were already in flight with the old token are replayed instead of triggering another refresh.
+	 */
+	void NotifyTokenRefreshed()
+	{
+		TokenGeneration++;
+	}
+
+	/**
+	 * Get the number of queued requests, cancelled requests are counted until they reach the front of their lane.
+	 */
+	int32 GetNumQueued() const
+	{
+		FScopeLock Lock(&Mutex);
+		return InteractiveLane.Num() + BackgroundLane.Num();
+	}
+
+	int32 GetNumQueued(const ERequestPriority Priority) const
+	{
+		FScopeLock Lock(&Mutex);
+		return Priority == ERequestPriority::Interactive ? InteractiveLane.Num() : BackgroundLane.Num();
+	}
+
+	/**
+	 * Stops ticking and drops every queued request, called when the module shuts down.
+	 */
+	void Shutdown()
+	{
+		FScopeLock Lock(&Mutex);
+		if (TickerHandle.IsValid())
+		{
+			FTSTicker::GetCoreTicker().RemoveTicker(TickerHandle);
+			TickerHandle.Reset();
+		}
+		InteractiveLane.Empty();
+		BackgroundLane.Empty();
+		ParkedRequests.Reset();
+		UnauthorizedHandler = nullptr;
+	}
+
+private:
+	struct FQueuedRequest
+	{
+		TFunction<TSharedRef<IHttpRequest>()> MakeRequest;
+		TFunction<void(FHttpResponsePtr Response, bool bConnectedSuccessfully)> OnComplete;
+		ERequestPriority Priority = ERequestPriority::Interactive;
+		FCancellationTokenPtr CancellationToken;
+		int32 NumAttempts = 0;
+		// Token generation the request was last sent with, and whether it was already replayed after a 401.
+		uint32 TokenGeneration = 0;
+		bool bReplayedUnauthorized = false;
+		FHttpResponsePtr UnauthorizedResponse;
+
+		bool IsCancelled() const { return CancellationToken.IsValid() && CancellationToken->IsCancelled(); }
+	};
+	using FQueuedRequestRef = TSharedRef<FQueuedRequest, ESPMode::ThreadSafe>;
+
+	using FLane = TRingBuffer<FQueuedRequestRef>;
+
+	FLane& GetLane(const ERequestPriority Priority)
+	{
+		return Priority == ERequestPriority::Interactive ? InteractiveLane : BackgroundLane;
+	}
+
+	/**
+	 * Ticks the scheduler while requests are queued, they may be waiting on the bucket or a Retry-After pause.
+	 * The ticker unregisters itself once both lanes are empty, so it must be ensured whenever a request is queued.
+	 */
+	void EnsureTickerLocked()
+	{
+		if (!TickerHandle.IsValid())
+		{
+			TickerHandle = FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateLambda([this](float DeltaTime)
+			{
+				Pump();
+
+				FScopeLock Lock(&Mutex);
+				if (InteractiveLane.IsEmpty() && BackgroundLane.IsEmpty())
+				{
+					TickerHandle.Reset();
+					return false;
+				}
+				return true;
+			}));
+		}
+	}
+
+	/**
+	 * Drops the cancelled requests at the front of a lane, the others are dropped once they reach the front.
+	 */
+	static void TrimCancelledLocked(FLane& Lane)
+	{
+		while (!Lane.IsEmpty() && Lane.First()->IsCancelled())
+		{
+			Lane.PopFront();
+		}
+	}
+
+	void RefillLocked(const double Now)
+	{
+		Tokens = FMath::Min(static_cast<double>(BurstSize), Tokens + (Now - LastRefillTime) * RequestsPerSecond);
+		LastRefillTime = Now;
+	}
+
+	/**
+	 * Dispatches as many queued requests as the bucket, the in-flight limits and any Retry-After pause allow.
+	 */
+	void Pump()
+	{
+		TArray<FQueuedRequestRef, TInlineAllocator<8>> RequestsToDispatch;
+		{
+			FScopeLock Lock(&Mutex);
+
+			const double Now = FPlatformTime::Seconds();
+			RefillLocked(Now);
+
+			// Cancelled requests never use a token or a slot.
+			TrimCancelledLocked(InteractiveLane);
+			TrimCancelledLocked(BackgroundLane);
+
+			while (Now >= BlockedUntil && Tokens >= 1.0)
+			{
+				FLane* Lane = nullptr;
+				if (InteractiveLane.Num() > 0 && NumInFlight < MaxConcurrentRequests)
+				{
+					Lane = &InteractiveLane;
+				}
+				else if (BackgroundLane.Num() > 0 && NumInFlight < MaxConcurrentRequests - InteractiveReservedSlots)
+				{
+					Lane = &BackgroundLane;
+				}
+
+				if (!Lane)
+				{
+					break;
+				}
+
+				RequestsToDispatch.Add(Lane->PopFrontValue());
+				Tokens -= 1.0;
+				NumInFlight++;
+
+				TrimCancelledLocked(*Lane);
+			}
+		}
+
+		for (const FQueuedRequestRef& QueuedRequest : RequestsToDispatch)
+		{
+			Dispatch(QueuedRequest);
+		}
+	}
+
+	void Dispatch(const FQueuedRequestRef& QueuedRequest)
+	{
+		QueuedRequest->NumAttempts++;
+		QueuedRequest->TokenGeneration = TokenGeneration.load();
+
+		TSharedRef<IHttpRequest> HttpRequest = QueuedRequest->MakeRequest();
+		const double DispatchTime = FPlatformTime::Seconds();
+
+		// Time to first byte is taken from the first progress notification that reports received bytes.
+		TSharedRef<std::atomic<double>, ESPMode::ThreadSafe> FirstByteTime = MakeShared<std::atomic<double>, ESPMode::ThreadSafe>(-1.0);
+		auto OnProgress = [FirstByteTime](FHttpRequestPtr Request, uint64 BytesSent, uint64 BytesReceived)
+		{
+			double Unset = -1.0;
+			if (BytesReceived > 0)
+			{
+				FirstByteTime->compare_exchange_strong(Unset, FPlatformTime::Seconds());
+			}
+		};
+#if UE_VERSION_OLDER_THAN(5, 4, 0)
+		HttpRequest->OnRequestProgress().BindLambda([OnProgress](FHttpRequestPtr Request, int32 BytesSent, int32 BytesReceived) { OnProgress(Request, BytesSent, BytesReceived); });
+#else
+		HttpRequest->OnRequestProgress64().BindLambda(OnProgress);
+#endif
+
+		HttpRequest->OnProcessRequestComplete().BindLambda(
+			[this, QueuedRequest, DispatchTime, FirstByteTime](FHttpRequestPtr Request, FHttpResponsePtr Response, bool bConnectedSuccessfully)
+			{
+				const bool bThrottled = bConnectedSuccessfully && Response.IsValid() && Response->GetResponseCode() == 429;
+				const bool bRetry = bThrottled && QueuedRequest->NumAttempts <= MaxRetries && !QueuedRequest->IsCancelled();
+				const bool bUnauthorized = bConnectedSuccessfully && Response.IsValid() && Response->GetResponseCode() == 401;
+
+				const double Now = FPlatformTime::Seconds();
+				const double FirstByte = FirstByteTime->load();
+				FRequestStats::Get().RecordRequest(
+					FRequestStats::GetEndpointName(Request.IsValid() ? Request->GetURL() : FString()),
+					bConnectedSuccessfully && Response.IsValid() ? Response->GetResponseCode() : 0,
+					Response.IsValid() ? Response->GetContent().Num() : 0,
+					Now - DispatchTime,
+					FirstByte >= 0.0 ? FirstByte - DispatchTime : -1.0,
+					bRetry
+				);
+
+				bool bParked = false;
+				TFunction<void(TFunction<void(bool bRefreshed)> OnRefreshed)> RefreshToken;
+				{
+					FScopeLock Lock(&Mutex);
+					NumInFlight--;
+
+					if (bUnauthorized && UnauthorizedHandler && !QueuedRequest->bReplayedUnauthorized && !QueuedRequest->IsCancelled())
+					{
+						bParked = true;
+						QueuedRequest->bReplayedUnauthorized = true;
+
+						if (QueuedRequest->TokenGeneration != TokenGeneration.load())
+						{
+							// The token was already refreshed while this request was in flight.
+							GetLane(QueuedRequest->Priority).AddFront(QueuedRequest);
+							EnsureTickerLocked();
+						}
+						else
+						{
+							QueuedRequest->UnauthorizedResponse = Response;
+							ParkedRequests.Add(QueuedRequest);
+							if (!bRefreshingToken)
+							{
+								bRefreshingToken = true;
+								RefreshToken = UnauthorizedHandler;
+							}
+						}
+					}
+
+					if (bRetry)
+					{
+						// Spotify reports the pause, otherwise back off exponentially.
+						double RetryAfter = 0.0;
+						if (!FSpotifyError::ParseRetryAfter(Response->GetHeader(TEXT("Retry-After")), RetryAfter))
+						{
+							RetryAfter = FMath::Pow(2.0, static_cast<double>(QueuedRequest->NumAttempts - 1));
+						}
+
+						BlockedUntil = FMath::Max(BlockedUntil, FPlatformTime::Seconds() + RetryAfter);
+						GetLane(QueuedRequest->Priority).AddFront(QueuedRequest);
+						EnsureTickerLocked();
+
+						UE_LOG(LogTemp, Warning, TEXT("Spotify rate limit hit, retrying in %.1fs (attempt %d)"), RetryAfter, QueuedRequest->NumAttempts);
+					}
+				}
+
+				if (RefreshToken)
+				{
+					UE_LOG(LogTemp, Warning, TEXT("Spotify access token rejected, refreshing"));
+					RefreshToken([this](bool bRefreshed) { OnTokenRefreshed(bRefreshed); });
+				}
+
+				if (!bRetry && !bParked && !QueuedRequest->IsCancelled())
+				{
+					QueuedRequest->OnComplete(Response, bConnectedSuccessfully);
+				}
+
+				Pump();
+			}
+		);
+
+		HttpRequest->ProcessRequest();
+	}
+
+	/**
+	 * Replays the parked requests in their original order, or fails them with their 401 if the refresh failed.
+	 */
+	void OnTokenRefreshed(const bool bRefreshed)
+	{
+		TArray<FQueuedRequestRef> RequestsToFail;
+		{
+			FScopeLock Lock(&Mutex);
+			bRefreshingToken = false;
+
+			if (bRefreshed)
+			{
+				TokenGeneration++;
+				for (int32 Index = ParkedRequests.Num() - 1; Index >= 0; --Index)
+				{
+					const FQueuedRequestRef& QueuedRequest = ParkedRequests[Index];
+					QueuedRequest->UnauthorizedResponse.Reset();
+					GetLane(QueuedRequest->Priority).AddFront(QueuedRequest);
+				}
+				if (ParkedRequests.Num() > 0)
+				{
+					EnsureTickerLocked();
+				}
+			}
+			else
+			{
+				RequestsToFail = ParkedRequests;
+			}
+			ParkedRequests.Reset();
+		}
+
+		for (const FQueuedRequestRef& QueuedRequest : RequestsToFail)
+		{
+			if (!QueuedRequest->IsCancelled())
+			{
+				QueuedRequest->OnComplete(QueuedRequest->UnauthorizedResponse, true);
+			}
+		}
+
+		Pump();
+	}
+
+	mutable FCriticalSection Mutex;
+	FLane InteractiveLane;
+	FLane BackgroundLane;
+	FTSTicker::FDelegateHandle TickerHandle;
+
+	int32 NumInFlight = 0;
+	int32 MaxConcurrentRequests = 16;
+	int32 InteractiveReservedSlots = 4;
+
+	// Token bucket, Spotify does not publish its limit (rolling 30 second window), these are conservative defaults.
+	float RequestsPerSecond = 10.0f;
+	int32 BurstSize = 20;
+	double Tokens = 20.0;
+	double LastRefillTime = FPlatformTime::Seconds();
+
+	// Dispatching is paused until this time after a 429.
+	double BlockedUntil = 0.0;
+	static constexpr int32 MaxRetries = 5;
+
+	// Requests waiting for a token refresh after a 401.
+	TArray<FQueuedRequestRef> ParkedRequests;
+	TFunction<void(TFunction<void(bool bRefreshed)> OnRefreshed)> UnauthorizedHandler;
+	bool bRefreshingToken = false;
+	std::atomic<uint32> TokenGeneration { 0 };
+};
@@ -0,0 +1,196 @@
+﻿// Copyright (c) Harris Barra. (MIT License)
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Misc/ScopeLock.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+
+/**
+ * Runtime metrics of a single Web API endpoint (e.g. "playlists/{id}/tracks").
+ * Latencies are in seconds and measured from dispatch, so time spent queued in the scheduler is excluded.
+ */
+struct FSpotifyEndpointStats
+{
+	// Upper bounds (in seconds) of the latency histogram buckets, the last bucket is unbounded.
+	static constexpr int32 NumLatencyBuckets = 8;
+	static constexpr double LatencyBucketBounds[NumLatencyBuckets - 1] = { 0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0 };
+
+	// Requests that went over the network, each retry counts as a request.
+	int64 NumRequests = 0;
+	// Completed requests without a connection or with a non 2xx/304 response.
+	int64 NumFailures = 0;
+	// Requests answered from the response cache without a round trip, and 304 revalidations.
+	int64 NumCacheHits = 0;
+	int64 NumRevalidations = 0;
+	// 429 responses, and the subset of them that were retried.
+	int64 NumThrottled = 0;
+	int64 NumRetries = 0;
+
+	int64 BytesReceived = 0;
+
+	double TotalTimeToFirstByte = 0.0;
+	int64 NumTimeToFirstByteSamples = 0;
+	double TotalLatency = 0.0;
+	double MaxLatency = 0.0;
+	int64 LatencyHistogram[NumLatencyBuckets] = {};
+
+	// Time spent handling responses on task graph workers (string conversion and decoding).
+	double TotalDecodeTime = 0.0;
+	int64 NumDecodes = 0;
+
+	double GetAverageLatency() const { return NumRequests > 0 ? TotalLatency / NumRequests : 0.0; }
+	double GetAverageTimeToFirstByte() const { return NumTimeToFirstByteSamples > 0 ? TotalTimeToFirstByte / NumTimeToFirstByteSamples : 0.0; }
+	double GetAverageDecodeTime() const { return NumDecodes > 0 ? TotalDecodeTime / NumDecodes : 0.0; }
+
+	static int32 GetLatencyBucket(const double Latency)
+	{
+		int32 Bucket = 0;
+		while (Bucket < NumLatencyBuckets - 1 && Latency > LatencyBucketBounds[Bucket])
+		{
+			Bucket++;
+		}
+		return Bucket;
+	}
+};
+
+class FRequestStats
+{
+public:
+	// This is the central sink for request metrics.
+	// The scheduler records network requests, FRequestUtils records cache hits and decode times.
+	// Everything is keyed by the endpoint name derived from the request url, so ids never create new entries.
+
+	static FRequestStats& Get()
+	{
+		static FRequestStats Instance;
+		return Instance;
+	}
+
+	/**
+	 * Derives the endpoint name of a Web API url, ids are replaced with {id} and the query is dropped.
+	 * e.g. https://api.spotify.com/v1/playlists/ABC/tracks?limit=100 -> playlists/{id}/tracks
+	 */
+	static FString GetEndpointName(const FString& Url)
+	{
+		FString Path = Url;
+		int32 Index;
+		if (Path.FindChar(TEXT('?'), Index))
+		{
+			Path.LeftInline(Index);
+		}
+
+		TArray<FString> Segments;
+		Path.ParseIntoArray(Segments, TEXT("/"));
+
+		const int32 VersionIndex = Segments.IndexOfByKey(TEXT("v1"));
+		if (VersionIndex == INDEX_NONE)
+		{
+			return Segments.Num() > 0 ? Segments.Last() : Path;
+		}
+
+		// Resources are /v1/<collection>/<id>/<sub-resource>, except for the current user's /v1/me/...
+		FString EndpointName;
+		for (int32 SegmentIndex = VersionIndex + 1; SegmentIndex < Segments.Num(); ++SegmentIndex)
+		{
+			const bool bIsId = SegmentIndex == VersionIndex + 2 && Segments[VersionIndex + 1] != TEXT("me");
+			if (!EndpointName.IsEmpty())
+			{
+				EndpointName += TEXT("/");
+			}
+			EndpointName += bIsId ? TEXT("{id}") : Segments[SegmentIndex];
+		}
+		return EndpointName;
+	}
+
+	/**
+	 * Records a completed network request (one attempt).
+	 * @param Endpoint The endpoint name, see GetEndpointName.
+	 * @param ResponseCode The response code, 0 if there was no response.
+	 * @param BytesReceived The size of the response body.
+	 * @param Latency The time from dispatch to completion.
+	 * @param TimeToFirstByte The time from dispatch to the first received byte, negative if unknown.
+	 * @param bRetried Whether the (throttled) request was requeued.
+	 */
+	void RecordRequest(const FString& Endpoint, const int ResponseCode, const int64 BytesReceived, const double Latency, const double TimeToFirstByte, const bool bRetried)
+	{
+		FScopeLock Lock(&Mutex);
+		FSpotifyEndpointStats& Stats = Endpoints.FindOrAdd(Endpoint);
+
+		Stats.NumRequests++;
+		Stats.BytesReceived += BytesReceived;
+		Stats.TotalLatency += Latency;
+		Stats.MaxLatency = FMath::Max(Stats.MaxLatency, Latency);
+		Stats.LatencyHistogram[FSpotifyEndpointStats::GetLatencyBucket(Latency)]++;
+
+		if (TimeToFirstByte >= 0.0)
+		{
+			Stats.TotalTimeToFirstByte += TimeToFirstByte;
+			Stats.NumTimeToFirstByteSamples++;
+		}
+
+		if (ResponseCode == 429)
+		{
+			Stats.NumThrottled++;
+			Stats.NumRetries += bRetried ? 1 : 0;
+		}
+
+		if (!bRetried && ResponseCode != 304 && (ResponseCode < 200 || ResponseCode >= 300))
+		{
+			Stats.NumFailures++;
+		}
+	}
+
+	void RecordCacheHit(const FString& Endpoint)
+	{
+		FScopeLock Lock(&Mutex);
+		Endpoints.FindOrAdd(Endpoint).NumCacheHits++;
+	}
+
+	void RecordRevalidation(const FString& Endpoint)
+	{
+		FScopeLock Lock(&Mutex);
+		Endpoints.FindOrAdd(Endpoint).NumRevalidations++;
+	}
+
+	void RecordDecode(const FString& Endpoint, const double DecodeTime)
+	{
+		FScopeLock Lock(&Mutex);
+		FSpotifyEndpointStats& Stats = Endpoints.FindOrAdd(Endpoint);
+		Stats.TotalDecodeTime += DecodeTime;
+		Stats.NumDecodes++;
+	}
+
+	/**
+	 * Get a copy of the metrics of every endpoint that has been used.
+	 */
+	TMap<FString, FSpotifyEndpointStats> GetStats() const
+	{
+		FScopeLock Lock(&Mutex);
+		return Endpoints;
+	}
+
+	void Reset()
+	{
+		FScopeLock Lock(&Mutex);
+		Endpoints.Reset();
+	}
+
+	/**
+	 * Logs a one line summary per endpoint.
+	 */
+	void DumpToLog() const
+	{
+		for (const TPair<FString, FSpotifyEndpointStats>& Pair : GetStats())
+		{
+			const FSpotifyEndpointStats& Stats = Pair.Value;
+			UE_LOG(LogTemp, Log, TEXT("%s: %lld requests (%lld failed, %lld cached, %lld revalidated, %lld throttled, %lld retried), %lld bytes, ttfb %.1fms, latency %.1fms avg / %.1fms max, decode %.2fms avg"),
+				*Pair.Key, Stats.NumRequests, Stats.NumFailures, Stats.NumCacheHits, Stats.NumRevalidations, Stats.NumThrottled, Stats.NumRetries, Stats.BytesReceived,
+				Stats.GetAverageTimeToFirstByte() * 1000.0, Stats.GetAverageLatency() * 1000.0, Stats.MaxLatency * 1000.0, Stats.GetAverageDecodeTime() * 1000.0);
+		}
+	}
+
+private:
+	mutable FCriticalSection Mutex;
+	TMap<FString, FSpotifyEndpointStats> Endpoints;
+};
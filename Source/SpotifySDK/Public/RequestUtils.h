@@ -2,15 +2,51 @@
 
 #pragma once
 
+#include "AsyncDecode.h"
 #include "HttpModule.h"
 #include "Interfaces/IHttpRequest.h"
 #include "Interfaces/IHttpResponse.h"
+#include "Misc/EngineVersionComparison.h"
+#include "RequestScheduler.h"
+#include "RequestStats.h"
+#include "ResponseCache.h"
+#include "SpotifyHttpClient.h"
 
 class FRequestUtils
 {
 public:
 	// This is a utility class for creating HTTP requests and parsing JSON responses.
-	// TODO: Need to rework how frequently deserialization is called to improve perf.
+	// Responses should be parsed ONCE via ParseResponseString, and the resulting JSON object
+	// is then used as the document handle for all subsequent field lookups.
+
+	/**
+	 * Get the base url of the Web API (no trailing slash), e.g. https://api.spotify.com/v1
+	 */
+	static FString GetApiBaseUrl()
+	{
+		FScopeLock Lock(&BaseUrlMutex());
+		return ApiBaseUrl();
+	}
+
+	/**
+	 * Get the base url of the embed player pages (no trailing slash), e.g. https://open.spotify.com/embed
+	 */
+	static FString GetEmbedBaseUrl()
+	{
+		FScopeLock Lock(&BaseUrlMutex());
+		return EmbedBaseUrl();
+	}
+
+	/**
+	 * Redirects every request to different hosts, used to run against a local mock server.
+	 * Empty urls restore the Spotify defaults.
+	 */
+	static void SetBaseUrls(const FString& InApiBaseUrl, const FString& InEmbedBaseUrl)
+	{
+		FScopeLock Lock(&BaseUrlMutex());
+		ApiBaseUrl() = InApiBaseUrl.IsEmpty() ? DefaultApiBaseUrl : InApiBaseUrl;
+		EmbedBaseUrl() = InEmbedBaseUrl.IsEmpty() ? DefaultEmbedBaseUrl : InEmbedBaseUrl;
+	}
 
 	static TSharedRef<IHttpRequest> CreatePOSTRequest(const FString& Url, const FString& RequestContent)
 	{
@@ -38,12 +74,119 @@ public:
 		return HttpRequest;
 	}
 
+	/**
+	 * Sends an authorized GET request to the Spotify Web API through the response cache and the request scheduler.
+	 * Fresh cached responses are returned without a network round trip, stale ones are revalidated
+	 * with If-None-Match so a 304 skips the transfer and returns the cached body.
+	 * Throttled (429) requests are retried by the scheduler after the Retry-After period, and
+	 * unauthorized (401) requests are parked and replayed once the token has been refreshed.
+	 * The callback is invoked on a task graph worker so that decoding never runs on the game thread,
+	 * callers must hand their own results back through FAsyncDecode::Deliver.
+	 * @param Url The full request url.
+	 * @param UserToken The access token for the Spotify user.
+	 * @param Callback A function that will be called with the response code (0 if no response), the response body
+	 * and the size of the body as received (0 if it was served from the cache or revalidated).
+	 * @param Priority The scheduler lane of the request.
+	 * @param CancellationToken If cancelled, the request is dropped and the callback is never called.
+	 */
+	static void ProcessGETRequest(const FString& Url, const FString& UserToken, TFunction<void(int ResponseCode, const FString& ResponseStr, int64 ContentLength)> Callback, const ERequestPriority Priority = ERequestPriority::Interactive, const FCancellationTokenPtr& CancellationToken = nullptr)
+	{
+		ProcessCachedGETRequest(Url, UserToken, [Callback](int ResponseCode, const FString& ResponseStr, const FResponseSource& Source)
+		{
+			// The callback decodes on its own and may chain further requests, so only the conversion is known here.
+			if (Source.bConverted)
+			{
+				FRequestStats::Get().RecordDecode(Source.Endpoint, Source.ConvertTime);
+			}
+			Callback(ResponseCode, ResponseStr, Source.ContentLength);
+		}, Priority, CancellationToken);
+	}
+
+	/**
+	 * Sends an authorized GET request like ProcessGETRequest and decodes successful responses.
+	 * The decoded result is cached next to the body, so fresh hits and revalidated (304) responses
+	 * skip decoding as well as the transfer.
+	 * @param Url The full request url.
+	 * @param UserToken The access token for the Spotify user.
+	 * @param Decode Decodes a successful response body, returns false if the body is malformed.
+	 * @param Callback A function that will be called with the response code (0 if no response), the response body,
+	 * the decoded result, which is null unless the response code is 200 and the body could be decoded, and the
+	 * Retry-After header of a failed response (empty if it had none), see FSpotifyError::FromResponse.
+	 * @param Priority The scheduler lane of the request.
+	 * @param CancellationToken If cancelled, the request is dropped and the callback is never called.
+	 */
+	template <typename DecodedType>
+	static void ProcessDecodedGETRequest(const FString& Url, const FString& UserToken, TFunction<bool(const FString& ResponseStr, DecodedType& OutDecoded)> Decode, TFunction<void(int ResponseCode, const FString& ResponseStr, const DecodedType* Decoded, const FString& RetryAfter)> Callback, const ERequestPriority Priority = ERequestPriority::Interactive, const FCancellationTokenPtr& CancellationToken = nullptr)
+	{
+		ProcessCachedGETRequest(Url, UserToken, [Decode, Callback](int ResponseCode, const FString& ResponseStr, const FResponseSource& Source)
+		{
+			const DecodedType* CachedDecoded = ResponseCode == 200 ? TDecodedResponse<DecodedType>::Find(Source.Entry.Decoded.Get()) : nullptr;
+			if (ResponseCode != 200 || CachedDecoded)
+			{
+				if (Source.bConverted)
+				{
+					FRequestStats::Get().RecordDecode(Source.Endpoint, Source.ConvertTime);
+				}
+				Callback(ResponseCode, ResponseStr, CachedDecoded, Source.RetryAfter);
+				return;
+			}
+
+			// Only the conversion and the decode itself are timed, not the callback (follow-up pages, user code).
+			const double StartTime = FPlatformTime::Seconds();
+			TSharedRef<TDecodedResponse<DecodedType>, ESPMode::ThreadSafe> Decoded = MakeShared<TDecodedResponse<DecodedType>, ESPMode::ThreadSafe>();
+			const bool bDecoded = Decode(ResponseStr, Decoded->Value);
+			FRequestStats::Get().RecordDecode(Source.Endpoint, Source.ConvertTime + FPlatformTime::Seconds() - StartTime);
+
+			if (!bDecoded)
+			{
+				Callback(ResponseCode, ResponseStr, nullptr, Source.RetryAfter);
+				return;
+			}
+
+			if (Source.Entry.Body.IsValid())
+			{
+				// Projected pages decode to about the size of their body, which is what the entry is charged.
+				FResponseCache::Get().SetDecoded(Source.CacheKey, Source.Entry.Body.ToSharedRef(), Decoded, Source.Entry.Body->GetAllocatedSize());
+			}
+			Callback(ResponseCode, ResponseStr, &Decoded->Value, Source.RetryAfter);
+		}, Priority, CancellationToken);
+	}
+
+	static bool IsCancelled(const FCancellationTokenPtr& CancellationToken)
+	{
+		return CancellationToken.IsValid() && CancellationToken->IsCancelled();
+	}
+
 	//////////// JSON Parsing ////////////
 
+	/**
+	 * Creates a JSON reader over a response body.
+	 * The reader reads the body in place, TJsonReaderFactory::Create would first copy the whole body.
+	 * @param ResponseString The raw response body, it must outlive the reader.
+	 */
+	static TSharedRef<TJsonReader<>> CreateJsonReader(const FString& ResponseString)
+	{
+#if UE_VERSION_OLDER_THAN(5, 1, 0)
+		return TJsonReaderFactory<>::Create(ResponseString);
+#else
+		return TJsonReaderFactory<>::CreateFromView(FStringView(ResponseString));
+#endif
+	}
+
+	/**
+	 * Parses a response body into a JSON document.
+	 * The returned object should be kept and reused for every lookup on the same response,
+	 * as deserialization is by far the most expensive step of handling a response.
+	 * @param ResponseString The raw response body.
+	 * @param JsonObject The parsed root object of the response.
+	 * @return True if the response was valid JSON.
+	 */
 	static bool ParseResponseString(const FString& ResponseString, TSharedPtr<FJsonObject>& JsonObject)
 	{
+		TRACE_CPUPROFILER_EVENT_SCOPE(SpotifySDK_ParseResponseString);
+
 		JsonObject = MakeShareable(new FJsonObject());
-		TSharedRef<TJsonReader<>> Reader = TJsonReaderFactory<>::Create(ResponseString);
+		TSharedRef<TJsonReader<>> Reader = CreateJsonReader(ResponseString);
 
 		if (FJsonSerializer::Deserialize(Reader, JsonObject) && JsonObject.IsValid())
 		{
@@ -87,6 +230,7 @@ public:
 		return false;
 	}
 
+	// NOTE: Parses the whole response for a single lookup, prefer the JSON object overload.
 	static bool GetObjectEntry(const FString& ResponseString, const FString& ObjectName, TSharedPtr<FJsonObject>& OutValue)
 	{
 		TSharedPtr<FJsonObject> JsonObject;
@@ -106,6 +250,7 @@ public:
 		return false;
 	}
 
+	// NOTE: Parses the whole response for a single lookup, prefer the JSON object overload.
 	static bool GetArrayEntry(const FString& ResponseString, const FString& ArrayName, TArray<TSharedPtr<FJsonValue>>& OutValue)
 	{
 		TSharedPtr<FJsonObject> JsonObject;
@@ -163,7 +308,7 @@ public:
 
 		TSharedPtr<FJsonObject> JsonObject = JsonArray[Index]->AsObject();
 
-		if (!JsonObject->HasField(FieldName))
+		if (!JsonObject.IsValid() || !JsonObject->HasField(FieldName))
 		{
 			OutValue = TEXT("Error: Field not found");
 			return false;
@@ -175,7 +320,7 @@ public:
 
 	static bool GetFieldEntry(const TSharedPtr<FJsonObject>& JsonObject, const FString& FieldName, FString& OutValue)
 	{
-		if (!JsonObject->HasField(FieldName))
+		if (!JsonObject.IsValid() || !JsonObject->HasField(FieldName))
 		{
 			OutValue = TEXT("Error: Field not found");
 			return false;
@@ -187,7 +332,7 @@ public:
 
 	static bool GetFieldEntry(const TSharedPtr<FJsonObject>& JsonObject, const FString& FieldName, int& OutValue)
 	{
-		if (!JsonObject->HasField(FieldName))
+		if (!JsonObject.IsValid() || !JsonObject->HasField(FieldName))
 		{
 			OutValue = -1;
 			return false;
@@ -197,6 +342,19 @@ public:
 		return true;
 	}
 
+	static bool GetFieldEntry(const TSharedPtr<FJsonObject>& JsonObject, const FString& FieldName, bool& OutValue)
+	{
+		if (!JsonObject.IsValid() || !JsonObject->HasField(FieldName))
+		{
+			OutValue = false;
+			return false;
+		}
+
+		OutValue = JsonObject->GetBoolField(FieldName);
+		return true;
+	}
+
+	// NOTE: Parses the whole response for a single lookup, prefer the JSON object overload.
 	static bool GetFieldEntry(const FString& ResponseString, const FString& FieldName, FString& OutValue)
 	{
 		TSharedPtr<FJsonObject> JsonObject;
@@ -255,6 +413,7 @@ public:
 		}
 	}
 
+	// NOTE: Parses the whole response for a single lookup, prefer the JSON object overload.
 	static bool GetFieldEntry(const FString& ResponseString, const FString& FieldName, int& OutValue)
 	{
 		TSharedPtr<FJsonObject> JsonObject;
@@ -272,4 +431,132 @@ public:
 	}
 
 private:
+	/**
+	 * Where a response body came from, handed to the wrappers of ProcessCachedGETRequest.
+	 */
+	struct FResponseSource
+	{
+		FString CacheKey;
+		// The cache entry the body came from (or was stored as), so decoders can attach their result to it.
+		// Empty for failed requests.
+		FCachedResponse Entry;
+		FString Endpoint;
+		// Whether the body was converted from a network response, and how long that took.
+		bool bConverted = false;
+		double ConvertTime = 0.0;
+		// The Retry-After header of a failed response.
+		FString RetryAfter;
+		// The size of the network response body, 0 if it was served from the cache or revalidated.
+		int64 ContentLength = 0;
+	};
+
+	/**
+	 * Shared implementation of ProcessGETRequest and ProcessDecodedGETRequest.
+	 * Decode time is recorded by the wrappers, as only they know where decoding ends and their callback begins.
+	 */
+	static void ProcessCachedGETRequest(const FString& Url, const FString& UserToken, TFunction<void(int ResponseCode, const FString& ResponseStr, const FResponseSource& Source)> Callback, const ERequestPriority Priority, const FCancellationTokenPtr& CancellationToken)
+	{
+		if (IsCancelled(CancellationToken))
+		{
+			return;
+		}
+
+		// Pagination chains keep the token they were started with, follow it to the current one.
+		const FSpotifyResolvedToken Token = FSpotifyHttpClient::Get().ResolveToken(UserToken);
+		const FString CacheKey = FResponseCache::MakeKey(Url, Token.Identity);
+		const FString Endpoint = FRequestStats::GetEndpointName(Url);
+
+		FCachedResponse CachedResponse;
+		const bool bHasCachedResponse = FResponseCache::Get().Find(CacheKey, CachedResponse);
+		if (bHasCachedResponse && CachedResponse.IsFresh())
+		{
+			FRequestStats::Get().RecordCacheHit(Endpoint);
+			FAsyncDecode::Launch([Callback, CacheKey, Endpoint, CachedResponse, CancellationToken]()
+			{
+				if (!IsCancelled(CancellationToken))
+				{
+					TRACE_CPUPROFILER_EVENT_SCOPE(SpotifySDK_HandleResponse);
+					Callback(200, *CachedResponse.Body, { CacheKey, CachedResponse, Endpoint });
+				}
+			});
+			return;
+		}
+
+		const FString ETag = bHasCachedResponse ? CachedResponse.ETag : FString();
+
+		// The token is resolved when the request is (re)created, so a request replayed after a
+		// token refresh picks up the new token.
+		FRequestScheduler::Get().Enqueue(
+			[Url, Token, ETag]() { return FSpotifyHttpClient::CreateApiGETRequest(Url, *FSpotifyHttpClient::Get().GetAuthorizationHeader(Token), ETag); },
+			[Callback, CacheKey, Endpoint, CachedResponse, CancellationToken](FHttpResponsePtr Response, bool bConnectedSuccessfully)
+			{
+				// Even the UTF-8 to FString conversion of a large page is worth keeping off the game thread.
+				FAsyncDecode::Launch([Callback, CacheKey, Endpoint, CachedResponse, CancellationToken, Response, bConnectedSuccessfully]()
+				{
+					if (IsCancelled(CancellationToken))
+					{
+						return;
+					}
+
+					TRACE_CPUPROFILER_EVENT_SCOPE(SpotifySDK_HandleResponse);
+
+					if (!bConnectedSuccessfully || !Response.IsValid())
+					{
+						Callback(0, FString(), { CacheKey, FCachedResponse(), Endpoint });
+						return;
+					}
+
+					const int ResponseCode = Response->GetResponseCode();
+					if (ResponseCode == 304 && CachedResponse.Body.IsValid())
+					{
+						FResponseCache::Get().Revalidate(CacheKey, Response->GetHeader(TEXT("Cache-Control")));
+						FRequestStats::Get().RecordRevalidation(Endpoint);
+						Callback(200, *CachedResponse.Body, { CacheKey, CachedResponse, Endpoint });
+						return;
+					}
+
+					// The body is converted once and shared by the cache and the callback.
+					FResponseSource Source { CacheKey, FCachedResponse(), Endpoint, true };
+					const double StartTime = FPlatformTime::Seconds();
+					const TSharedRef<const FString, ESPMode::ThreadSafe> ResponseStr = MakeShared<const FString, ESPMode::ThreadSafe>(Response->GetContentAsString());
+					Source.ConvertTime = FPlatformTime::Seconds() - StartTime;
+					Source.ContentLength = Response->GetContent().Num();
+					if (ResponseCode == 200)
+					{
+						FResponseCache::Get().Store(CacheKey, ResponseStr, Response->GetHeader(TEXT("ETag")), Response->GetHeader(TEXT("Cache-Control")));
+						Source.Entry.Body = ResponseStr;
+					}
+					else
+					{
+						Source.RetryAfter = Response->GetHeader(TEXT("Retry-After"));
+					}
+
+					Callback(ResponseCode, *ResponseStr, Source);
+				});
+			},
+			Priority,
+			CancellationToken
+		);
+	}
+
+	static constexpr const TCHAR* DefaultApiBaseUrl = TEXT("https://api.spotify.com/v1");
+	static constexpr const TCHAR* DefaultEmbedBaseUrl = TEXT("https://open.spotify.com/embed");
+
+	static FCriticalSection& BaseUrlMutex()
+	{
+		static FCriticalSection Mutex;
+		return Mutex;
+	}
+
+	static FString& ApiBaseUrl()
+	{
+		static FString Url = DefaultApiBaseUrl;
+		return Url;
+	}
+
+	static FString& EmbedBaseUrl()
+	{
+		static FString Url = DefaultEmbedBaseUrl;
+		return Url;
+	}
 };
@@ -0,0 +1,309 @@
+﻿// Copyright (c) Harris Barra. (MIT License)
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/List.h"
+#include "Misc/ScopeLock.h"
+
+struct FResponseCacheStats
+{
+	// Lookups served from a fresh entry without touching the network.
+	int64 Hits = 0;
+	// Lookups that went to the network, including those that found a stale entry.
+	int64 Misses = 0;
+	// Stale entries that the server confirmed unchanged (304 Not Modified), also counted as misses.
+	int64 Revalidations = 0;
+	int64 Evictions = 0;
+	int64 NumEntries = 0;
+	int64 BytesUsed = 0;
+	int64 ByteBudget = 0;
+};
+
+/**
+ * A decoded response body, kept next to the body so that hits and revalidations skip decoding too.
+ */
+struct FDecodedResponse
+{
+	virtual ~FDecodedResponse() = default;
+
+	// Identifies the decoded type, a decoded body is only ever handed back to a decoder of the same type.
+	virtual const void* GetTypeId() const = 0;
+};
+
+template <typename ValueType>
+struct TDecodedResponse : public FDecodedResponse
+{
+	ValueType Value;
+
+	virtual const void* GetTypeId() const override { return StaticTypeId(); }
+
+	static const void* StaticTypeId()
+	{
+		static const uint8 TypeId = 0;
+		return &TypeId;
+	}
+
+	/**
+	 * @return The decoded value, or null if Decoded is not a TDecodedResponse<ValueType>.
+	 */
+	static const ValueType* Find(const FDecodedResponse* Decoded)
+	{
+		return Decoded && Decoded->GetTypeId() == StaticTypeId() ? &static_cast<const TDecodedResponse*>(Decoded)->Value : nullptr;
+	}
+};
+
+struct FCachedResponse
+{
+	TSharedPtr<const FString, ESPMode::ThreadSafe> Body;
+	// The decoded body, if a decoder has attached it, see FResponseCache::SetDecoded.
+	TSharedPtr<const FDecodedResponse, ESPMode::ThreadSafe> Decoded;
+	FString ETag;
+	// Platform seconds after which the entry must be revalidated before use.
+	double ExpiresAt = 0.0;
+
+	bool IsFresh() const { return FPlatformTime::Seconds() < ExpiresAt; }
+};
+
+class FResponseCache
+{
+public:
+	// This is an in-memory LRU cache of Web API response bodies, bounded by a byte budget.
+	// Entries are keyed by URL and token identity, fresh entries (Cache-Control max-age) are served
+	// without touching the network and stale entries are revalidated with If-None-Match. Decoders may
+	// attach their decoded result to an entry, so neither a hit nor a 304 parses the body again.
+
+	static FResponseCache& Get()
+	{
+		static FResponseCache Instance;
+		return Instance;
+	}
+
+	/**
+	 * Builds the cache key of a request.
+	 * @param Url The full request url.
+	 * @param TokenIdentity The identity of the requesting token, see FSpotifyHttpClient::GetTokenIdentity.
+	 * Raw bearer tokens are never kept as keys, and refreshing the token keeps the entries reachable.
+	 */
+	static FString MakeKey(const FString& Url, const uint64 TokenIdentity)
+	{
+		return FString::Printf(TEXT("%llu|%s"), TokenIdentity, *Url);
+	}
+
+	/**
+	 * Looks up a cached response and marks it as most recently used.
+	 * @return True if an entry exists (it may be stale, check IsFresh()).
+	 */
+	bool Find(const FString& Key, FCachedResponse& OutResponse)
+	{
+		FScopeLock Lock(&Mutex);
+
+		FEntry* Entry = Entries.Find(Key);
+		if (!Entry)
+		{
+			Stats.Misses++;
+			return false;
+		}
+
+		// A stale entry still costs a request, whether it is revalidated or replaced.
+		if (Entry->Response.IsFresh())
+		{
+			Stats.Hits++;
+		}
+		else
+		{
+			Stats.Misses++;
+		}
+
+		LruList.RemoveNode(Entry->LruNode, false);
+		LruList.AddHead(Entry->LruNode);
+
+		OutResponse = Entry->Response;
+		return true;
+	}
+
+	/**
+	 * Stores a response, evicting least recently used entries until the byte budget is met.
+	 * @param Key The request key, see MakeKey.
+	 * @param Body The response body.
+	 * @param ETag The ETag response header (may be empty).
+	 * @param CacheControl The Cache-Control response header (may be empty).
+	 */
+	void Store(const FString& Key, const FString& Body, const FString& ETag, const FString& CacheControl)
+	{
+		Store(Key, MakeShared<const FString, ESPMode::ThreadSafe>(Body), ETag, CacheControl);
+	}
+
+	/**
+	 * Stores a response without copying the body, the entry shares it with the caller.
+	 */
+	void Store(const FString& Key, const TSharedRef<const FString, ESPMode::ThreadSafe>& Body, const FString& ETag, const FString& CacheControl)
+	{
+		double MaxAge = 0.0;
+		if (!ParseCacheControl(CacheControl, MaxAge) || (ETag.IsEmpty() && MaxAge <= 0.0))
+		{
+			// Nothing we could ever serve or revalidate.
+			return;
+		}
+
+		const int64 Bytes = Body->GetAllocatedSize() + Key.GetAllocatedSize();
+
+		FScopeLock Lock(&Mutex);
+
+		if (Bytes > ByteBudget)
+		{
+			return;
+		}
+
+		RemoveLocked(Key);
+
+		FEntry& Entry = Entries.Add(Key);
+		Entry.Response.Body = Body;
+		Entry.Response.ETag = ETag;
+		Entry.Response.ExpiresAt = FPlatformTime::Seconds() + MaxAge;
+		Entry.Bytes = Bytes;
+		Entry.LruNode = new TDoubleLinkedList<FString>::TDoubleLinkedListNode(Key);
+		LruList.AddHead(Entry.LruNode);
+		Stats.BytesUsed += Bytes;
+
+		EvictLocked();
+	}
+
+	/**
+	 * Marks a stale entry as confirmed by the server (304 Not Modified).
+	 * @param Key The request key, see MakeKey.
+	 * @param CacheControl The Cache-Control header of the 304 response.
+	 */
+	void Revalidate(const FString& Key, const FString& CacheControl)
+	{
+		double MaxAge = 0.0;
+		ParseCacheControl(CacheControl, MaxAge);
+
+		FScopeLock Lock(&Mutex);
+
+		if (FEntry* Entry = Entries.Find(Key))
+		{
+			Entry->Response.ExpiresAt = FPlatformTime::Seconds() + MaxAge;
+			Stats.Revalidations++;
+		}
+	}
+
+	/**
+	 * Attaches the decoded result to the entry of a body.
+	 * Nothing is attached if the entry has since been replaced or evicted, or was never stored.
+	 * @param Key The request key, see MakeKey.
+	 * @param Body The body the result was decoded from.
+	 * @param Decoded The decoded result.
+	 * @param DecodedBytes The memory the decoded result is charged against the byte budget.
+	 */
+	void SetDecoded(const FString& Key, const TSharedRef<const FString, ESPMode::ThreadSafe>& Body, const TSharedRef<const FDecodedResponse, ESPMode::ThreadSafe>& Decoded, const int64 DecodedBytes)
+	{
+		FScopeLock Lock(&Mutex);
+
+		FEntry* Entry = Entries.Find(Key);
+		if (!Entry || Entry->Response.Body.Get() != &Body.Get() || Entry->Response.Decoded.IsValid())
+		{
+			return;
+		}
+
+		Entry->Response.Decoded = Decoded;
+		Entry->Bytes += DecodedBytes;
+		Stats.BytesUsed += DecodedBytes;
+
+		EvictLocked();
+	}
+
+	void SetByteBudget(const int64 InByteBudget)
+	{
+		FScopeLock Lock(&Mutex);
+		ByteBudget = FMath::Max<int64>(0, InByteBudget);
+		EvictLocked();
+	}
+
+	void Clear()
+	{
+		FScopeLock Lock(&Mutex);
+		while (LruList.GetTail())
+		{
+			const FString Key = LruList.GetTail()->GetValue();
+			RemoveLocked(Key);
+		}
+	}
+
+	FResponseCacheStats GetStats() const
+	{
+		FScopeLock Lock(&Mutex);
+		FResponseCacheStats Result = Stats;
+		Result.NumEntries = Entries.Num();
+		Result.ByteBudget = ByteBudget;
+		return Result;
+	}
+
+	~FResponseCache()
+	{
+		Clear();
+	}
+
+private:
+	struct FEntry
+	{
+		FCachedResponse Response;
+		int64 Bytes = 0;
+		TDoubleLinkedList<FString>::TDoubleLinkedListNode* LruNode = nullptr;
+	};
+
+	/**
+	 * Parses the max-age of a Cache-Control header.
+	 * @return False if the response must not be stored at all (no-store).
+	 */
+	static bool ParseCacheControl(const FString& CacheControl, double& OutMaxAge)
+	{
+		OutMaxAge = 0.0;
+
+		TArray<FString> Directives;
+		CacheControl.ParseIntoArray(Directives, TEXT(","));
+
+		for (FString& Directive : Directives)
+		{
+			Directive.TrimStartAndEndInline();
+			if (Directive.Equals(TEXT("no-store"), ESearchCase::IgnoreCase))
+			{
+				return false;
+			}
+			if (Directive.StartsWith(TEXT("max-age="), ESearchCase::IgnoreCase))
+			{
+				OutMaxAge = FMath::Max(0.0, FCString::Atod(*Directive + 8));
+			}
+		}
+
+		return true;
+	}
+
+	void RemoveLocked(const FString& Key)
+	{
+		FEntry Entry;
+		if (Entries.RemoveAndCopyValue(Key, Entry))
+		{
+			Stats.BytesUsed -= Entry.Bytes;
+			LruList.RemoveNode(Entry.LruNode, true);
+		}
+	}
+
+	void EvictLocked()
+	{
+		while (Stats.BytesUsed > ByteBudget && LruList.GetTail())
+		{
+			const FString Key = LruList.GetTail()->GetValue();
+			RemoveLocked(Key);
+			Stats.Evictions++;
+		}
+	}
+
+	mutable FCriticalSection Mutex;
+	TMap<FString, FEntry> Entries;
+	TDoubleLinkedList<FString> LruList;
+	FResponseCacheStats Stats;
+
+	// Default budget of 32MB, enough for a few thousand projected pages.
+	int64 ByteBudget = 32 * 1024 * 1024;
+};
@@ -0,0 +1,197 @@
+﻿// Copyright (c) Harris Barra. (MIT License)
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HttpModule.h"
+#include "Interfaces/IHttpRequest.h"
+#include "Misc/ScopeLock.h"
+#include <atomic>
+
+/**
+ * A token resolved to the current token it stands for, with everything a request needs from it.
+ */
+struct FSpotifyResolvedToken
+{
+	FString AccessToken;
+	// The prebuilt "Bearer <token>" header value, shared by every request sent with the token.
+	TSharedRef<const FString, ESPMode::ThreadSafe> AuthorizationHeader = MakeShared<const FString, ESPMode::ThreadSafe>();
+	// See FSpotifyHttpClient::GetTokenIdentity.
+	uint64 Identity = 0;
+};
+
+class FSpotifyHttpClient
+{
+public:
+	// This is the shared client every Web API request is created through.
+	// It builds the common header set and tracks token rotations and identities. The Authorization
+	// header is built once per token when the token is published (see FSpotifyAuth) and shared by
+	// every request sent with it, requests resolve it together with the token identity under a single lock.
+	// Connection reuse and content encoding are left to the HTTP backend's defaults, so neither Connection nor
+	// Accept-Encoding is set here.
+
+	static FSpotifyHttpClient& Get()
+	{
+		static FSpotifyHttpClient Instance;
+		return Instance;
+	}
+
+	/**
+	 * Creates an authorized GET request to the Web API.
+	 * @param Url The full request url.
+	 * @param AuthorizationHeader The prebuilt header value of the resolved token, see GetAuthorizationHeader.
+	 * @param ETag If set, the request is sent as a conditional request (If-None-Match).
+	 * @return The unsent request.
+	 */
+	static TSharedRef<IHttpRequest> CreateApiGETRequest(const FString& Url, const FString& AuthorizationHeader, const FString& ETag = FString())
+	{
+		TSharedRef<IHttpRequest> HttpRequest = FHttpModule::Get().CreateRequest();
+
+		HttpRequest->SetURL(Url);
+		HttpRequest->SetVerb(TEXT("GET"));
+		HttpRequest->SetHeader(TEXT("Authorization"), AuthorizationHeader);
+		HttpRequest->SetHeader(TEXT("Accept"), TEXT("application/json"));
+		if (!ETag.IsEmpty())
+		{
+			HttpRequest->SetHeader(TEXT("If-None-Match"), ETag);
+		}
+
+		return HttpRequest;
+	}
+
+	/**
+	 * Records that a token was replaced, along with the new token's prebuilt Authorization header.
+	 * If it was refreshed, requests still holding the old token (e.g. the remaining pages of a
+	 * pagination chain, or requests parked on a 401) are then sent with the new one.
+	 * @param bRefreshed True if the new token was refreshed from the old one, it then keeps the old token's identity.
+	 * Otherwise the tokens are unrelated and the old one keeps standing for itself.
+	 */
+	void RotateToken(const FString& OldToken, const FString& NewToken, const TSharedRef<const FString, ESPMode::ThreadSafe>& AuthorizationHeader, const bool bRefreshed = false)
+	{
+		if (NewToken.IsEmpty())
+		{
+			return;
+		}
+
+		FScopeLock Lock(&Mutex);
+		FindOrAddTokenLocked(NewToken).AuthorizationHeader = AuthorizationHeader;
+
+		// A token set from outside may belong to another user, requests of the old user must not pick it up.
+		if (!bRefreshed || OldToken.IsEmpty() || OldToken == NewToken)
+		{
+			return;
+		}
+
+		// Tokens live for an hour, anything this far back is long gone.
+		if (Successors.Num() >= MaxRotations)
+		{
+			Successors.Reset();
+		}
+		Successors.Add(OldToken, NewToken);
+		bHasSuccessors.store(true, std::memory_order_release);
+
+		if (const FTokenEntry* OldEntry = Tokens.Find(OldToken))
+		{
+			const uint64 OldIdentity = OldEntry->Identity;
+			Tokens.FindChecked(NewToken).Identity = OldIdentity;
+		}
+	}
+
+	/**
+	 * Get the identity of the session a token belongs to, used to key per-user state such as the response cache.
+	 * Identities are handed out once and never reused, so unlike a hash of the token two users can never
+	 * share one, and a refreshed token keeps the identity of the token it replaced (see RotateToken).
+	 */
+	uint64 GetTokenIdentity(const FString& UserToken)
+	{
+		FScopeLock Lock(&Mutex);
+		return FindOrAddTokenLocked(ResolveTokenLocked(UserToken)).Identity;
+	}
+
+	/**
+	 * Get the current token a (possibly refreshed) token stands for, with its identity and Authorization header.
+	 */
+	FSpotifyResolvedToken ResolveToken(const FString& UserToken)
+	{
+		FScopeLock Lock(&Mutex);
+		FSpotifyResolvedToken Resolved;
+		Resolved.AccessToken = ResolveTokenLocked(UserToken);
+		const FTokenEntry& Entry = FindOrAddTokenLocked(Resolved.AccessToken);
+		Resolved.AuthorizationHeader = Entry.AuthorizationHeader;
+		Resolved.Identity = Entry.Identity;
+		return Resolved;
+	}
+
+	/**
+	 * Get the Authorization header to (re)create a request with, the token may have been refreshed since it was resolved.
+	 */
+	TSharedRef<const FString, ESPMode::ThreadSafe> GetAuthorizationHeader(const FSpotifyResolvedToken& Token)
+	{
+		// Until the first refresh every token stands for itself, so requests skip the lock.
+		if (!bHasSuccessors.load(std::memory_order_acquire))
+		{
+			return Token.AuthorizationHeader;
+		}
+
+		FScopeLock Lock(&Mutex);
+		const FString& CurrentToken = ResolveTokenLocked(Token.AccessToken);
+		if (CurrentToken == Token.AccessToken)
+		{
+			return Token.AuthorizationHeader;
+		}
+		return FindOrAddTokenLocked(CurrentToken).AuthorizationHeader;
+	}
+
+private:
+	struct FTokenEntry
+	{
+		uint64 Identity = 0;
+		TSharedRef<const FString, ESPMode::ThreadSafe> AuthorizationHeader = MakeShared<const FString, ESPMode::ThreadSafe>();
+	};
+
+	/**
+	 * Tokens that were never published (e.g. passed straight to an endpoint) get their header built here, once.
+	 */
+	FTokenEntry& FindOrAddTokenLocked(const FString& Token)
+	{
+		if (FTokenEntry* Entry = Tokens.Find(Token))
+		{
+			return *Entry;
+		}
+
+		// Forgetting identities only orphans the cache entries of long gone tokens, new ones never reuse them.
+		if (Tokens.Num() >= MaxIdentities)
+		{
+			Tokens.Reset();
+		}
+
+		FTokenEntry& Entry = Tokens.Add(Token);
+		Entry.Identity = ++LastIdentity;
+		Entry.AuthorizationHeader = MakeShared<const FString, ESPMode::ThreadSafe>(TEXT("Bearer ") + Token);
+		return Entry;
+	}
+
+	const FString& ResolveTokenLocked(const FString& UserToken) const
+	{
+		const FString* Token = &UserToken;
+		for (int32 Depth = 0; Depth < MaxRotations; ++Depth)
+		{
+			const FString* Successor = Successors.Find(*Token);
+			if (!Successor)
+			{
+				break;
+			}
+			Token = Successor;
+		}
+		return *Token;
+	}
+
+	static constexpr int32 MaxRotations = 16;
+	static constexpr int32 MaxIdentities = 64;
+
+	mutable FCriticalSection Mutex;
+	TMap<FString, FString> Successors;
+	std::atomic<bool> bHasSuccessors { false };
+	TMap<FString, FTokenEntry> Tokens;
+	uint64 LastIdentity = 0;
+};
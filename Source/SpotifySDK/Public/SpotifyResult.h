@@ -0,0 +1,561 @@
+﻿// Copyright (c) Harris Barra. (MIT License)
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/Ticker.h"
+#include "Misc/ScopeLock.h"
+#include "RequestHandle.h"
+
+enum class ESpotifyErrorType : uint8
+{
+	// No response was received (connection failure, DNS, TLS, ...).
+	Connection,
+	// The server answered with a non-success status, see FSpotifyError::HttpStatus.
+	Http,
+	// The response could not be decoded.
+	Decode,
+	Cancelled,
+	TimedOut
+};
+
+/**
+ * Why a request failed, and whether retrying it may succeed.
+ */
+struct FSpotifyError
+{
+	ESpotifyErrorType Type = ESpotifyErrorType::Connection;
+	// The HTTP status code, 0 if no response was received.
+	int32 HttpStatus = 0;
+	// Suggested delay before a retry in seconds, negative if retrying is pointless.
+	float RetryAfterSeconds = -1.0f;
+	FString Message;
+
+	bool IsRetryable() const { return RetryAfterSeconds >= 0.0f; }
+
+	/**
+	 * Classifies a failed response as passed to FRequestUtils::ProcessDecodedGETRequest callbacks.
+	 * @param ResponseCode The response code, 0 if no response was received.
+	 * @param ResponseStr The response body, kept as the message.
+	 * @param RetryAfterHeader The Retry-After header of the response, empty if it had none.
+	 */
+	static FSpotifyError FromResponse(const int ResponseCode, const FString& ResponseStr, const FString& RetryAfterHeader = FString())
+	{
+		FSpotifyError Error;
+		Error.Type = ResponseCode == 0 ? ESpotifyErrorType::Connection : ESpotifyErrorType::Http;
+		Error.HttpStatus = ResponseCode;
+		Error.Message = ResponseStr;
+
+		// Throttling and auth are already retried by the scheduler, so only transient failures are worth another attempt.
+		if (ResponseCode == 0 || ResponseCode == 429 || ResponseCode >= 500)
+		{
+			// The server's delay wins, a second is only a guess for responses without one.
+			double RetryAfter = 0.0;
+			Error.RetryAfterSeconds = ParseRetryAfter(RetryAfterHeader, RetryAfter) ? static_cast<float>(RetryAfter) : 1.0f;
+		}
+		return Error;
+	}
+
+	/**
+	 * Parses a Retry-After header, given either in seconds or as an HTTP date.
+	 * @param RetryAfterHeader The header value.
+	 * @param OutSeconds The delay from now in seconds, never negative.
+	 * @return False if the header is empty or malformed.
+	 */
+	static bool ParseRetryAfter(const FString& RetryAfterHeader, double& OutSeconds)
+	{
+		const FString Value = RetryAfterHeader.TrimStartAndEnd();
+		if (Value.IsEmpty())
+		{
+			return false;
+		}
+
+		if (Value.IsNumeric())
+		{
+			OutSeconds = FMath::Max(0.0, FCString::Atod(*Value));
+			return true;
+		}
+
+		FDateTime RetryDate;
+		if (FDateTime::ParseHttpDate(Value, RetryDate))
+		{
+			OutSeconds = FMath::Max(0.0, (RetryDate - FDateTime::UtcNow()).GetTotalSeconds());
+			return true;
+		}
+		return false;
+	}
+
+	static FSpotifyError Make(const ESpotifyErrorType Type, const FString& Message)
+	{
+		FSpotifyError Error;
+		Error.Type = Type;
+		Error.Message = Message;
+		Error.RetryAfterSeconds = Type == ESpotifyErrorType::TimedOut ? 0.0f : -1.0f;
+		return Error;
+	}
+};
+
+/**
+ * Either the value of a request or the error it failed with.
+ */
+template <typename ValueType>
+class TSpotifyResult
+{
+public:
+	TSpotifyResult(const ValueType& InValue) : Value(InValue) {}
+	TSpotifyResult(ValueType&& InValue) : Value(MoveTemp(InValue)) {}
+	TSpotifyResult(const FSpotifyError& InError) : Error(InError) {}
+
+	bool IsOk() const { return Value.IsSet(); }
+
+	const ValueType& GetValue() const { return Value.GetValue(); }
+	ValueType& GetValue() { return Value.GetValue(); }
+
+	// Only meaningful if the result is not ok.
+	const FSpotifyError& GetError() const { return Error; }
+
+	/**
+	 * Adapts a success callback and an optional failure callback to a single result callback.
+	 */
+	static TFunction<void(const TSpotifyResult& Result)> Dispatch(TFunction<void(const ValueType& Value)> Callback, TFunction<void(const FSpotifyError& Error)> OnFailure)
+	{
+		return [Callback, OnFailure](const TSpotifyResult& Result)
+		{
+			if (Result.IsOk())
+			{
+				Callback(Result.GetValue());
+			}
+			else if (OnFailure)
+			{
+				OnFailure(Result.GetError());
+			}
+		};
+	}
+
+private:
+	TOptional<ValueType> Value;
+	FSpotifyError Error;
+};
+
+/**
+ * Keeps the first error reported by any of several concurrent requests, e.g. the pages of a paginated request.
+ */
+class FSpotifyFirstError
+{
+public:
+	void Set(const FSpotifyError& InError)
+	{
+		FScopeLock Lock(&Mutex);
+		if (!Error.IsSet())
+		{
+			Error = InError;
+		}
+	}
+
+	TOptional<FSpotifyError> Get() const
+	{
+		FScopeLock Lock(&Mutex);
+		return Error;
+	}
+
+private:
+	mutable FCriticalSection Mutex;
+	TOptional<FSpotifyError> Error;
+};
+
+template <typename ValueType>
+class TSpotifyPromise;
+
+template <typename ValueType>
+class TSpotifyFuture
+{
+public:
+	// This is the handle to a result that will arrive later.
+	// Continuations run on the thread that completes the future, for endpoints that is the callback
+	// thread (see ECallbackThread), or immediately if the future is already complete. Every future
+	// completes exactly once, cancelling or timing out completes it with the matching error, so
+	// composed pipelines never hang on a dropped request.
+
+	bool IsReady() const
+	{
+		FScopeLock Lock(&State->Mutex);
+		return State->Result.IsSet();
+	}
+
+	/**
+	 * Registers a function that will be called with the result.
+	 */
+	void OnComplete(TFunction<void(const TSpotifyResult<ValueType>& Result)> Continuation) const
+	{
+		{
+			FScopeLock Lock(&State->Mutex);
+			if (!State->Result.IsSet())
+			{
+				State->Continuations.Add(MoveTemp(Continuation));
+				return;
+			}
+		}
+		Continuation(State->Result.GetValue());
+	}
+
+	/**
+	 * Chains a dependent request, errors skip it and propagate to the returned future.
+	 * @param Func Called with the value, returns the future of the next step.
+	 */
+	template <typename FuncType>
+	auto Then(FuncType Func) const -> decltype(Func(DeclVal<const ValueType&>()))
+	{
+		using NextFutureType = decltype(Func(DeclVal<const ValueType&>()));
+		using NextValueType = typename NextFutureType::FValueType;
+
+		TSpotifyPromise<NextValueType> Promise;
+		TSharedRef<TChainStep<NextValueType>, ESPMode::ThreadSafe> NextStep = MakeShared<TChainStep<NextValueType>, ESPMode::ThreadSafe>();
+
+		// Cancelling the chain cancels whichever step is running.
+		Promise.SetCancelHandler([Previous = *this, NextStep]()
+		{
+			Previous.Cancel();
+			NextStep->Cancel();
+		});
+
+		OnComplete([Promise, Func, NextStep](const TSpotifyResult<ValueType>& Result)
+		{
+			if (!Result.IsOk())
+			{
+				Promise.SetError(Result.GetError());
+				return;
+			}
+
+			if (!NextStep->IsCancelled())
+			{
+				NextStep->Start(Func(Result.GetValue()), Promise);
+			}
+		});
+
+		return Promise.GetFuture();
+	}
+
+	/**
+	 * Transforms the value synchronously, errors propagate to the returned future.
+	 */
+	template <typename FuncType>
+	auto Map(FuncType Func) const -> TSpotifyFuture<decltype(Func(DeclVal<const ValueType&>()))>
+	{
+		using NextValueType = decltype(Func(DeclVal<const ValueType&>()));
+
+		TSpotifyPromise<NextValueType> Promise;
+		Promise.SetCancelHandler([Previous = *this]() { Previous.Cancel(); });
+
+		OnComplete([Promise, Func](const TSpotifyResult<ValueType>& Result)
+		{
+			if (Result.IsOk())
+			{
+				Promise.SetValue(Func(Result.GetValue()));
+			}
+			else
+			{
+				Promise.SetError(Result.GetError());
+			}
+		});
+
+		return Promise.GetFuture();
+	}
+
+	/**
+	 * Recovers from an error, e.g. to retry or fall back to cached data.
+	 * @param Func Called with the error, returns the future to continue with.
+	 */
+	TSpotifyFuture<ValueType> OrElse(TFunction<TSpotifyFuture<ValueType>(const FSpotifyError& Error)> Func) const
+	{
+		TSpotifyPromise<ValueType> Promise;
+		TSharedRef<TChainStep<ValueType>, ESPMode::ThreadSafe> Fallback = MakeShared<TChainStep<ValueType>, ESPMode::ThreadSafe>();
+
+		Promise.SetCancelHandler([Previous = *this, Fallback]()
+		{
+			Previous.Cancel();
+			Fallback->Cancel();
+		});
+
+		OnComplete([Promise, Func, Fallback](const TSpotifyResult<ValueType>& Result)
+		{
+			if (Result.IsOk() || Result.GetError().Type == ESpotifyErrorType::Cancelled)
+			{
+				Promise.SetResult(Result);
+				return;
+			}
+
+			if (!Fallback->IsCancelled())
+			{
+				Fallback->Start(Func(Result.GetError()), Promise);
+			}
+		});
+
+		return Promise.GetFuture();
+	}
+
+	/**
+	 * Fails the returned future with a TimedOut error (and cancels the request) if no result arrived in time.
+	 * @param Seconds The time to wait, measured on the core ticker.
+	 */
+	TSpotifyFuture<ValueType> WithTimeout(const float Seconds) const
+	{
+		TSpotifyPromise<ValueType> Promise;
+		Promise.SetCancelHandler([Previous = *this]() { Previous.Cancel(); });
+
+		FTSTicker::FDelegateHandle TickerHandle = FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateLambda([Previous = *this, Promise](float DeltaTime)
+		{
+			if (Promise.SetError(FSpotifyError::Make(ESpotifyErrorType::TimedOut, TEXT("Request timed out"))))
+			{
+				Previous.Cancel();
+			}
+			return false;
+		}), Seconds);
+
+		OnComplete([Promise, TickerHandle](const TSpotifyResult<ValueType>& Result)
+		{
+			if (Promise.SetResult(Result))
+			{
+				FTSTicker::GetCoreTicker().RemoveTicker(TickerHandle);
+			}
+		});
+
+		return Promise.GetFuture();
+	}
+
+	/**
+	 * Cancels the request, the future then completes with a Cancelled error.
+	 */
+	void Cancel() const
+	{
+		TFunction<void()> CancelHandler;
+		{
+			FScopeLock Lock(&State->Mutex);
+			if (State->Result.IsSet())
+			{
+				return;
+			}
+			CancelHandler = MoveTemp(State->CancelHandler);
+		}
+
+		if (CancelHandler)
+		{
+			CancelHandler();
+		}
+		TSpotifyPromise<ValueType>(State).SetError(FSpotifyError::Make(ESpotifyErrorType::Cancelled, TEXT("Request cancelled")));
+	}
+
+	/**
+	 * Waits for every future, the results keep the order of Futures and include the failures.
+	 */
+	static TSpotifyFuture<TArray<TSpotifyResult<ValueType>>> WhenAll(const TArray<TSpotifyFuture<ValueType>>& Futures)
+	{
+		TSpotifyPromise<TArray<TSpotifyResult<ValueType>>> Promise;
+		if (Futures.Num() == 0)
+		{
+			Promise.SetValue(TArray<TSpotifyResult<ValueType>>());
+			return Promise.GetFuture();
+		}
+
+		Promise.SetCancelHandler([Futures]()
+		{
+			for (const TSpotifyFuture<ValueType>& Future : Futures)
+			{
+				Future.Cancel();
+			}
+		});
+
+		struct FJoin
+		{
+			FCriticalSection Mutex;
+			TArray<TOptional<TSpotifyResult<ValueType>>> Results;
+			int32 NumRemaining = 0;
+		};
+		TSharedRef<FJoin, ESPMode::ThreadSafe> Join = MakeShared<FJoin, ESPMode::ThreadSafe>();
+		Join->Results.SetNum(Futures.Num());
+		Join->NumRemaining = Futures.Num();
+
+		for (int32 Index = 0; Index < Futures.Num(); ++Index)
+		{
+			Futures[Index].OnComplete([Promise, Join, Index](const TSpotifyResult<ValueType>& Result)
+			{
+				TArray<TSpotifyResult<ValueType>> Results;
+				{
+					FScopeLock Lock(&Join->Mutex);
+					Join->Results[Index] = Result;
+					if (--Join->NumRemaining > 0)
+					{
+						return;
+					}
+
+					Results.Reserve(Join->Results.Num());
+					for (TOptional<TSpotifyResult<ValueType>>& Entry : Join->Results)
+					{
+						Results.Add(MoveTemp(Entry.GetValue()));
+					}
+				}
+				Promise.SetValue(MoveTemp(Results));
+			});
+		}
+
+		return Promise.GetFuture();
+	}
+
+	using FValueType = ValueType;
+
+	// A default constructed future never completes on its own, only through Cancel.
+	TSpotifyFuture() : State(MakeShared<FState, ESPMode::ThreadSafe>()) {}
+
+private:
+	friend class TSpotifyPromise<ValueType>;
+
+	struct FState
+	{
+		FCriticalSection Mutex;
+		TOptional<TSpotifyResult<ValueType>> Result;
+		TArray<TFunction<void(const TSpotifyResult<ValueType>& Result)>> Continuations;
+		TFunction<void()> CancelHandler;
+	};
+	using FStateRef = TSharedRef<FState, ESPMode::ThreadSafe>;
+
+	/**
+	 * The step a Then or OrElse chain continues with, started on the completion thread while the
+	 * chain may be cancelled from any other.
+	 */
+	template <typename StepValueType>
+	class TChainStep
+	{
+	public:
+		bool IsCancelled() const
+		{
+			FScopeLock Lock(&Mutex);
+			return bCancelled;
+		}
+
+		/**
+		 * Continues the chain with the step's future, or cancels it if the chain was cancelled while it was created.
+		 */
+		void Start(const TSpotifyFuture<StepValueType>& InFuture, const TSpotifyPromise<StepValueType>& Promise)
+		{
+			bool bStarted = false;
+			{
+				FScopeLock Lock(&Mutex);
+				if (!bCancelled)
+				{
+					Future = InFuture;
+					bStarted = true;
+				}
+			}
+
+			if (!bStarted)
+			{
+				InFuture.Cancel();
+				return;
+			}
+			InFuture.OnComplete([Promise](const TSpotifyResult<StepValueType>& Result) { Promise.SetResult(Result); });
+		}
+
+		void Cancel()
+		{
+			TOptional<TSpotifyFuture<StepValueType>> StartedFuture;
+			{
+				FScopeLock Lock(&Mutex);
+				bCancelled = true;
+				StartedFuture = Future;
+			}
+
+			if (StartedFuture.IsSet())
+			{
+				StartedFuture->Cancel();
+			}
+		}
+
+	private:
+		mutable FCriticalSection Mutex;
+		TOptional<TSpotifyFuture<StepValueType>> Future;
+		bool bCancelled = false;
+	};
+
+	explicit TSpotifyFuture(const FStateRef& InState) : State(InState) {}
+
+	FStateRef State;
+};
+
+/**
+ * The producing side of a TSpotifyFuture, copies share the same future.
+ */
+template <typename ValueType>
+class TSpotifyPromise
+{
+public:
+	TSpotifyPromise() : State(MakeShared<FState, ESPMode::ThreadSafe>()) {}
+
+	TSpotifyFuture<ValueType> GetFuture() const { return TSpotifyFuture<ValueType>(State); }
+
+	/**
+	 * Completes the future, only the first result is kept.
+	 * @return False if the future was already complete.
+	 */
+	bool SetResult(const TSpotifyResult<ValueType>& Result) const
+	{
+		TArray<TFunction<void(const TSpotifyResult<ValueType>& Result)>> Continuations;
+		{
+			FScopeLock Lock(&State->Mutex);
+			if (State->Result.IsSet())
+			{
+				return false;
+			}
+			State->Result.Emplace(Result);
+			State->CancelHandler = nullptr;
+			Continuations = MoveTemp(State->Continuations);
+		}
+
+		for (const TFunction<void(const TSpotifyResult<ValueType>& Result)>& Continuation : Continuations)
+		{
+			Continuation(State->Result.GetValue());
+		}
+		return true;
+	}
+
+	bool SetValue(ValueType&& Value) const { return SetResult(TSpotifyResult<ValueType>(MoveTemp(Value))); }
+	bool SetValue(const ValueType& Value) const { return SetResult(TSpotifyResult<ValueType>(Value)); }
+	bool SetError(const FSpotifyError& Error) const { return SetResult(TSpotifyResult<ValueType>(Error)); }
+
+	/**
+	 * Callbacks completing the future, to hand to the callback based request functions.
+	 */
+	TFunction<void(const ValueType& Value)> GetValueCallback() const
+	{
+		return [Promise = *this](const ValueType& Value) { Promise.SetValue(Value); };
+	}
+
+	TFunction<void(const FSpotifyError& Error)> GetErrorCallback() const
+	{
+		return [Promise = *this](const FSpotifyError& Error) { Promise.SetError(Error); };
+	}
+
+	/**
+	 * Sets what cancelling the future does, e.g. cancelling the underlying request handle.
+	 */
+	void SetCancelHandler(TFunction<void()> CancelHandler) const
+	{
+		FScopeLock Lock(&State->Mutex);
+		if (!State->Result.IsSet())
+		{
+			State->CancelHandler = MoveTemp(CancelHandler);
+		}
+	}
+
+	void SetCancelHandler(const FSpotifyRequestHandle& Handle) const
+	{
+		SetCancelHandler([Handle]() { Handle.Cancel(); });
+	}
+
+private:
+	friend class TSpotifyFuture<ValueType>;
+
+	using FState = typename TSpotifyFuture<ValueType>::FState;
+
+	explicit TSpotifyPromise(const TSharedRef<FState, ESPMode::ThreadSafe>& InState) : State(InState) {}
+
+	TSharedRef<FState, ESPMode::ThreadSafe> State;
+};
@@ -4,9 +4,17 @@
 
 #include "RequestUtils.h"
 #include "Modules/ModuleManager.h"
+#include "SpotifySDK/Albums/SpotifyAlbums.h"
+#include "SpotifySDK/Artists/SpotifyArtists.h"
 #include "SpotifySDK/Auth/SpotifyAuth.h"
+#include "SpotifySDK/Playlists/SpotifyLibraryCache.h"
+#include "SpotifySDK/Playlists/SpotifyLibrarySync.h"
+#include "SpotifySDK/Playlists/SpotifyPlaylistPrefetcher.h"
 #include "SpotifySDK/Playlists/SpotifyPlaylists.h"
+#include "SpotifySDK/Search/TrackSearchIndex.h"
+#include "SpotifySDK/Tracks/PreviewUrlCache.h"
 #include "SpotifySDK/Tracks/SpotifyTracks.h"
+#include "SpotifySDK/Tracks/TrackStore.h"
 #include "SpotifySDK/UserClient/SpotifyUser.h"
 
 class FSpotifySDKModule : public IModuleInterface
@@ -28,38 +36,302 @@ public:
 
 	SPOTIFYSDK_API void UpdateSpotifyUserToken(const FString& Token) { GetSpotifyAuth().UpdateSpotifyUserToken(Token); }
 
+	/**
+	 * Set the user's credentials from the token endpoint, the access token is then renewed
+	 * before it expires and requests rejected with a 401 are replayed with the renewed token.
+	 */
+	SPOTIFYSDK_API void UpdateSpotifyUserToken(const FString& AccessToken, const FString& RefreshToken, const int32 ExpiresInSeconds)
+	{
+		GetSpotifyAuth().UpdateSpotifyUserToken(AccessToken, RefreshToken, ExpiresInSeconds);
+	}
+
 	///////////////////////////////////////
 
-	SPOTIFYSDK_API void RequestUserProfile(TFunction<void(const FUserProfile& Profile)> Callback)
+	SPOTIFYSDK_API FSpotifyRequestHandle RequestUserProfile(TFunction<void(const FUserProfile& Profile)> Callback, TFunction<void(const FSpotifyError& Error)> OnFailure = nullptr)
 	{
-		FSpotifyUser::RequestUserProfile(GetSpotifyUserToken(), Callback);
+		return FSpotifyUser::RequestUserProfile(GetSpotifyUserToken(), Callback, OnFailure);
 	}
 
-	SPOTIFYSDK_API void RequestUserPlaylists(const FString& UserId, const TPair<int, int> LimitOffset, const TFunction<void(const TArray<FPlaylistProfile>& Playlists)>& Callback)
+	/**
+	 * Requests the user's playlists, if enabled the most likely to be opened next are prefetched once they arrive (see SetPlaylistPrefetch).
+	 */
+	SPOTIFYSDK_API FSpotifyRequestHandle RequestUserPlaylists(const FString& UserId, const TPair<int, int> LimitOffset, const TFunction<void(const TArray<FPlaylistProfile>& Playlists)>& Callback, const int MaxConcurrentPages = 1, const EPlaylistFields Fields = EPlaylistFields::All, const TFunction<void(const FSpotifyError& Error)>& OnFailure = nullptr)
 	{
-		FSpotifyPlaylists::RequestUserPlaylists(GetSpotifyUserToken(), UserId, LimitOffset, Callback);
+		return FSpotifyPlaylists::RequestUserPlaylists(GetSpotifyUserToken(), UserId, LimitOffset, [this, Callback](const TArray<FPlaylistProfile>& Playlists)
+		{
+			PrefetchLikelyPlaylists(Playlists);
+			Callback(Playlists);
+		}, MaxConcurrentPages, Fields, OnFailure);
 	}
 
-	SPOTIFYSDK_API void RequestPlaylist(const FString& PlaylistId, const TFunction<void(const FPlaylistProfile& Playlist)>& Callback)
+	SPOTIFYSDK_API FSpotifyRequestHandle RequestPlaylist(const FString& PlaylistId, const TFunction<void(const FPlaylistProfile& Playlist)>& Callback, const TFunction<void(const FSpotifyError& Error)>& OnFailure = nullptr)
 	{
-		FSpotifyPlaylists::RequestPlaylist(GetSpotifyUserToken(), PlaylistId, Callback);
+		return FSpotifyPlaylists::RequestPlaylist(GetSpotifyUserToken(), PlaylistId, Callback, OnFailure);
 	}
 
-	SPOTIFYSDK_API void BatchRequestPlaylists(const TArray<FString>& PlaylistIds, const TFunction<void(const TArray<FPlaylistProfile>& Playlists)>& Callback)
+	SPOTIFYSDK_API FSpotifyRequestHandle BatchRequestPlaylists(const TArray<FString>& PlaylistIds, const TFunction<void(const TArray<FPlaylistProfile>& Playlists, const TArray<FString>& FailedPlaylistIds)>& Callback, const int MaxConcurrentRequests = 8)
+	{
+		return FSpotifyPlaylists::BatchRequestPlaylists(GetSpotifyUserToken(), PlaylistIds, Callback, MaxConcurrentRequests);
+	}
+
+	SPOTIFYSDK_API FSpotifyRequestHandle RequestPlaylistTracks(const FString& PlaylistId, const TPair<int, int> LimitOffset, const TFunction<void(const FPlaylistData& PlaylistData)>& Callback, const int MaxConcurrentPages = 1, const ETrackFields Fields = ETrackFields::All, const TFunction<void(const FSpotifyError& Error)>& OnFailure = nullptr)
+	{
+		PlaylistPrefetcher->RecordPlaylistOpened(PlaylistId);
+
+		TFunction<void(const FPlaylistTracksPage& Page)> IndexPage = MakeIndexPageHook(PlaylistId, LimitOffset, Fields);
+		return FSpotifyPlaylists::RequestPlaylistTracks(GetSpotifyUserToken(), PlaylistId, LimitOffset, Callback, MaxConcurrentPages, Fields, MakeIndexFailureHook(PlaylistId, IndexPage, OnFailure), IndexPage);
+	}
+
+	SPOTIFYSDK_API FSpotifyRequestHandle RequestPlaylistTracksStreamed(const FString& PlaylistId, const TPair<int, int> LimitOffset, const TFunction<void(const FPlaylistTracksPage& Page)>& OnPage, const TFunction<void(int TotalTracks)>& OnComplete, const int MaxConcurrentPages = 1, const ETrackFields Fields = ETrackFields::All, const TFunction<void(const FSpotifyError& Error)>& OnFailure = nullptr)
+	{
+		PlaylistPrefetcher->RecordPlaylistOpened(PlaylistId);
+
+		TFunction<void(const FPlaylistTracksPage& Page)> IndexPage = MakeIndexPageHook(PlaylistId, LimitOffset, Fields);
+		return FSpotifyPlaylists::RequestPlaylistTracksStreamed(GetSpotifyUserToken(), PlaylistId, LimitOffset, [IndexPage, OnPage](const FPlaylistTracksPage& Page)
+		{
+			if (IndexPage)
+			{
+				IndexPage(Page);
+			}
+			OnPage(Page);
+		}, OnComplete, MaxConcurrentPages, Fields, MakeIndexFailureHook(PlaylistId, IndexPage, OnFailure));
+	}
+
+	///////////////////////////////////////
+
+	// Future based variants, errors propagate through the returned future (see TSpotifyFuture).
+
+	SPOTIFYSDK_API TSpotifyFuture<FUserProfile> RequestUserProfileAsync()
 	{
-		FSpotifyPlaylists::BatchRequestPlaylists(GetSpotifyUserToken(), PlaylistIds, Callback);
+		return FSpotifyUser::RequestUserProfileAsync(GetSpotifyUserToken());
 	}
 
-	SPOTIFYSDK_API void RequestPlaylistTracks(const FString& PlaylistId, const TPair<int, int> LimitOffset, const TFunction<void(const FPlaylistData& PlaylistData)>& Callback)
+	SPOTIFYSDK_API TSpotifyFuture<TArray<FPlaylistProfile>> RequestUserPlaylistsAsync(const FString& UserId, const TPair<int, int> LimitOffset, const int MaxConcurrentPages = 1, const EPlaylistFields Fields = EPlaylistFields::All)
 	{
-		FSpotifyPlaylists::RequestPlaylistTracks(GetSpotifyUserToken(), PlaylistId, LimitOffset, Callback);
+		TSpotifyFuture<TArray<FPlaylistProfile>> Future = FSpotifyPlaylists::RequestUserPlaylistsAsync(GetSpotifyUserToken(), UserId, LimitOffset, MaxConcurrentPages, Fields);
+		Future.OnComplete([this](const TSpotifyResult<TArray<FPlaylistProfile>>& Result)
+		{
+			if (Result.IsOk())
+			{
+				PrefetchLikelyPlaylists(Result.GetValue());
+			}
+		});
+		return Future;
 	}
 
-	SPOTIFYSDK_API void RequestTrackPreviewUrl(const FString& TrackId, const TFunction<void(const FString& Url)>& Callback)
+	SPOTIFYSDK_API TSpotifyFuture<FPlaylistData> RequestPlaylistTracksAsync(const FString& PlaylistId, const TPair<int, int> LimitOffset, const int MaxConcurrentPages = 1, const ETrackFields Fields = ETrackFields::All)
+	{
+		PlaylistPrefetcher->RecordPlaylistOpened(PlaylistId);
+		return FSpotifyPlaylists::RequestPlaylistTracksAsync(GetSpotifyUserToken(), PlaylistId, LimitOffset, MaxConcurrentPages, Fields);
+	}
+
+	SPOTIFYSDK_API TSpotifyFuture<FPlaylistProfile> RequestPlaylistAsync(const FString& PlaylistId)
+	{
+		return FSpotifyPlaylists::RequestPlaylistAsync(GetSpotifyUserToken(), PlaylistId);
+	}
+
+	SPOTIFYSDK_API TSpotifyFuture<FString> RequestTrackPreviewUrlAsync(const FString& TrackId)
+	{
+		return FSpotifyTracks::RequestTrackPreviewUrlAsync(TrackId);
+	}
+
+	///////////////////////////////////////
+
+	/**
+	 * Requests the user's library, only refetching tracks of playlists whose snapshot changed since
+	 * the last session. The on-disk store is loaded on first use.
+	 */
+	SPOTIFYSDK_API FSpotifyRequestHandle RequestLibrary(const FString& UserId, const TFunction<void(const TArray<FPlaylistProfile>& Playlists, const TArray<FString>& RefetchedPlaylistIds)>& Callback, const TFunction<void(const FSpotifyError& Error)>& OnFailure = nullptr)
+	{
+		FCancellationTokenRef Token = MakeShared<FCancellationToken, ESPMode::ThreadSafe>();
+		LoadLibraryCache([this, Token, UserId, Callback, OnFailure]()
+		{
+			if (Token->IsCancelled())
+			{
+				return;
+			}
+			const FSpotifyRequestHandle Request = FSpotifyLibraryCache::RequestLibrary(LibraryCache, GetSpotifyUserToken(), UserId, [this, Callback](const TArray<FPlaylistProfile>& Playlists, const TArray<FString>& RefetchedPlaylistIds)
+			{
+				const TSet<FString> RefetchedPlaylistIdSet(RefetchedPlaylistIds);
+				TSet<FString> PlaylistIds;
+				TArray<FString> FailedPlaylistIds;
+				for (const FPlaylistProfile& Playlist : Playlists)
+				{
+					PlaylistIds.Add(Playlist.PlaylistId);
+					// A failed refetch keeps the stored snapshot.
+					if (!RefetchedPlaylistIdSet.Contains(Playlist.PlaylistId) && !LibraryCache->IsUpToDate(Playlist))
+					{
+						FailedPlaylistIds.Add(Playlist.PlaylistId);
+					}
+				}
+				TrackSearchIndex->RetainPlaylists(PlaylistIds);
+				TrackStore->RetainPlaylists(PlaylistIds);
+				StoreCachedPlaylists(RefetchedPlaylistIds);
+				IndexCachedPlaylists(FailedPlaylistIds);
+				CompactLibrary();
+
+				Callback(Playlists, RefetchedPlaylistIds);
+			}, FSpotifyLibraryCache::DefaultMaxConcurrentPlaylists, OnFailure, MakeLibraryIndexPageHook());
+			ForwardCancellation(Token, Request);
+		});
+		return FSpotifyRequestHandle(Token);
+	}
+
+	/**
+	 * Incrementally syncs the library store, refetching only playlists whose snapshot changed and
+	 * reporting the added, removed and moved tracks of each of them. Cheap enough to call periodically.
+	 */
+	SPOTIFYSDK_API FSpotifyRequestHandle SyncLibrary(const FString& UserId, const TFunction<void(const FLibrarySyncResult& Result)>& Callback, const int MaxConcurrentPlaylists = FSpotifyLibraryCache::DefaultMaxConcurrentPlaylists, const TFunction<void(const FSpotifyError& Error)>& OnFailure = nullptr)
+	{
+		FCancellationTokenRef Token = MakeShared<FCancellationToken, ESPMode::ThreadSafe>();
+		LoadLibraryCache([this, Token, UserId, Callback, MaxConcurrentPlaylists, OnFailure]()
+		{
+			if (Token->IsCancelled())
+			{
+				return;
+			}
+			const FSpotifyRequestHandle Request = FSpotifyLibrarySync::Sync(LibraryCache, GetSpotifyUserToken(), UserId, [this, Callback](const FLibrarySyncResult& Result)
+			{
+				for (const FString& PlaylistId : Result.RemovedPlaylistIds)
+				{
+					TrackSearchIndex->RemovePlaylist(PlaylistId);
+					TrackStore->RemovePlaylist(PlaylistId);
+				}
+
+				TArray<FString> ChangedPlaylistIds;
+				for (const FPlaylistProfile& Playlist : Result.AddedPlaylists)
+				{
+					ChangedPlaylistIds.Add(Playlist.PlaylistId);
+				}
+				for (const FPlaylistDiff& Diff : Result.ChangedPlaylists)
+				{
+					ChangedPlaylistIds.Add(Diff.Profile.PlaylistId);
+				}
+				StoreCachedPlaylists(ChangedPlaylistIds);
+				IndexCachedPlaylists(Result.FailedPlaylistIds);
+				CompactLibrary();
+
+				Callback(Result);
+			}, MaxConcurrentPlaylists, OnFailure, MakeLibraryIndexPageHook());
+			ForwardCancellation(Token, Request);
+		});
+		return FSpotifyRequestHandle(Token);
+	}
+
+	SPOTIFYSDK_API const FSpotifyLibraryCache& GetLibraryCache() const { return *LibraryCache; }
+
+	/**
+	 * Typeahead search over the tracks of the library (see RequestLibrary and SyncLibrary) and any
+	 * tracks added to GetTrackSearchIndex, matching name, artists and album by word prefix.
+	 */
+	SPOTIFYSDK_API TArray<FTrackProfile> SearchTracks(const FString& Query, const int32 MaxResults = 20) const
+	{
+		return TrackSearchIndex->Search(Query, MaxResults);
+	}
+
+	SPOTIFYSDK_API FTrackSearchIndex& GetTrackSearchIndex() { return *TrackSearchIndex; }
+
+	/**
+	 * Get the IDs of the library playlists that contain a track, without scanning the library.
+	 */
+	SPOTIFYSDK_API TArray<FString> GetPlaylistsContainingTrack(const FString& TrackId) const
+	{
+		return TrackStore->GetPlaylistsContaining(TrackId);
+	}
+
+	SPOTIFYSDK_API FTrackStore& GetTrackStore() { return *TrackStore; }
+
+	SPOTIFYSDK_API FSpotifyRequestHandle RequestTracks(const TArray<FString>& TrackIds, const TFunction<void(const TArray<FTrackProfile>& Tracks, const TArray<FString>& FailedTrackIds)>& Callback, const int MaxConcurrentRequests = 4, const TFunction<void(const FSpotifyError& Error)>& OnFailure = nullptr)
+	{
+		return FSpotifyTracks::RequestTracks(GetSpotifyUserToken(), TrackIds, Callback, MaxConcurrentRequests, OnFailure);
+	}
+
+	SPOTIFYSDK_API FSpotifyRequestHandle RequestAlbums(const TArray<FString>& AlbumIds, const TFunction<void(const TArray<FAlbumProfile>& Albums, const TArray<FString>& FailedAlbumIds)>& Callback, const int MaxConcurrentRequests = 4, const TFunction<void(const FSpotifyError& Error)>& OnFailure = nullptr)
+	{
+		return FSpotifyAlbums::RequestAlbums(GetSpotifyUserToken(), AlbumIds, Callback, MaxConcurrentRequests, OnFailure);
+	}
+
+	SPOTIFYSDK_API FSpotifyRequestHandle RequestArtists(const TArray<FString>& ArtistIds, const TFunction<void(const TArray<FArtistProfile>& Artists, const TArray<FString>& FailedArtistIds)>& Callback, const int MaxConcurrentRequests = 4, const TFunction<void(const FSpotifyError& Error)>& OnFailure = nullptr)
+	{
+		return FSpotifyArtists::RequestArtists(GetSpotifyUserToken(), ArtistIds, Callback, MaxConcurrentRequests, OnFailure);
+	}
+
+	SPOTIFYSDK_API FSpotifyRequestHandle RequestTrackPreviewUrl(const FString& TrackId, const TFunction<void(const FString& Url)>& Callback, const TFunction<void(const FSpotifyError& Error)>& OnFailure = nullptr)
+	{
+		return FSpotifyTracks::RequestTrackPreviewUrl(TrackId, Callback, OnFailure);
+	}
+
+	/**
+	 * Resolves the preview urls of many tracks with bounded concurrency.
+	 * Results (including tracks without a preview) are kept in a persistent store, so repeat
+	 * sessions mostly skip the network. The store is loaded on first use.
+	 */
+	SPOTIFYSDK_API FSpotifyRequestHandle RequestTrackPreviewUrls(const TArray<FString>& TrackIds, const TFunction<void(const TArray<FString>& PreviewUrls, const TArray<FString>& FailedTrackIds)>& Callback, const int MaxConcurrentRequests = 8)
+	{
+		if (!bPreviewUrlCacheLoaded)
+		{
+			PreviewUrlCache->Load();
+			bPreviewUrlCacheLoaded = true;
+		}
+		return FPreviewUrlCache::RequestPreviewUrls(PreviewUrlCache, TrackIds, Callback, MaxConcurrentRequests);
+	}
+
+	SPOTIFYSDK_API FPreviewUrlCache& GetPreviewUrlCache() { return *PreviewUrlCache; }
+
+	///////////////////////////////////////
+
+	/**
+	 * Get the hit/miss counters of the in-memory Web API response cache.
+	 * @return A snapshot of the cache statistics.
+	 */
+	SPOTIFYSDK_API FResponseCacheStats GetResponseCacheStats() const { return FResponseCache::Get().GetStats(); }
+	SPOTIFYSDK_API void SetResponseCacheByteBudget(const int64 ByteBudget) { FResponseCache::Get().SetByteBudget(ByteBudget); }
+	SPOTIFYSDK_API void ClearResponseCache() { FResponseCache::Get().Clear(); }
+
+	/**
+	 * Get the request metrics of every endpoint used so far (request counts, bytes, latencies, decode times, 429s).
+	 * @return A snapshot of the metrics keyed by endpoint name, e.g. "playlists/{id}/tracks".
+	 */
+	SPOTIFYSDK_API TMap<FString, FSpotifyEndpointStats> GetRequestStats() const { return FRequestStats::Get().GetStats(); }
+	SPOTIFYSDK_API void ResetRequestStats() { FRequestStats::Get().Reset(); }
+	SPOTIFYSDK_API void DumpRequestStats() const { FRequestStats::Get().DumpToLog(); }
+
+	///////////////////////////////////////
+
+	/**
+	 * Choose the thread endpoint callbacks are delivered on, decoding always runs on task graph workers.
+	 * Defaults to the game thread.
+	 */
+	SPOTIFYSDK_API void SetCallbackThread(const ECallbackThread CallbackThread) { FAsyncDecode::SetCallbackThread(CallbackThread); }
+
+	/**
+	 * Configure the central request scheduler, see FRequestScheduler.
+	 */
+	SPOTIFYSDK_API void SetRequestRateLimit(const float RequestsPerSecond, const int32 BurstSize) { FRequestScheduler::Get().SetRateLimit(RequestsPerSecond, BurstSize); }
+	SPOTIFYSDK_API void SetRequestConcurrencyLimits(const int32 MaxConcurrentRequests, const int32 InteractiveReservedSlots) { FRequestScheduler::Get().SetConcurrencyLimits(MaxConcurrentRequests, InteractiveReservedSlots); }
+
+	/**
+	 * Configures the prefetching done after RequestUserPlaylists, prefetching is off until enabled here.
+	 * @param NumPlaylists The number of most likely playlists whose first tracks page and cover are prefetched, 0 disables prefetching.
+	 * @param Budget The concurrency, byte and bandwidth budget of every prefetch run.
+	 */
+	SPOTIFYSDK_API void SetPlaylistPrefetch(const int32 NumPlaylists, const FPrefetchBudget& Budget = FPrefetchBudget())
 	{
-		FSpotifyTracks::RequestTrackPreviewUrl(TrackId, Callback);
+		NumPrefetchPlaylists = FMath::Max(0, NumPlaylists);
+		PlaylistPrefetcher->SetBudget(Budget);
+		if (NumPrefetchPlaylists == 0)
+		{
+			PlaylistPrefetcher->Cancel();
+		}
 	}
 
+	/**
+	 * Get a prefetched playlist cover, see FSpotifyPlaylistPrefetcher::FindImage.
+	 */
+	SPOTIFYSDK_API TSharedPtr<const TArray<uint8>, ESPMode::ThreadSafe> FindPrefetchedImage(const FString& Url) const { return PlaylistPrefetcher->FindImage(Url); }
+
+	SPOTIFYSDK_API FSpotifyPlaylistPrefetcher& GetPlaylistPrefetcher() { return *PlaylistPrefetcher; }
+
 	///////////////////////////////////////
 
 	SPOTIFYSDK_API const FString& GetClientId() { return GetSpotifyAuth().GetClientId(); }
@@ -69,17 +341,221 @@ public:
 	 * Get the Logged-in Spotify User Access Token.
 	 * This token is given after the user has agreed authentication and
 	 * serves as the primary bearer for all higher-level endpoint calls.
-	 * @return A reference to the User Token string.
+	 * @return A copy of the User Token string, safe to read from any thread.
 	 */
-	SPOTIFYSDK_API const FString& GetSpotifyUserToken() { return GetSpotifyAuth().GetSpotifyUserToken(); }
+	SPOTIFYSDK_API FString GetSpotifyUserToken() const { return GetSpotifyAuth().GetSpotifyUserToken(); }
 
 private:
 	static FSpotifySDKModule* Singleton;
 
+	/**
+	 * Loads the library store on a background task on first use, requests made meanwhile wait for it.
+	 * @param OnLoaded A function that will be called once the store is loaded and indexed, right away if it already is.
+	 */
+	void LoadLibraryCache(TFunction<void()> OnLoaded)
+	{
+		bool bLoaded;
+		{
+			FScopeLock Lock(&LibraryCacheLoadMutex);
+			bLoaded = bLibraryCacheLoaded;
+			if (!bLoaded)
+			{
+				PendingLibraryCacheLoads.Add(MoveTemp(OnLoaded));
+				if (bLibraryCacheLoading)
+				{
+					return;
+				}
+				bLibraryCacheLoading = true;
+			}
+		}
+
+		if (bLoaded)
+		{
+			OnLoaded();
+			return;
+		}
+
+		FSpotifyLibraryCache::LoadAsync(LibraryCache, [this]()
+		{
+			IndexCachedPlaylists(LibraryCache->GetPlaylistIds());
+
+			TArray<TFunction<void()>> Pending;
+			{
+				FScopeLock Lock(&LibraryCacheLoadMutex);
+				bLibraryCacheLoaded = true;
+				bLibraryCacheLoading = false;
+				Pending = MoveTemp(PendingLibraryCacheLoads);
+			}
+			for (const TFunction<void()>& Loaded : Pending)
+			{
+				Loaded();
+			}
+		});
+	}
+
+	/**
+	 * Cancels a request started after its handle was returned whenever the handle is cancelled.
+	 */
+	static void ForwardCancellation(const FCancellationTokenRef& Token, const FSpotifyRequestHandle& Request)
+	{
+		Token->SetOnCancelled([Request]() { Request.Cancel(); });
+		// The handle may have been cancelled before the listener was set.
+		if (Token->IsCancelled())
+		{
+			Request.Cancel();
+		}
+	}
+
+	void PrefetchLikelyPlaylists(const TArray<FPlaylistProfile>& Playlists)
+	{
+		if (NumPrefetchPlaylists > 0)
+		{
+			PlaylistPrefetcher->Prefetch(GetSpotifyUserToken(), Playlists, NumPrefetchPlaylists);
+		}
+	}
+
+	/**
+	 * Resets the search index and the track store to the stored tracks of the playlists.
+	 * Playlists whose refetch failed go through here too, as the index may already hold some of their new pages.
+	 */
+	void IndexCachedPlaylists(const TArray<FString>& PlaylistIds)
+	{
+		for (const FString& PlaylistId : PlaylistIds)
+		{
+			FCachedPlaylist Playlist;
+			if (LibraryCache->Find(PlaylistId, Playlist))
+			{
+				TrackSearchIndex->SetPlaylistTracks(PlaylistId, Playlist.Tracks);
+				TrackStore->SetPlaylistTracks(PlaylistId, Playlist.Tracks);
+			}
+			else
+			{
+				TrackSearchIndex->RemovePlaylist(PlaylistId);
+			}
+		}
+	}
+
+	/**
+	 * Updates the track store from refetched playlists, their pages were already indexed as they arrived.
+	 */
+	void StoreCachedPlaylists(const TArray<FString>& PlaylistIds)
+	{
+		for (const FString& PlaylistId : PlaylistIds)
+		{
+			FCachedPlaylist Playlist;
+			if (LibraryCache->Find(PlaylistId, Playlist))
+			{
+				TrackStore->SetPlaylistTracks(PlaylistId, Playlist.Tracks);
+			}
+		}
+	}
+
+	/**
+	 * Drops the tracks that left the library with the playlists that held them.
+	 * The track store frees them as they go, only the library store's lookup needs a sweep.
+	 */
+	void CompactLibrary()
+	{
+		LibraryCache->Compact();
+	}
+
+	/**
+	 * Feeds the pages of a library playlist into the search index as they are decoded.
+	 * The first page replaces the playlist's previous tracks, pagination delivers it before any other page.
+	 * Only complete tracks of requests from the start of the playlist are indexed, anything else would
+	 * replace the playlist with a partial one. Playlists outside the library (e.g. a friend's) are never
+	 * indexed, search only covers the library. Tracks are shared through the library store, so the index
+	 * and the stored playlists hold the same instances.
+	 */
+	TFunction<void(const FPlaylistTracksPage& Page)> MakeIndexPageHook(const FString& PlaylistId, const TPair<int, int> LimitOffset, const ETrackFields Fields) const
+	{
+		if (LimitOffset.Value != 0 || Fields != ETrackFields::All || !LibraryCache->Contains(PlaylistId))
+		{
+			return nullptr;
+		}
+
+		return [Index = TrackSearchIndex, Cache = LibraryCache, PlaylistId](const FPlaylistTracksPage& Page)
+		{
+			IndexPage(*Index, *Cache, PlaylistId, Page);
+		};
+	}
+
+	/**
+	 * Resets an indexed playlist to its stored tracks if its request fails, the pages indexed so far would leave it partial.
+	 */
+	TFunction<void(const FSpotifyError& Error)> MakeIndexFailureHook(const FString& PlaylistId, const TFunction<void(const FPlaylistTracksPage& Page)>& IndexPage, const TFunction<void(const FSpotifyError& Error)>& OnFailure)
+	{
+		if (!IndexPage)
+		{
+			return OnFailure;
+		}
+
+		return [this, PlaylistId, OnFailure](const FSpotifyError& Error)
+		{
+			IndexCachedPlaylists({ PlaylistId });
+			if (OnFailure)
+			{
+				OnFailure(Error);
+			}
+		};
+	}
+
+	TFunction<void(const FString& PlaylistId, const FPlaylistTracksPage& Page)> MakeLibraryIndexPageHook() const
+	{
+		return [Index = TrackSearchIndex, Cache = LibraryCache](const FString& PlaylistId, const FPlaylistTracksPage& Page)
+		{
+			IndexPage(*Index, *Cache, PlaylistId, Page);
+		};
+	}
+
+	static void IndexPage(FTrackSearchIndex& Index, FSpotifyLibraryCache& Cache, const FString& PlaylistId, const FPlaylistTracksPage& Page)
+	{
+		const TArray<FTrackProfileRef> Tracks = Cache.ShareTracks(Page.Tracks);
+		if (Page.PageIndex == 0)
+		{
+			Index.SetPlaylistTracks(PlaylistId, Tracks);
+		}
+		else
+		{
+			Index.AddTracks(PlaylistId, Tracks);
+		}
+	}
+
 	/**
 	 * Authentication instance for Spotify SDK.
 	 * Holds all necessary credentials and tokens.
 	 * This is a singleton instance that can be accessed statically.
 	 */
 	TUniquePtr<FSpotifyAuth> SpotifyAuth = MakeUnique<FSpotifyAuth>();
+
+	/**
+	 * Persistent store of the user's decoded playlists, see RequestLibrary.
+	 */
+	TSharedRef<FSpotifyLibraryCache, ESPMode::ThreadSafe> LibraryCache = MakeShared<FSpotifyLibraryCache, ESPMode::ThreadSafe>();
+	FCriticalSection LibraryCacheLoadMutex;
+	bool bLibraryCacheLoaded = false;
+	bool bLibraryCacheLoading = false;
+	TArray<TFunction<void()>> PendingLibraryCacheLoads;
+
+	/**
+	 * Search index over the library's tracks, see SearchTracks.
+	 */
+	TSharedRef<FTrackSearchIndex, ESPMode::ThreadSafe> TrackSearchIndex = MakeShared<FTrackSearchIndex, ESPMode::ThreadSafe>();
+
+	/**
+	 * Deduplicated tracks of the library and the playlists containing each of them, see GetPlaylistsContainingTrack.
+	 */
+	TSharedRef<FTrackStore, ESPMode::ThreadSafe> TrackStore = MakeShared<FTrackStore, ESPMode::ThreadSafe>();
+
+	/**
+	 * Persistent TrackId -> preview url store, see RequestTrackPreviewUrls.
+	 */
+	TSharedRef<FPreviewUrlCache, ESPMode::ThreadSafe> PreviewUrlCache = MakeShared<FPreviewUrlCache, ESPMode::ThreadSafe>();
+	bool bPreviewUrlCacheLoaded = false;
+
+	/**
+	 * Warms the playlists most likely to be opened after RequestUserPlaylists, see SetPlaylistPrefetch.
+	 */
+	TSharedRef<FSpotifyPlaylistPrefetcher, ESPMode::ThreadSafe> PlaylistPrefetcher = MakeShared<FSpotifyPlaylistPrefetcher, ESPMode::ThreadSafe>();
+	int32 NumPrefetchPlaylists = 0;
 };
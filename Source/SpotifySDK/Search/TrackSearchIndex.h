@@ -0,0 +1,505 @@
+﻿// Copyright (c) Harris Barra. (MIT License)
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/BitArray.h"
+#include "Misc/ScopeRWLock.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+#include "SpotifySDK/Tracks/TrackProfile.h"
+
+class FTrackSearchIndex
+{
+public:
+	// This is an in-memory inverted index over the name, artists and album of loaded tracks.
+	// Every distinct word is a term with a posting list of the tracks containing it, and every term
+	// is also filed under each of its first MaxIndexedPrefix characters, so a typeahead prefix resolves
+	// to its matching terms with a single lookup instead of a scan over the library.
+	// Tracks are shared between playlists and reference counted, a track leaving its last playlist is
+	// only tombstoned (its postings stay valid if it comes back) and the index is compacted once most
+	// of it is dead. Documents hold the shared track itself (see FTrackProfileRef), not a copy.
+
+	/**
+	 * Adds tracks of a playlist, e.g. a page as soon as it arrives.
+	 * Tracks already indexed take the metadata of the added ones.
+	 * @param PlaylistId The playlist the tracks belong to.
+	 * @param Tracks The tracks to add.
+	 */
+	void AddTracks(const FString& PlaylistId, const TArray<FTrackProfileRef>& Tracks)
+	{
+		TRACE_CPUPROFILER_EVENT_SCOPE(SpotifySDK_IndexTracks);
+
+		FWriteScopeLock Lock(IndexLock);
+		TArray<int32>& PlaylistDocuments = Playlists.FindOrAdd(PlaylistId);
+		PlaylistDocuments.Reserve(PlaylistDocuments.Num() + Tracks.Num());
+		for (const FTrackProfileRef& Track : Tracks)
+		{
+			PlaylistDocuments.Add(AddReference(Track));
+		}
+	}
+
+	/**
+	 * Adds tracks that are not shared with a library store, the index keeps its own instance of each.
+	 */
+	void AddTracks(const FString& PlaylistId, const TArray<FTrackProfile>& Tracks)
+	{
+		AddTracks(PlaylistId, MakeTrackRefs(Tracks));
+	}
+
+	/**
+	 * Replaces the tracks of a playlist, used when its snapshot changed.
+	 */
+	void SetPlaylistTracks(const FString& PlaylistId, const TArray<FTrackProfileRef>& Tracks)
+	{
+		{
+			FWriteScopeLock Lock(IndexLock);
+			RemovePlaylistLocked(PlaylistId);
+		}
+		AddTracks(PlaylistId, Tracks);
+	}
+
+	void SetPlaylistTracks(const FString& PlaylistId, const TArray<FTrackProfile>& Tracks)
+	{
+		SetPlaylistTracks(PlaylistId, MakeTrackRefs(Tracks));
+	}
+
+	void RemovePlaylist(const FString& PlaylistId)
+	{
+		FWriteScopeLock Lock(IndexLock);
+		RemovePlaylistLocked(PlaylistId);
+	}
+
+	/**
+	 * Removes every playlist that is not in PlaylistIds.
+	 */
+	void RetainPlaylists(const TSet<FString>& PlaylistIds)
+	{
+		FWriteScopeLock Lock(IndexLock);
+
+		TArray<FString> StalePlaylistIds;
+		for (const TPair<FString, TArray<int32>>& Pair : Playlists)
+		{
+			if (!PlaylistIds.Contains(Pair.Key))
+			{
+				StalePlaylistIds.Add(Pair.Key);
+			}
+		}
+		for (const FString& PlaylistId : StalePlaylistIds)
+		{
+			RemovePlaylistLocked(PlaylistId);
+		}
+	}
+
+	/**
+	 * Finds the tracks matching every word of the query, the last word may be incomplete.
+	 * Matches are ranked by where they were found (name, then artists, then album) and by whether
+	 * the words matched whole terms.
+	 * @param Query The text typed by the user.
+	 * @param MaxResults The maximum number of tracks returned.
+	 * @return The best matching tracks, best first.
+	 */
+	TArray<FTrackProfile> Search(const FString& Query, const int32 MaxResults = 20) const
+	{
+		TRACE_CPUPROFILER_EVENT_SCOPE(SpotifySDK_SearchTracks);
+
+		TArray<FString> Words;
+		Tokenize(Query, Words);
+		if (Words.Num() == 0 || MaxResults <= 0)
+		{
+			return {};
+		}
+
+		FReadScopeLock Lock(IndexLock);
+
+		// Resolve every word to the terms it is a prefix of, and enumerate candidates from the rarest word.
+		TArray<TArray<int32>> WordTerms;
+		WordTerms.SetNum(Words.Num());
+		int32 RarestWord = 0;
+		int64 RarestCount = MAX_int64;
+		for (int32 WordIndex = 0; WordIndex < Words.Num(); ++WordIndex)
+		{
+			FindTerms(Words[WordIndex], WordTerms[WordIndex]);
+
+			int64 Count = 0;
+			for (const int32 Term : WordTerms[WordIndex])
+			{
+				Count += Postings[Term].Num();
+			}
+			if (Count == 0)
+			{
+				return {};
+			}
+			if (Count < RarestCount)
+			{
+				RarestCount = Count;
+				RarestWord = WordIndex;
+			}
+		}
+
+		// (score, document) of the best candidates so far, kept as a heap with the worst on top.
+		auto IsBetter = [](const TPair<int32, int32>& A, const TPair<int32, int32>& B)
+		{
+			return A.Key != B.Key ? A.Key > B.Key : A.Value < B.Value;
+		};
+		auto IsWorse = [&IsBetter](const TPair<int32, int32>& A, const TPair<int32, int32>& B) { return IsBetter(B, A); };
+		TArray<TPair<int32, int32>> Ranked;
+		Ranked.Reserve(MaxResults + 1);
+
+		TBitArray<> Visited(false, Documents.Num());
+		for (const int32 Term : WordTerms[RarestWord])
+		{
+			for (const int32 DocumentIndex : Postings[Term])
+			{
+				if (Visited[DocumentIndex] || Documents[DocumentIndex].RefCount == 0)
+				{
+					continue;
+				}
+				Visited[DocumentIndex] = true;
+
+				const TPair<int32, int32> Entry(ScoreDocument(Documents[DocumentIndex], Words), DocumentIndex);
+				if (Entry.Key == 0 || (Ranked.Num() == MaxResults && !IsBetter(Entry, Ranked.HeapTop())))
+				{
+					continue;
+				}
+
+				Ranked.HeapPush(Entry, IsWorse);
+				if (Ranked.Num() > MaxResults)
+				{
+					Ranked.HeapPopDiscard(IsWorse);
+				}
+			}
+		}
+		Ranked.Sort(IsBetter);
+
+		TArray<FTrackProfile> Results;
+		Results.Reserve(Ranked.Num());
+		for (const TPair<int32, int32>& Entry : Ranked)
+		{
+			Results.Add(*Documents[Entry.Value].Track);
+		}
+		return Results;
+	}
+
+	/**
+	 * Get the number of distinct tracks in the index.
+	 */
+	int32 Num() const
+	{
+		FReadScopeLock Lock(IndexLock);
+		return NumLiveDocuments;
+	}
+
+	void Reset()
+	{
+		FWriteScopeLock Lock(IndexLock);
+		ResetLocked();
+	}
+
+	/**
+	 * Splits text into lowercase alphanumeric words.
+	 */
+	static void Tokenize(const FString& Text, TArray<FString>& OutWords)
+	{
+		int32 Start = INDEX_NONE;
+		for (int32 Index = 0; Index <= Text.Len(); ++Index)
+		{
+			const bool bWordChar = Index < Text.Len() && FChar::IsAlnum(Text[Index]);
+			if (bWordChar && Start == INDEX_NONE)
+			{
+				Start = Index;
+			}
+			else if (!bWordChar && Start != INDEX_NONE)
+			{
+				OutWords.Add(Text.Mid(Start, Index - Start).ToLower());
+				Start = INDEX_NONE;
+			}
+		}
+	}
+
+private:
+	struct FDocument
+	{
+		explicit FDocument(const FTrackProfileRef& InTrack)
+			: Track(InTrack)
+		{
+		}
+
+		FTrackProfileRef Track;
+		// Term ids per field, in field order.
+		TArray<int32> NameTerms;
+		TArray<int32> ArtistTerms;
+		TArray<int32> AlbumTerms;
+		// Number of playlist entries referencing the track, 0 once tombstoned.
+		int32 RefCount = 0;
+	};
+
+	// Longer prefixes are resolved through their first MaxIndexedPrefix characters and then filtered.
+	static constexpr int32 MaxIndexedPrefix = 6;
+
+	static TArray<FTrackProfileRef> MakeTrackRefs(const TArray<FTrackProfile>& Tracks)
+	{
+		TArray<FTrackProfileRef> TrackRefs;
+		TrackRefs.Reserve(Tracks.Num());
+		for (const FTrackProfile& Track : Tracks)
+		{
+			TrackRefs.Add(MakeShared<const FTrackProfile, ESPMode::ThreadSafe>(Track));
+		}
+		return TrackRefs;
+	}
+
+	int32 AddReference(const FTrackProfileRef& Track)
+	{
+		if (const int32* Existing = DocumentIds.Find(Track->TrackId))
+		{
+			const int32 DocumentIndex = *Existing;
+			FDocument& Document = Documents[DocumentIndex];
+			if (Document.RefCount++ == 0)
+			{
+				NumLiveDocuments++;
+			}
+
+			// A refetched track may have been renamed or moved to another album, the newest metadata wins.
+			if (!Document.Track->HasSameMetadata(*Track))
+			{
+				UpdateDocument(DocumentIndex, Track);
+			}
+			else
+			{
+				// Holding the newest instance lets an older one be freed with the playlists that still hold it.
+				Document.Track = Track;
+			}
+			return DocumentIndex;
+		}
+
+		const int32 DocumentIndex = Documents.Emplace(Track);
+		FDocument& Document = Documents[DocumentIndex];
+		Document.RefCount = 1;
+		NumLiveDocuments++;
+		DocumentIds.Add(Track->TrackId, DocumentIndex);
+
+		IndexDocument(DocumentIndex);
+		return DocumentIndex;
+	}
+
+	/**
+	 * Replaces the track of a document, reposting it if any searchable field changed.
+	 * Terms that lose their last document stay until the next compaction.
+	 */
+	void UpdateDocument(const int32 DocumentIndex, const FTrackProfileRef& Track)
+	{
+		FDocument& Document = Documents[DocumentIndex];
+		const FTrackProfile& OldTrack = *Document.Track;
+		const bool bTermsChanged = OldTrack.Name != Track->Name || OldTrack.Artists != Track->Artists || OldTrack.AlbumName != Track->AlbumName;
+		Document.Track = Track;
+		if (!bTermsChanged)
+		{
+			return;
+		}
+
+		for (const int32 Term : GetUniqueTerms(Document))
+		{
+			Postings[Term].RemoveSingleSwap(DocumentIndex);
+		}
+		Document.NameTerms.Reset();
+		Document.ArtistTerms.Reset();
+		Document.AlbumTerms.Reset();
+
+		IndexDocument(DocumentIndex);
+	}
+
+	/**
+	 * Tokenizes the fields of a document and posts it under every term.
+	 */
+	void IndexDocument(const int32 DocumentIndex)
+	{
+		FDocument& Document = Documents[DocumentIndex];
+		const FTrackProfile& Track = *Document.Track;
+
+		TArray<FString> Words;
+		Tokenize(Track.Name, Words);
+		AddTerms(Words, Document.NameTerms);
+
+		Words.Reset();
+		for (const FString& Artist : Track.Artists)
+		{
+			Tokenize(Artist, Words);
+		}
+		AddTerms(Words, Document.ArtistTerms);
+
+		Words.Reset();
+		Tokenize(Track.AlbumName, Words);
+		AddTerms(Words, Document.AlbumTerms);
+
+		for (const int32 Term : GetUniqueTerms(Document))
+		{
+			Postings[Term].Add(DocumentIndex);
+		}
+	}
+
+	/**
+	 * A document is posted once per term, however often and in however many fields the term appears.
+	 */
+	static TSet<int32, DefaultKeyFuncs<int32>, TInlineSetAllocator<16>> GetUniqueTerms(const FDocument& Document)
+	{
+		TSet<int32, DefaultKeyFuncs<int32>, TInlineSetAllocator<16>> UniqueTerms;
+		UniqueTerms.Append(Document.NameTerms);
+		UniqueTerms.Append(Document.ArtistTerms);
+		UniqueTerms.Append(Document.AlbumTerms);
+		return UniqueTerms;
+	}
+
+	void AddTerms(const TArray<FString>& Words, TArray<int32>& OutTerms)
+	{
+		OutTerms.Reserve(Words.Num());
+		for (const FString& Word : Words)
+		{
+			if (const int32* Existing = TermIds.Find(Word))
+			{
+				OutTerms.Add(*Existing);
+				continue;
+			}
+
+			const int32 Term = Terms.Add(Word);
+			TermIds.Add(Word, Term);
+			Postings.AddDefaulted();
+			for (int32 Length = 1; Length <= FMath::Min(Word.Len(), MaxIndexedPrefix); ++Length)
+			{
+				PrefixTerms.FindOrAdd(Word.Left(Length)).Add(Term);
+			}
+			OutTerms.Add(Term);
+		}
+	}
+
+	void RemovePlaylistLocked(const FString& PlaylistId)
+	{
+		TArray<int32> PlaylistDocuments;
+		if (!Playlists.RemoveAndCopyValue(PlaylistId, PlaylistDocuments))
+		{
+			return;
+		}
+
+		for (const int32 DocumentIndex : PlaylistDocuments)
+		{
+			if (--Documents[DocumentIndex].RefCount == 0)
+			{
+				NumLiveDocuments--;
+			}
+		}
+
+		if (Documents.Num() > 1024 && NumLiveDocuments < Documents.Num() / 2)
+		{
+			CompactLocked();
+		}
+	}
+
+	/**
+	 * Rebuilds the index from the playlists, dropping tombstoned tracks and unused terms.
+	 */
+	void CompactLocked()
+	{
+		TMap<FString, TArray<int32>> OldPlaylists = MoveTemp(Playlists);
+		TArray<FDocument> OldDocuments = MoveTemp(Documents);
+		ResetLocked();
+
+		for (TPair<FString, TArray<int32>>& Pair : OldPlaylists)
+		{
+			TArray<int32>& PlaylistDocuments = Playlists.Add(Pair.Key);
+			PlaylistDocuments.Reserve(Pair.Value.Num());
+			for (const int32 DocumentIndex : Pair.Value)
+			{
+				PlaylistDocuments.Add(AddReference(OldDocuments[DocumentIndex].Track));
+			}
+		}
+	}
+
+	void ResetLocked()
+	{
+		Documents.Reset();
+		DocumentIds.Reset();
+		Terms.Reset();
+		TermIds.Reset();
+		Postings.Reset();
+		PrefixTerms.Reset();
+		Playlists.Reset();
+		NumLiveDocuments = 0;
+	}
+
+	void FindTerms(const FString& Word, TArray<int32>& OutTerms) const
+	{
+		const TArray<int32>* Candidates = PrefixTerms.Find(Word.Len() > MaxIndexedPrefix ? Word.Left(MaxIndexedPrefix) : Word);
+		if (!Candidates)
+		{
+			return;
+		}
+
+		if (Word.Len() <= MaxIndexedPrefix)
+		{
+			OutTerms = *Candidates;
+			return;
+		}
+
+		for (const int32 Term : *Candidates)
+		{
+			if (Terms[Term].StartsWith(Word, ESearchCase::CaseSensitive))
+			{
+				OutTerms.Add(Term);
+			}
+		}
+	}
+
+	/**
+	 * Scores a candidate against every query word, 0 if any word is not found.
+	 */
+	int32 ScoreDocument(const FDocument& Document, const TArray<FString>& Words) const
+	{
+		int32 Score = 0;
+		for (const FString& Word : Words)
+		{
+			const int32 WordScore = FMath::Max3(
+				ScoreField(Document.NameTerms, Word, 6),
+				ScoreField(Document.ArtistTerms, Word, 4),
+				ScoreField(Document.AlbumTerms, Word, 2));
+			if (WordScore == 0)
+			{
+				return 0;
+			}
+			Score += WordScore;
+		}
+		return Score;
+	}
+
+	int32 ScoreField(const TArray<int32>& FieldTerms, const FString& Word, const int32 Weight) const
+	{
+		int32 Score = 0;
+		for (const int32 Term : FieldTerms)
+		{
+			const FString& TermStr = Terms[Term];
+			if (TermStr.Len() == Word.Len() && TermStr.Equals(Word, ESearchCase::CaseSensitive))
+			{
+				// Whole word matches rank above prefix matches.
+				return Weight + 1;
+			}
+			if (TermStr.StartsWith(Word, ESearchCase::CaseSensitive))
+			{
+				Score = Weight;
+			}
+		}
+		return Score;
+	}
+
+	mutable FRWLock IndexLock;
+
+	TArray<FDocument> Documents;
+	TMap<FString, int32> DocumentIds;
+	int32 NumLiveDocuments = 0;
+
+	TArray<FString> Terms;
+	TMap<FString, int32> TermIds;
+	// Documents containing each term.
+	TArray<TArray<int32>> Postings;
+	// Terms filed under each of their first MaxIndexedPrefix prefixes.
+	TMap<FString, TArray<int32>> PrefixTerms;
+
+	// The document of every entry of every indexed playlist.
+	TMap<FString, TArray<int32>> Playlists;
+};
@@ -46,6 +46,15 @@ public class SpotifySDK : ModuleRules
 			);
 		
 		
+		// The offline benchmark (SpotifySDK.Benchmark console command) replays payloads from a local HTTP server.
+		bool bWithBenchmark = Target.Configuration != UnrealTargetConfiguration.Shipping;
+		if (bWithBenchmark)
+		{
+			PrivateDependencyModuleNames.Add("HTTPServer");
+		}
+		PrivateDefinitions.Add("WITH_SPOTIFYSDK_BENCHMARK=" + (bWithBenchmark ? "1" : "0"));
+		
+		
 		DynamicallyLoadedModuleNames.AddRange(
 			new string[]
 			{
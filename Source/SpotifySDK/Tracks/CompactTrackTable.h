@@ -0,0 +1,292 @@
+﻿// Copyright (c) Harris Barra. (MIT License)
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Misc/Crc.h"
+#include "SpotifySDK/Tracks/SpotifyTracks.h"
+
+/**
+ * A Spotify id (22 character base62) stored inline, without a heap allocation.
+ * SEE: https://developer.spotify.com/documentation/web-api/concepts/spotify-uris-ids
+ */
+struct FSpotifyId
+{
+	static constexpr int32 Length = 22;
+
+	ANSICHAR Chars[Length] = {};
+
+	/**
+	 * Parses a base62 id.
+	 * @return False (and an invalid id) if the string is not a 22 character base62 id.
+	 */
+	static bool Parse(const FString& Str, FSpotifyId& OutId)
+	{
+		OutId = FSpotifyId();
+		if (Str.Len() != Length)
+		{
+			return false;
+		}
+
+		for (int32 Index = 0; Index < Length; ++Index)
+		{
+			const TCHAR Char = Str[Index];
+			if (!FChar::IsAlnum(Char) || Char > 0x7F)
+			{
+				OutId = FSpotifyId();
+				return false;
+			}
+			OutId.Chars[Index] = static_cast<ANSICHAR>(Char);
+		}
+
+		return true;
+	}
+
+	bool IsValid() const { return Chars[0] != '\0'; }
+
+	FString ToString() const
+	{
+		return IsValid() ? FString(FAnsiStringView(Chars, Length)) : FString();
+	}
+
+	bool operator==(const FSpotifyId& Other) const { return FMemory::Memcmp(Chars, Other.Chars, Length) == 0; }
+	bool operator!=(const FSpotifyId& Other) const { return !(*this == Other); }
+
+	friend uint32 GetTypeHash(const FSpotifyId& Id) { return FCrc::MemCrc32(Id.Chars, Length); }
+};
+
+/**
+ * A table of unique strings addressed by index.
+ * Index 0 is always the empty string.
+ * Every string is held once, the lookup is an open addressing hash table of indices into the table.
+ * Strings are compared case-sensitively.
+ */
+class FStringInternTable
+{
+public:
+	FStringInternTable()
+	{
+		Strings.Add(FString());
+		Hashes.Add(0);
+	}
+
+	int32 Intern(const FString& Str)
+	{
+		if (Str.IsEmpty())
+		{
+			return 0;
+		}
+
+		const uint32 Hash = FCrc::StrCrc32(*Str);
+		int32 Slot = FindSlot(Str, Hash);
+		if (Slot != INDEX_NONE && Slots[Slot] != INDEX_NONE)
+		{
+			return Slots[Slot];
+		}
+
+		// Keep the table at most half full so probe sequences stay short.
+		if (Strings.Num() * 2 >= Slots.Num())
+		{
+			Rehash(FMath::Max(MinSlots, Slots.Num() * 2));
+			Slot = FindSlot(Str, Hash);
+		}
+
+		const int32 Index = Strings.Add(Str);
+		Hashes.Add(Hash);
+		Slots[Slot] = Index;
+		return Index;
+	}
+
+	const FString& Get(const int32 Index) const { return Strings[Index]; }
+	int32 Num() const { return Strings.Num(); }
+
+	SIZE_T GetAllocatedSize() const
+	{
+		SIZE_T Size = Strings.GetAllocatedSize() + Hashes.GetAllocatedSize() + Slots.GetAllocatedSize();
+		for (const FString& Str : Strings)
+		{
+			Size += Str.GetAllocatedSize();
+		}
+		return Size;
+	}
+
+private:
+	/**
+	 * Get the slot holding Str, or the empty slot it would be inserted at.
+	 * @return INDEX_NONE if the table has no slots yet.
+	 */
+	int32 FindSlot(const FString& Str, const uint32 Hash) const
+	{
+		if (Slots.Num() == 0)
+		{
+			return INDEX_NONE;
+		}
+
+		const uint32 Mask = Slots.Num() - 1;
+		for (uint32 Slot = Hash & Mask; ; Slot = (Slot + 1) & Mask)
+		{
+			const int32 Index = Slots[Slot];
+			if (Index == INDEX_NONE || (Hashes[Index] == Hash && Strings[Index].Equals(Str, ESearchCase::CaseSensitive)))
+			{
+				return Slot;
+			}
+		}
+	}
+
+	void Rehash(const int32 NumSlots)
+	{
+		Slots.Init(INDEX_NONE, NumSlots);
+
+		const uint32 Mask = NumSlots - 1;
+		for (int32 Index = 1; Index < Strings.Num(); ++Index)
+		{
+			uint32 Slot = Hashes[Index] & Mask;
+			while (Slots[Slot] != INDEX_NONE)
+			{
+				Slot = (Slot + 1) & Mask;
+			}
+			Slots[Slot] = Index;
+		}
+	}
+
+	// Must be a power of two.
+	static constexpr int32 MinSlots = 64;
+
+	TArray<FString> Strings;
+	// The hash of every string, so growing the lookup never rehashes the strings themselves.
+	TArray<uint32> Hashes;
+	// Indices into Strings, INDEX_NONE for empty slots.
+	TArray<int32> Slots;
+};
+
+class FCompactTrackTable
+{
+public:
+	// This is a compact struct-of-arrays representation of many tracks.
+	// Ids are stored inline, and names, artists, album names, release dates and image urls are interned so that
+	// the thousands of duplicates across a large library are only held once.
+	// Convert to the Blueprint FTrackProfile at the edge with ToProfile.
+
+	/**
+	 * Adds a track to the table.
+	 * Note: Tracks without a valid base62 id (local files) keep an invalid FSpotifyId.
+	 * @return The index of the track in the table.
+	 */
+	int32 Add(const FTrackProfile& Profile)
+	{
+		const int32 Index = TrackIds.AddDefaulted();
+		FSpotifyId::Parse(Profile.TrackId, TrackIds[Index]);
+		FSpotifyId::Parse(Profile.AlbumId, AlbumIds.AddDefaulted_GetRef());
+
+		Names.Add(Strings.Intern(Profile.Name));
+		DurationsMs.Add(Profile.DurationMs);
+		AlbumReleaseDates.Add(Strings.Intern(Profile.AlbumReleaseDate));
+		AlbumNames.Add(Strings.Intern(Profile.AlbumName));
+		ImgUrls.Add(Strings.Intern(Profile.ImgUrl));
+
+		for (const FString& Artist : Profile.Artists)
+		{
+			Artists.Add(Strings.Intern(Artist));
+		}
+		ArtistsEnd.Add(Artists.Num());
+
+		return Index;
+	}
+
+	void Append(const TArray<FTrackProfile>& Profiles)
+	{
+		Reserve(Num() + Profiles.Num());
+		for (const FTrackProfile& Profile : Profiles)
+		{
+			Add(Profile);
+		}
+	}
+
+	void Reserve(const int32 NumTracks)
+	{
+		TrackIds.Reserve(NumTracks);
+		AlbumIds.Reserve(NumTracks);
+		Names.Reserve(NumTracks);
+		DurationsMs.Reserve(NumTracks);
+		AlbumReleaseDates.Reserve(NumTracks);
+		AlbumNames.Reserve(NumTracks);
+		ImgUrls.Reserve(NumTracks);
+		ArtistsEnd.Reserve(NumTracks);
+	}
+
+	int32 Num() const { return TrackIds.Num(); }
+
+	const FSpotifyId& GetTrackId(const int32 Index) const { return TrackIds[Index]; }
+	const FSpotifyId& GetAlbumId(const int32 Index) const { return AlbumIds[Index]; }
+	const FString& GetName(const int32 Index) const { return Strings.Get(Names[Index]); }
+	int GetDurationMs(const int32 Index) const { return DurationsMs[Index]; }
+	const FString& GetAlbumReleaseDate(const int32 Index) const { return Strings.Get(AlbumReleaseDates[Index]); }
+	const FString& GetImgUrl(const int32 Index) const { return Strings.Get(ImgUrls[Index]); }
+	const FString& GetAlbumName(const int32 Index) const { return Strings.Get(AlbumNames[Index]); }
+
+	/**
+	 * Get the interned artist indices of a track, resolve them with GetString.
+	 */
+	TArrayView<const int32> GetArtists(const int32 Index) const
+	{
+		const int32 Begin = Index > 0 ? ArtistsEnd[Index - 1] : 0;
+		return TArrayView<const int32>(Artists.GetData() + Begin, ArtistsEnd[Index] - Begin);
+	}
+
+	const FString& GetString(const int32 StringIndex) const { return Strings.Get(StringIndex); }
+
+	/**
+	 * Expands a track back into the Blueprint representation.
+	 */
+	FTrackProfile ToProfile(const int32 Index) const
+	{
+		FTrackProfile Profile;
+		Profile.Name = GetName(Index);
+		Profile.TrackId = TrackIds[Index].ToString();
+		Profile.DurationMs = DurationsMs[Index];
+		Profile.AlbumReleaseDate = GetAlbumReleaseDate(Index);
+		Profile.AlbumId = AlbumIds[Index].ToString();
+		Profile.ImgUrl = GetImgUrl(Index);
+		Profile.AlbumName = GetAlbumName(Index);
+
+		const TArrayView<const int32> TrackArtists = GetArtists(Index);
+		Profile.Artists.Reserve(TrackArtists.Num());
+		for (const int32 Artist : TrackArtists)
+		{
+			Profile.Artists.Add(Strings.Get(Artist));
+		}
+
+		return Profile;
+	}
+
+	void ToProfiles(TArray<FTrackProfile>& OutProfiles) const
+	{
+		OutProfiles.Reserve(OutProfiles.Num() + Num());
+		for (int32 Index = 0; Index < Num(); ++Index)
+		{
+			OutProfiles.Add(ToProfile(Index));
+		}
+	}
+
+	SIZE_T GetAllocatedSize() const
+	{
+		return TrackIds.GetAllocatedSize() + AlbumIds.GetAllocatedSize() + Names.GetAllocatedSize()
+			+ DurationsMs.GetAllocatedSize() + AlbumReleaseDates.GetAllocatedSize() + AlbumNames.GetAllocatedSize() + ImgUrls.GetAllocatedSize()
+			+ Artists.GetAllocatedSize() + ArtistsEnd.GetAllocatedSize() + Strings.GetAllocatedSize();
+	}
+
+private:
+	TArray<FSpotifyId> TrackIds;
+	TArray<FSpotifyId> AlbumIds;
+	TArray<int32> Names;
+	TArray<int> DurationsMs;
+	TArray<int32> AlbumReleaseDates;
+	TArray<int32> AlbumNames;
+	TArray<int32> ImgUrls;
+
+	// Flattened artist lists, the artists of track i are [ArtistsEnd[i - 1], ArtistsEnd[i]).
+	TArray<int32> Artists;
+	TArray<int32> ArtistsEnd;
+
+	FStringInternTable Strings;
+};
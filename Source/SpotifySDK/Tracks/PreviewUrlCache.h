@@ -0,0 +1,269 @@
+﻿// Copyright (c) Harris Barra. (MIT License)
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Misc/DateTime.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Misc/ScopeLock.h"
+#include "Misc/Timespan.h"
+#include "RequestBatcher.h"
+#include "RequestHandle.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+#include "SpotifySDK/Tracks/SpotifyTracks.h"
+
+class FPreviewUrlCache
+{
+public:
+	// This is a persistent TrackId -> preview url store.
+	// Resolving a preview url scrapes a whole embed page, so results are kept across sessions.
+	// Tracks without a preview are stored too (as an empty url) so they are not scraped again,
+	// but with a shorter time to live in case a preview is added later.
+
+	static FString GetDefaultPath()
+	{
+		return FPaths::ProjectSavedDir() / TEXT("SpotifySDK") / TEXT("PreviewUrls.bin");
+	}
+
+	/**
+	 * Loads the store from disk, replacing any entries held in memory. Expired entries are skipped.
+	 * @param Path The file to load from.
+	 * @return False if the file is missing, from an older format version or corrupted.
+	 */
+	bool Load(const FString& Path = GetDefaultPath())
+	{
+		FScopeLock Lock(&Mutex);
+		Entries.Reset();
+
+		TArray<uint8> Bytes;
+		if (!FFileHelper::LoadFileToArray(Bytes, *Path, FILEREAD_Silent))
+		{
+			return false;
+		}
+
+		FMemoryReader Reader(Bytes);
+
+		uint32 Magic = 0;
+		uint32 Version = 0;
+		int32 NumEntries = 0;
+		Reader << Magic << Version << NumEntries;
+		if (Magic != FileMagic || Version != FileVersion || NumEntries < 0)
+		{
+			return false;
+		}
+
+		const int64 Now = FDateTime::UtcNow().GetTicks();
+		Entries.Reserve(NumEntries);
+		for (int32 Index = 0; Index < NumEntries && !Reader.IsError(); ++Index)
+		{
+			FString TrackId;
+			FEntry Entry;
+			Reader << TrackId << Entry.Url << Entry.ExpiresAt;
+			if (Entry.ExpiresAt > Now)
+			{
+				Entries.Add(MoveTemp(TrackId), MoveTemp(Entry));
+			}
+		}
+
+		if (Reader.IsError())
+		{
+			UE_LOG(LogTemp, Error, TEXT("Spotify preview url cache is corrupted: %s"), *Path);
+			Entries.Reset();
+			return false;
+		}
+
+		return true;
+	}
+
+	/**
+	 * Writes the unexpired entries to disk in a single write.
+	 * @param Path The file to save to.
+	 * @return True if the file was written.
+	 */
+	bool Save(const FString& Path = GetDefaultPath())
+	{
+		FScopeLock Lock(&Mutex);
+
+		const int64 Now = FDateTime::UtcNow().GetTicks();
+		for (auto It = Entries.CreateIterator(); It; ++It)
+		{
+			if (It.Value().ExpiresAt <= Now)
+			{
+				It.RemoveCurrent();
+			}
+		}
+
+		TArray<uint8> Bytes;
+		FMemoryWriter Writer(Bytes);
+
+		uint32 Magic = FileMagic;
+		uint32 Version = FileVersion;
+		int32 NumEntries = Entries.Num();
+		Writer << Magic << Version << NumEntries;
+
+		for (TPair<FString, FEntry>& Pair : Entries)
+		{
+			Writer << Pair.Key << Pair.Value.Url << Pair.Value.ExpiresAt;
+		}
+
+		return FFileHelper::SaveArrayToFile(Bytes, *Path);
+	}
+
+	/**
+	 * Looks up the preview url of a track.
+	 * @param TrackId The ID of the Spotify track.
+	 * @param OutUrl The preview url, empty if the track is known to have no preview.
+	 * @return True if an unexpired entry (positive or negative) was found.
+	 */
+	bool Find(const FString& TrackId, FString& OutUrl) const
+	{
+		FScopeLock Lock(&Mutex);
+		const FEntry* Entry = Entries.Find(TrackId);
+		if (!Entry || Entry->ExpiresAt <= FDateTime::UtcNow().GetTicks())
+		{
+			return false;
+		}
+
+		OutUrl = Entry->Url;
+		return true;
+	}
+
+	/**
+	 * Stores the preview url of a track, an empty url records that the track has no preview.
+	 */
+	void Store(const FString& TrackId, const FString& Url)
+	{
+		FScopeLock Lock(&Mutex);
+		const FTimespan TimeToLive = Url.IsEmpty() ? NegativeTimeToLive : PositiveTimeToLive;
+		Entries.Add(TrackId, { Url, (FDateTime::UtcNow() + TimeToLive).GetTicks() });
+	}
+
+	void SetTimeToLive(const FTimespan InPositiveTimeToLive, const FTimespan InNegativeTimeToLive)
+	{
+		FScopeLock Lock(&Mutex);
+		PositiveTimeToLive = InPositiveTimeToLive;
+		NegativeTimeToLive = InNegativeTimeToLive;
+	}
+
+	int32 Num() const
+	{
+		FScopeLock Lock(&Mutex);
+		return Entries.Num();
+	}
+
+	void Clear()
+	{
+		FScopeLock Lock(&Mutex);
+		Entries.Reset();
+	}
+
+	/**
+	 * Resolves the preview urls of many tracks, serving known tracks from the store.
+	 * Only unknown or expired tracks are scraped, up to MaxConcurrentRequests at once, and the store is
+	 * saved to disk once complete. Failed requests are not stored, so they are retried next time.
+	 * @param Cache The store to read from and update.
+	 * @param TrackIds The IDs of the Spotify tracks, duplicates are only resolved once.
+	 * @param Callback A function that will be called with the preview urls (in the same order as TrackIds, empty if the track has no preview) and the IDs that failed.
+	 * @param MaxConcurrentRequests The maximum number of embed pages requested at once.
+	 * @return A handle to cancel the remaining requests, the callback is then never called.
+	 */
+	static FSpotifyRequestHandle RequestPreviewUrls(const TSharedRef<FPreviewUrlCache, ESPMode::ThreadSafe>& Cache, const TArray<FString>& TrackIds, TFunction<void(const TArray<FString>& PreviewUrls, const TArray<FString>& FailedTrackIds)> Callback, const int MaxConcurrentRequests = 8)
+	{
+		FCancellationTokenRef Token = MakeShared<FCancellationToken, ESPMode::ThreadSafe>();
+
+		TSharedRef<TArray<FString>, ESPMode::ThreadSafe> MissingTrackIds = MakeShared<TArray<FString>, ESPMode::ThreadSafe>();
+		{
+			TSet<FString> SeenTrackIds;
+			FString PreviewUrl;
+			for (const FString& TrackId : TrackIds)
+			{
+				bool bAlreadySeen = false;
+				SeenTrackIds.Add(TrackId, &bAlreadySeen);
+				if (!bAlreadySeen && !Cache->Find(TrackId, PreviewUrl))
+				{
+					MissingTrackIds->Add(TrackId);
+				}
+			}
+		}
+
+		// Requests that failed, each slot is only written by its own task.
+		TSharedRef<TArray<bool>, ESPMode::ThreadSafe> Failed = MakeShared<TArray<bool>, ESPMode::ThreadSafe>();
+		Failed->SetNumZeroed(MissingTrackIds->Num());
+
+		FRequestBatcher::Run(MissingTrackIds->Num(), MaxConcurrentRequests, [=](int32 Index, TFunction<void()> Done)
+		{
+			if (Token->IsCancelled())
+			{
+				return;
+			}
+
+			const FString& TrackId = (*MissingTrackIds)[Index];
+			FSpotifyTracks::RequestTrackPreviewUrlImpl(TrackId, [=](int ResponseCode, const FString& PreviewUrl, const FString& RetryAfter)
+			{
+				// A missing track will never get a preview, anything else may be transient.
+				if (ResponseCode == 200 || ResponseCode == 404)
+				{
+					Cache->Store(TrackId, PreviewUrl);
+				}
+				else
+				{
+					UE_LOG(LogTemp, Error, TEXT("Spotify Track Preview Url request failed (%d): %s"), ResponseCode, *TrackId);
+					(*Failed)[Index] = true;
+				}
+				Done();
+			});
+		},
+		[=]()
+		{
+			if (MissingTrackIds->Num() > 0)
+			{
+				Cache->Save();
+			}
+
+			TSet<FString> FailedTrackIdSet;
+			for (int32 Index = 0; Index < MissingTrackIds->Num(); ++Index)
+			{
+				if ((*Failed)[Index])
+				{
+					FailedTrackIdSet.Add((*MissingTrackIds)[Index]);
+				}
+			}
+
+			TArray<FString> PreviewUrls;
+			PreviewUrls.SetNum(TrackIds.Num());
+			for (int32 Index = 0; Index < TrackIds.Num(); ++Index)
+			{
+				Cache->Find(TrackIds[Index], PreviewUrls[Index]);
+			}
+
+			FAsyncDecode::Deliver([Callback, Token, PreviewUrls = MoveTemp(PreviewUrls), FailedTrackIds = FailedTrackIdSet.Array()]()
+			{
+				if (!Token->IsCancelled())
+				{
+					Callback(PreviewUrls, FailedTrackIds);
+				}
+			});
+		});
+
+		return FSpotifyRequestHandle(Token);
+	}
+
+private:
+	struct FEntry
+	{
+		FString Url;
+		// UTC ticks.
+		int64 ExpiresAt = 0;
+	};
+
+	// Bump FileVersion whenever the record layout changes, older files are then ignored.
+	static constexpr uint32 FileMagic = 0x53505055; // 'SPPU'
+	static constexpr uint32 FileVersion = 1;
+
+	mutable FCriticalSection Mutex;
+	TMap<FString, FEntry> Entries;
+	FTimespan PositiveTimeToLive = FTimespan::FromDays(7.0);
+	FTimespan NegativeTimeToLive = FTimespan::FromDays(1.0);
+};
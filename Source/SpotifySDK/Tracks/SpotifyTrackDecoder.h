@@ -0,0 +1,343 @@
+﻿// Copyright (c) Harris Barra. (MIT License)
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+#include "RequestUtils.h"
+#include "Serialization/JsonReader.h"
+#include "SpotifySDK/Tracks/TrackProfile.h"
+
+class FSpotifyTrackDecoder
+{
+public:
+	// This is a streaming decoder for track payloads.
+	// It walks the JSON token stream once and writes straight into FTrackProfile records,
+	// so no FJsonObject DOM is built and any subtree we never read (available_markets,
+	// external_ids, the rest of the album object, ...) is skipped without allocating.
+
+	/**
+	 * Decodes a single page of the playlist tracks endpoint.
+	 * Locally added tracks and unavailable (null) tracks are skipped.
+	 * ENDPOINT: https://developer.spotify.com/documentation/web-api/reference/get-playlists-tracks
+	 * @param ResponseStr The raw response body of the page.
+	 * @param OutTracks The array the decoded tracks are appended to, callers should reserve it up front.
+	 * @return The total number of tracks reported by the endpoint, or -1 if the payload was malformed.
+	 */
+	static int DecodePlaylistTracksPage(const FString& ResponseStr, TArray<FTrackProfile>& OutTracks)
+	{
+		TRACE_CPUPROFILER_EVENT_SCOPE(SpotifySDK_DecodePlaylistTracksPage);
+
+		TSharedRef<TJsonReader<>> Reader = FRequestUtils::CreateJsonReader(ResponseStr);
+		EJsonNotation Notation;
+
+		if (!Reader->ReadNext(Notation) || Notation != EJsonNotation::ObjectStart)
+		{
+			return -1;
+		}
+
+		int TotalTracks = -1;
+		while (Reader->ReadNext(Notation) && Notation != EJsonNotation::ObjectEnd)
+		{
+			if (IsField(*Reader, TEXT("total")) && Notation == EJsonNotation::Number)
+			{
+				TotalTracks = static_cast<int>(Reader->GetValueAsNumber());
+			}
+			else if (IsField(*Reader, TEXT("items")) && Notation == EJsonNotation::ArrayStart)
+			{
+				if (!DecodePlaylistItems(*Reader, OutTracks))
+				{
+					return -1;
+				}
+			}
+			else if (!SkipValue(*Reader, Notation))
+			{
+				return -1;
+			}
+		}
+
+		return Notation == EJsonNotation::ObjectEnd ? TotalTracks : -1;
+	}
+
+	/**
+	 * Decodes a response of the several tracks endpoint.
+	 * Entries stay aligned with the requested ids, unknown ids (null entries) are left unset.
+	 * ENDPOINT: https://developer.spotify.com/documentation/web-api/reference/get-several-tracks
+	 * @param ResponseStr The raw response body.
+	 * @param OutTracks The array the decoded tracks are appended to, one entry per requested id.
+	 * @return False if the payload was malformed.
+	 */
+	static bool DecodeTracks(const FString& ResponseStr, TArray<TOptional<FTrackProfile>>& OutTracks)
+	{
+		TRACE_CPUPROFILER_EVENT_SCOPE(SpotifySDK_DecodeTracks);
+
+		TSharedRef<TJsonReader<>> Reader = FRequestUtils::CreateJsonReader(ResponseStr);
+		EJsonNotation Notation;
+
+		if (!Reader->ReadNext(Notation) || Notation != EJsonNotation::ObjectStart)
+		{
+			return false;
+		}
+
+		while (Reader->ReadNext(Notation) && Notation != EJsonNotation::ObjectEnd)
+		{
+			if (IsField(*Reader, TEXT("tracks")) && Notation == EJsonNotation::ArrayStart)
+			{
+				while (Reader->ReadNext(Notation) && Notation != EJsonNotation::ArrayEnd)
+				{
+					TOptional<FTrackProfile>& Track = OutTracks.AddDefaulted_GetRef();
+					if (Notation == EJsonNotation::ObjectStart)
+					{
+						FTrackProfile& Profile = Track.Emplace();
+						Profile.DurationMs = 0;
+						if (!DecodeTrack(*Reader, Profile))
+						{
+							return false;
+						}
+					}
+					else if (!SkipValue(*Reader, Notation))
+					{
+						return false;
+					}
+				}
+
+				if (Notation != EJsonNotation::ArrayEnd)
+				{
+					return false;
+				}
+			}
+			else if (!SkipValue(*Reader, Notation))
+			{
+				return false;
+			}
+		}
+
+		return Notation == EJsonNotation::ObjectEnd;
+	}
+
+	/**
+	 * Decodes a single track object, the reader must be positioned just after the object's ObjectStart.
+	 * ENDPOINT: https://developer.spotify.com/documentation/web-api/reference/get-track
+	 * @param Reader The JSON reader.
+	 * @param OutProfile The profile the track fields are written to.
+	 * @return True if the object was fully consumed.
+	 */
+	static bool DecodeTrack(TJsonReader<>& Reader, FTrackProfile& OutProfile)
+	{
+		EJsonNotation Notation;
+		while (Reader.ReadNext(Notation) && Notation != EJsonNotation::ObjectEnd)
+		{
+			bool bDecoded = true;
+			if (Notation == EJsonNotation::String && IsField(Reader, TEXT("name")))
+			{
+				OutProfile.Name = Reader.GetValueAsString();
+			}
+			else if (Notation == EJsonNotation::String && IsField(Reader, TEXT("id")))
+			{
+				OutProfile.TrackId = Reader.GetValueAsString();
+			}
+			else if (Notation == EJsonNotation::Number && IsField(Reader, TEXT("duration_ms")))
+			{
+				OutProfile.DurationMs = static_cast<int>(Reader.GetValueAsNumber());
+			}
+			else if (Notation == EJsonNotation::ArrayStart && IsField(Reader, TEXT("artists")))
+			{
+				bDecoded = DecodeArtists(Reader, OutProfile);
+			}
+			else if (Notation == EJsonNotation::ObjectStart && IsField(Reader, TEXT("album")))
+			{
+				bDecoded = DecodeAlbum(Reader, OutProfile);
+			}
+			else
+			{
+				bDecoded = SkipValue(Reader, Notation);
+			}
+
+			if (!bDecoded)
+			{
+				return false;
+			}
+		}
+
+		return Notation == EJsonNotation::ObjectEnd;
+	}
+
+private:
+	static bool DecodePlaylistItems(TJsonReader<>& Reader, TArray<FTrackProfile>& OutTracks)
+	{
+		EJsonNotation Notation;
+		while (Reader.ReadNext(Notation) && Notation != EJsonNotation::ArrayEnd)
+		{
+			if (Notation != EJsonNotation::ObjectStart)
+			{
+				if (!SkipValue(Reader, Notation))
+				{
+					return false;
+				}
+				continue;
+			}
+
+			// "is_local" may come after "track", so decode first and only keep the record once the item is closed.
+			FTrackProfile Profile;
+			Profile.DurationMs = 0;
+			bool bIsLocalTrack = false;
+			bool bHasTrack = false;
+
+			while (Reader.ReadNext(Notation) && Notation != EJsonNotation::ObjectEnd)
+			{
+				bool bDecoded = true;
+				if (Notation == EJsonNotation::Boolean && IsField(Reader, TEXT("is_local")))
+				{
+					bIsLocalTrack = Reader.GetValueAsBoolean();
+				}
+				else if (Notation == EJsonNotation::ObjectStart && IsField(Reader, TEXT("track")))
+				{
+					bHasTrack = true;
+					bDecoded = DecodeTrack(Reader, Profile);
+				}
+				else
+				{
+					bDecoded = SkipValue(Reader, Notation);
+				}
+
+				if (!bDecoded)
+				{
+					return false;
+				}
+			}
+
+			// We need to verify that the track is not a locally added track as there are no preview URLs
+			// for those tracks.
+			if (bHasTrack && !bIsLocalTrack)
+			{
+				OutTracks.Add(MoveTemp(Profile));
+			}
+		}
+
+		return Notation == EJsonNotation::ArrayEnd;
+	}
+
+	static bool DecodeArtists(TJsonReader<>& Reader, FTrackProfile& OutProfile)
+	{
+		EJsonNotation Notation;
+		while (Reader.ReadNext(Notation) && Notation != EJsonNotation::ArrayEnd)
+		{
+			if (Notation != EJsonNotation::ObjectStart)
+			{
+				if (!SkipValue(Reader, Notation))
+				{
+					return false;
+				}
+				continue;
+			}
+
+			FString& Artist = OutProfile.Artists.AddDefaulted_GetRef();
+			while (Reader.ReadNext(Notation) && Notation != EJsonNotation::ObjectEnd)
+			{
+				if (Notation == EJsonNotation::String && IsField(Reader, TEXT("name")))
+				{
+					Artist = Reader.GetValueAsString();
+				}
+				else if (!SkipValue(Reader, Notation))
+				{
+					return false;
+				}
+			}
+		}
+
+		return Notation == EJsonNotation::ArrayEnd;
+	}
+
+	static bool DecodeAlbum(TJsonReader<>& Reader, FTrackProfile& OutProfile)
+	{
+		EJsonNotation Notation;
+		while (Reader.ReadNext(Notation) && Notation != EJsonNotation::ObjectEnd)
+		{
+			bool bDecoded = true;
+			if (Notation == EJsonNotation::String && IsField(Reader, TEXT("id")))
+			{
+				OutProfile.AlbumId = Reader.GetValueAsString();
+			}
+			else if (Notation == EJsonNotation::String && IsField(Reader, TEXT("name")))
+			{
+				OutProfile.AlbumName = Reader.GetValueAsString();
+			}
+			else if (Notation == EJsonNotation::String && IsField(Reader, TEXT("release_date")))
+			{
+				OutProfile.AlbumReleaseDate = Reader.GetValueAsString();
+			}
+			else if (Notation == EJsonNotation::ArrayStart && IsField(Reader, TEXT("images")))
+			{
+				bDecoded = DecodeFirstImageUrl(Reader, OutProfile.ImgUrl);
+			}
+			else
+			{
+				bDecoded = SkipValue(Reader, Notation);
+			}
+
+			if (!bDecoded)
+			{
+				return false;
+			}
+		}
+
+		return Notation == EJsonNotation::ObjectEnd;
+	}
+
+	/**
+	 * Reads the first image url of an images array and skips the rest.
+	 */
+	static bool DecodeFirstImageUrl(TJsonReader<>& Reader, FString& OutUrl)
+	{
+		EJsonNotation Notation;
+		while (Reader.ReadNext(Notation) && Notation != EJsonNotation::ArrayEnd)
+		{
+			if (Notation != EJsonNotation::ObjectStart || !OutUrl.IsEmpty())
+			{
+				if (!SkipValue(Reader, Notation))
+				{
+					return false;
+				}
+				continue;
+			}
+
+			while (Reader.ReadNext(Notation) && Notation != EJsonNotation::ObjectEnd)
+			{
+				if (IsField(Reader, TEXT("url")) && Notation == EJsonNotation::String)
+				{
+					OutUrl = Reader.GetValueAsString();
+				}
+				else if (!SkipValue(Reader, Notation))
+				{
+					return false;
+				}
+			}
+		}
+
+		return Notation == EJsonNotation::ArrayEnd;
+	}
+
+	/**
+	 * Skips the value that was just read, including its whole subtree for objects and arrays.
+	 */
+	static bool SkipValue(TJsonReader<>& Reader, const EJsonNotation Notation)
+	{
+		switch (Notation)
+		{
+		case EJsonNotation::ObjectStart:
+			return Reader.SkipObject();
+		case EJsonNotation::ArrayStart:
+			return Reader.SkipArray();
+		case EJsonNotation::Error:
+			return false;
+		default:
+			return true;
+		}
+	}
+
+	static bool IsField(const TJsonReader<>& Reader, const TCHAR* FieldName)
+	{
+		// FString comparisons are case-insensitive by default, JSON keys are not.
+		return Reader.GetIdentifier().Equals(FieldName, ESearchCase::CaseSensitive);
+	}
+};
@@ -2,45 +2,97 @@
 
 #pragma once
 
+#include "MultiIdRequest.h"
 #include "RequestUtils.h"
-#include "SpotifyTracks.generated.h"
-
-USTRUCT(BlueprintType)
-struct FTrackProfile
-{
-	GENERATED_BODY()
-
-public:
-	UPROPERTY(BlueprintReadWrite)
-	FString Name;
-	UPROPERTY(BlueprintReadWrite)
-	FString TrackId;
-	UPROPERTY(BlueprintReadWrite)
-	int DurationMs;
-	UPROPERTY(BlueprintReadWrite)
-	TArray<FString> Artists;
-	UPROPERTY(BlueprintReadWrite)
-	FString AlbumReleaseDate;
-	UPROPERTY(BlueprintReadWrite)
-	FString AlbumId;
-	UPROPERTY(BlueprintReadWrite)
-	FString ImgUrl;
-};
+#include "SpotifyResult.h"
+#include "SpotifySDK/Tracks/SpotifyTrackDecoder.h"
+#include "SpotifySDK/Tracks/TrackProfile.h"
+#include <cstring>
 
 class FSpotifyTracks
 {
 public:
+	/**
+	 * Requests the track details of many tracks.
+	 * The ids are split into chunks of the endpoint's batch limit (50), which are requested concurrently.
+	 * ENDPOINT: https://developer.spotify.com/documentation/web-api/reference/get-several-tracks
+	 * @param UserToken The access token for the Spotify user.
+	 * @param TrackIds The IDs of the Spotify tracks.
+	 * @param Callback A function that will be called with the tracks (in the same order as TrackIds) and the IDs that failed or were not found.
+	 * @param MaxConcurrentRequests The maximum number of chunk requests in flight.
+	 * @param OnFailure An optional function that will be called with the first error before Callback if any chunk failed.
+	 * @return A handle to cancel the request.
+	 */
+	static FSpotifyRequestHandle RequestTracks(const FString& UserToken, const TArray<FString>& TrackIds, TFunction<void(const TArray<FTrackProfile>& Tracks, const TArray<FString>& FailedTrackIds)> Callback, const int MaxConcurrentRequests = 4, TFunction<void(const FSpotifyError& Error)> OnFailure = nullptr)
+	{
+		return FMultiIdRequest::Run<FTrackProfile>(UserToken, TEXT("tracks"), TrackIds, TracksChunkSize, MaxConcurrentRequests,
+			[](const FString& ResponseStr, TArray<TOptional<FTrackProfile>>& OutTracks)
+			{
+				return FSpotifyTrackDecoder::DecodeTracks(ResponseStr, OutTracks);
+			},
+			Callback, OnFailure
+		);
+	}
+
 	/**
 	 * Requests the Track Preview URL for a Spotify track.
 	 * WARNING: This method is a bit hacky as it parses the HTML response from the Spotify embed URL.
 	 * As of August 2025 there is no official direct API endpoint to get the preview URL.
 	 * @param TrackId The ID of the Spotify track.
 	 * @param Callback A function that will be called with the preview URL.
+	 * @param OnFailure An optional function that will be called with the error if the request fails.
+	 * @return A handle to cancel the request.
+	 */
+	static FSpotifyRequestHandle RequestTrackPreviewUrl(const FString& TrackId, TFunction<void(const FString& Url)> Callback, TFunction<void(const FSpotifyError& Error)> OnFailure = nullptr)
+	{
+		FCancellationTokenRef Token = MakeShared<FCancellationToken, ESPMode::ThreadSafe>();
+
+		RequestTrackPreviewUrlImpl(TrackId, [TrackId, Callback, OnFailure](int ResponseCode, const FString& PreviewUrl, const FString& RetryAfter)
+		{
+			if (ResponseCode == 200)
+			{
+				UE_LOG(LogTemp, Verbose, TEXT("Got Preview Url: %s"), *PreviewUrl);
+
+				FAsyncDecode::Deliver([Callback, PreviewUrl]() { Callback(PreviewUrl); });
+			}
+			else if (OnFailure)
+			{
+				FAsyncDecode::Deliver([OnFailure, Error = FSpotifyError::FromResponse(ResponseCode, FString(), RetryAfter)]() { OnFailure(Error); });
+			}
+			else
+			{
+				FString ErrorStr = TEXT("Spotify Track Preview Url request failed!!!");
+				UE_LOG(LogTemp, Error, TEXT("%s"), *ErrorStr);
+				UE_LOG(LogTemp, Error, TEXT("Request Error (%d): %s"), ResponseCode, *TrackId);
+			}
+		}, Token);
+
+		return FSpotifyRequestHandle(Token);
+	}
+
+	/**
+	 * Future based variant of RequestTrackPreviewUrl, the value is empty if the track has no preview.
+	 */
+	static TSpotifyFuture<FString> RequestTrackPreviewUrlAsync(const FString& TrackId)
+	{
+		TSpotifyPromise<FString> Promise;
+		Promise.SetCancelHandler(RequestTrackPreviewUrl(TrackId, Promise.GetValueCallback(), Promise.GetErrorCallback()));
+		return Promise.GetFuture();
+	}
+
+	/**
+	 * Internal implementation of the RequestTrackPreviewUrl function.
+	 * Its callback runs on a task graph worker and is always called, with the response code (0 if no response),
+	 * the preview url (empty if the track has no preview or the request failed) and the Retry-After header of a failed response.
+	 * Nothing is logged, failures are left to the caller.
+	 * @param CancellationToken If cancelled, the request is aborted and the callback is never called.
+	 * The token's OnCancelled listener is taken, so it must not be shared with other requests.
 	 */
-	static void RequestTrackPreviewUrl(const FString& TrackId, TFunction<void(const FString& Url)> Callback)
+	static void RequestTrackPreviewUrlImpl(const FString& TrackId, TFunction<void(int ResponseCode, const FString& Url, const FString& RetryAfter)> Callback, const FCancellationTokenPtr& CancellationToken = nullptr)
 	{
 		FString BaseUrl = FString::Printf(
-			TEXT("https://open.spotify.com/embed/track/%s"),
+			TEXT("%s/track/%s"),
+			*FRequestUtils::GetEmbedBaseUrl(),
 			*TrackId
 		);
 
@@ -48,43 +100,100 @@ public:
 		TSharedRef<IHttpRequest> HttpRequest = FRequestUtils::CreateGETRequest(BaseUrl, Headers);
 
 		HttpRequest->OnProcessRequestComplete().BindLambda(
-			[Callback](FHttpRequestPtr Request, FHttpResponsePtr Response, bool bConnectedSuccessfully)
+			[Callback, CancellationToken](FHttpRequestPtr Request, FHttpResponsePtr Response, bool bConnectedSuccessfully)
 			{
-				if (bConnectedSuccessfully && Response.IsValid() && Response->GetResponseCode() == 200)
+				if (FRequestUtils::IsCancelled(CancellationToken))
 				{
-					FString ResponseStr = Response->GetContentAsString();
-					FString PreviewUrl;
-
-					// Parse the response string to find the preview URL
-					// This is a bit hacky, but Spotify's embed URL will return the preview URL
-					// We cannot source the URL directly from the API, so we have to parse it from the HTML response.
-					const FString SearchKey = TEXT("audioPreview\":{\"url\":\"");
-					int32 StartIndex = ResponseStr.Find(SearchKey, ESearchCase::IgnoreCase, ESearchDir::FromStart);
+					return;
+				}
 
-					if (StartIndex != -1)
+				// Scanning a few hundred KB of HTML is kept off the game thread.
+				FAsyncDecode::Launch([Callback, CancellationToken, Response, bConnectedSuccessfully]()
+				{
+					if (FRequestUtils::IsCancelled(CancellationToken))
 					{
-						StartIndex += SearchKey.Len();
-						int32 EndIndex = ResponseStr.Find(TEXT("\""), ESearchCase::IgnoreCase, ESearchDir::FromStart, StartIndex);
-
-						if (EndIndex != -1 && EndIndex > StartIndex)
-						{
-							PreviewUrl = ResponseStr.Mid(StartIndex, EndIndex - StartIndex);
-						}
+						return;
 					}
 
-					UE_LOG(LogTemp, Error, TEXT("Got Preview Url: %s"), *PreviewUrl);
+					if (bConnectedSuccessfully && Response.IsValid() && Response->GetResponseCode() == 200)
+					{
+						FString PreviewUrl;
+						ExtractPreviewUrl(Response->GetContent(), PreviewUrl);
+						Callback(200, PreviewUrl, FString());
+					}
+					else
+					{
+						// Failures are reported by the callers, a missing track (404) is an expected result for FPreviewUrlCache.
+						const bool bHasResponse = bConnectedSuccessfully && Response.IsValid();
+						Callback(bHasResponse ? Response->GetResponseCode() : 0, FString(), bHasResponse ? Response->GetHeader(TEXT("Retry-After")) : FString());
+					}
+				});
+			}
+		);
 
-					Callback(PreviewUrl);
+		if (CancellationToken.IsValid())
+		{
+			CancellationToken->SetOnCancelled([WeakRequest = TWeakPtr<IHttpRequest>(HttpRequest)]()
+			{
+				if (TSharedPtr<IHttpRequest> PinnedRequest = WeakRequest.Pin())
+				{
+					PinnedRequest->CancelRequest();
 				}
-				else
+			});
+		}
+
+		HttpRequest->ProcessRequest();
+	}
+
+	/**
+	 * Extracts the preview url from the raw (UTF-8) embed page.
+	 * This is a bit hacky, but Spotify's embed URL will return the preview URL
+	 * We cannot source the URL directly from the API, so we have to parse it from the HTML response.
+	 * The key and the url are plain ASCII, so the page is searched as bytes and only the url itself is
+	 * converted, the rest of the page is never widened to an FString.
+	 * @param Content The raw response body.
+	 * @param OutUrl The preview url, empty if the track has no preview.
+	 * @return True if a preview url was found.
+	 */
+	static bool ExtractPreviewUrl(TConstArrayView<uint8> Content, FString& OutUrl)
+	{
+		static constexpr ANSICHAR SearchKey[] = "audioPreview\":{\"url\":\"";
+		static constexpr int32 SearchKeyLen = UE_ARRAY_COUNT(SearchKey) - 1;
+
+		OutUrl.Reset();
+
+		const uint8* Data = Content.GetData();
+		const uint8* const End = Data + Content.Num();
+
+		// Jump between occurrences of the first key byte with memchr and only compare the key there.
+		while (End - Data >= SearchKeyLen)
+		{
+			const uint8* Candidate = static_cast<const uint8*>(memchr(Data, SearchKey[0], (End - Data) - SearchKeyLen + 1));
+			if (!Candidate)
+			{
+				return false;
+			}
+
+			if (FMemory::Memcmp(Candidate, SearchKey, SearchKeyLen) == 0)
+			{
+				const uint8* UrlBegin = Candidate + SearchKeyLen;
+				const uint8* UrlEnd = static_cast<const uint8*>(memchr(UrlBegin, '"', End - UrlBegin));
+				if (!UrlEnd || UrlEnd == UrlBegin)
 				{
-					FString ErrorStr = TEXT("Spotify Track Preview Url request failed!!!");
-					UE_LOG(LogTemp, Error, TEXT("%s"), *ErrorStr);
-					UE_LOG(LogTemp, Error, TEXT("Request Error: %s"), *Response->GetContentAsString());
+					return false;
 				}
+
+				OutUrl = FString(FUTF8ToTCHAR(reinterpret_cast<const UTF8CHAR*>(UrlBegin), UE_PTRDIFF_TO_INT32(UrlEnd - UrlBegin)));
+				return true;
 			}
-		);
 
-		HttpRequest->ProcessRequest();
+			Data = Candidate + 1;
+		}
+
+		return false;
 	}
+
+private:
+	// Maximum number of ids accepted by the several tracks endpoint.
+	static constexpr int32 TracksChunkSize = 50;
 };
@@ -0,0 +1,45 @@
+﻿// Copyright (c) Harris Barra. (MIT License)
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "TrackProfile.generated.h"
+
+USTRUCT(BlueprintType)
+struct FTrackProfile
+{
+	GENERATED_BODY()
+
+public:
+	UPROPERTY(BlueprintReadWrite)
+	FString Name;
+	UPROPERTY(BlueprintReadWrite)
+	FString TrackId;
+	UPROPERTY(BlueprintReadWrite)
+	int DurationMs;
+	UPROPERTY(BlueprintReadWrite)
+	TArray<FString> Artists;
+	UPROPERTY(BlueprintReadWrite)
+	FString AlbumReleaseDate;
+	UPROPERTY(BlueprintReadWrite)
+	FString AlbumId;
+	UPROPERTY(BlueprintReadWrite)
+	FString AlbumName;
+	UPROPERTY(BlueprintReadWrite)
+	FString ImgUrl;
+
+	/**
+	 * Compares everything but the TrackId, e.g. to detect a refetched track that was renamed or moved to another album.
+	 */
+	bool HasSameMetadata(const FTrackProfile& Other) const
+	{
+		return Name == Other.Name && DurationMs == Other.DurationMs && Artists == Other.Artists && AlbumReleaseDate == Other.AlbumReleaseDate
+			&& AlbumId == Other.AlbumId && AlbumName == Other.AlbumName && ImgUrl == Other.ImgUrl;
+	}
+};
+
+/**
+ * An immutable track shared by the library store, the search index and anything else holding library tracks,
+ * so a track that appears in many playlists is held once. See FSpotifyLibraryCache::ShareTracks.
+ */
+using FTrackProfileRef = TSharedRef<const FTrackProfile, ESPMode::ThreadSafe>;
@@ -0,0 +1,308 @@
+﻿// Copyright (c) Harris Barra. (MIT License)
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/BitArray.h"
+#include "Misc/ScopeRWLock.h"
+#include "SpotifySDK/Tracks/TrackProfile.h"
+
+class FTrackStore
+{
+public:
+	// This is a library-wide track store shared by every playlist.
+	// Each distinct track is held once and playlists only keep the indices of their entries. The tracks
+	// themselves are the shared instances of the library store (see FSpotifyLibraryCache::ShareTracks),
+	// so the store adds no copy of its own. A reverse index maps every track to the playlists that
+	// contain it, so "which playlists contain this track" is a single lookup instead of a full scan.
+	// Track and playlist slots are freed as soon as nothing references them and reused by later
+	// additions, so the store never has to be rebuilt.
+
+	/**
+	 * Replaces the entries of a playlist.
+	 * A track already held with different metadata (e.g. renamed) is replaced for every playlist.
+	 * @param PlaylistId The ID of the Spotify playlist.
+	 * @param Tracks The tracks of the playlist, in playlist order.
+	 */
+	void SetPlaylistTracks(const FString& PlaylistId, const TArray<FTrackProfile>& Tracks)
+	{
+		SetPlaylistTracksImpl(PlaylistId, Tracks);
+	}
+
+	void SetPlaylistTracks(const FString& PlaylistId, const TArray<FTrackProfileRef>& Tracks)
+	{
+		SetPlaylistTracksImpl(PlaylistId, Tracks);
+	}
+
+	void RemovePlaylist(const FString& PlaylistId)
+	{
+		FWriteScopeLock Lock(StoreLock);
+		int32 PlaylistIndex = INDEX_NONE;
+		if (PlaylistIndices.RemoveAndCopyValue(PlaylistId, PlaylistIndex))
+		{
+			ReleasePlaylistLocked(PlaylistIndex);
+		}
+	}
+
+	/**
+	 * Removes every playlist that is not in PlaylistIds.
+	 */
+	void RetainPlaylists(const TSet<FString>& PlaylistIds)
+	{
+		FWriteScopeLock Lock(StoreLock);
+		for (auto It = PlaylistIndices.CreateIterator(); It; ++It)
+		{
+			if (!PlaylistIds.Contains(It.Key()))
+			{
+				ReleasePlaylistLocked(It.Value());
+				It.RemoveCurrent();
+			}
+		}
+	}
+
+	/**
+	 * Get the IDs of the playlists that contain a track.
+	 * @param TrackId The ID of the Spotify track.
+	 * @return The playlist IDs, empty if no playlist contains the track.
+	 */
+	TArray<FString> GetPlaylistsContaining(const FString& TrackId) const
+	{
+		FReadScopeLock Lock(StoreLock);
+
+		TArray<FString> PlaylistIds;
+		if (const int32* TrackIndex = TrackIndices.Find(TrackId))
+		{
+			PlaylistIds.Reserve(TrackPlaylists[*TrackIndex].Num());
+			for (const int32 PlaylistIndex : TrackPlaylists[*TrackIndex])
+			{
+				PlaylistIds.Add(Playlists[PlaylistIndex]);
+			}
+		}
+		return PlaylistIds;
+	}
+
+	/**
+	 * Get the entries of a playlist as copies of their tracks.
+	 * @return False if the playlist is not in the store.
+	 */
+	bool GetPlaylistTracks(const FString& PlaylistId, TArray<FTrackProfile>& OutTracks) const
+	{
+		FReadScopeLock Lock(StoreLock);
+
+		const int32* PlaylistIndex = PlaylistIndices.Find(PlaylistId);
+		if (!PlaylistIndex)
+		{
+			return false;
+		}
+
+		const TArray<int32>& Entries = PlaylistEntries[*PlaylistIndex];
+		OutTracks.Reserve(OutTracks.Num() + Entries.Num());
+		for (const int32 TrackIndex : Entries)
+		{
+			OutTracks.Add(*Tracks[TrackIndex]);
+		}
+		return true;
+	}
+
+	bool FindTrack(const FString& TrackId, FTrackProfile& OutTrack) const
+	{
+		FReadScopeLock Lock(StoreLock);
+
+		const int32* TrackIndex = TrackIndices.Find(TrackId);
+		if (!TrackIndex)
+		{
+			return false;
+		}
+		OutTrack = *Tracks[*TrackIndex];
+		return true;
+	}
+
+	/**
+	 * Get the number of distinct tracks held.
+	 */
+	int32 NumTracks() const
+	{
+		FReadScopeLock Lock(StoreLock);
+		return TrackIndices.Num();
+	}
+
+	/**
+	 * Get the total number of playlist entries, i.e. the number of tracks held without deduplication.
+	 */
+	int32 NumEntries() const
+	{
+		FReadScopeLock Lock(StoreLock);
+		int32 Num = 0;
+		for (const TArray<int32>& Entries : PlaylistEntries)
+		{
+			Num += Entries.Num();
+		}
+		return Num;
+	}
+
+	/**
+	 * Get the memory held by the store itself, the shared tracks are accounted to the library store.
+	 */
+	SIZE_T GetAllocatedSize() const
+	{
+		FReadScopeLock Lock(StoreLock);
+
+		SIZE_T Size = Tracks.GetAllocatedSize() + TrackIndices.GetAllocatedSize() + TrackPlaylists.GetAllocatedSize() + FreeTrackSlots.GetAllocatedSize()
+			+ Playlists.GetAllocatedSize() + PlaylistIndices.GetAllocatedSize() + PlaylistEntries.GetAllocatedSize() + FreePlaylistSlots.GetAllocatedSize();
+		for (const TArray<int32>& Entries : PlaylistEntries)
+		{
+			Size += Entries.GetAllocatedSize();
+		}
+		for (const TArray<int32>& Membership : TrackPlaylists)
+		{
+			Size += Membership.GetAllocatedSize();
+		}
+		return Size;
+	}
+
+private:
+	static FTrackProfileRef ShareTrack(const FTrackProfile& Track) { return MakeShared<const FTrackProfile, ESPMode::ThreadSafe>(Track); }
+	static const FTrackProfileRef& ShareTrack(const FTrackProfileRef& Track) { return Track; }
+
+	static const FTrackProfile& GetTrack(const FTrackProfile& Track) { return Track; }
+	static const FTrackProfile& GetTrack(const FTrackProfileRef& Track) { return *Track; }
+
+	// A shared track replaces any other instance, so the store always holds the library store's instance.
+	static bool IsHeld(const TSharedPtr<const FTrackProfile, ESPMode::ThreadSafe>& Held, const FTrackProfile& Track) { return Held->HasSameMetadata(Track); }
+	static bool IsHeld(const TSharedPtr<const FTrackProfile, ESPMode::ThreadSafe>& Held, const FTrackProfileRef& Track) { return Held.Get() == &Track.Get(); }
+
+	template <typename TrackType>
+	void SetPlaylistTracksImpl(const FString& PlaylistId, const TArray<TrackType>& NewTracks)
+	{
+		FWriteScopeLock Lock(StoreLock);
+
+		const int32 PlaylistIndex = FindOrAddPlaylistLocked(PlaylistId);
+		const TArray<int32> OldEntries = MoveTemp(PlaylistEntries[PlaylistIndex]);
+		TArray<int32>& Entries = PlaylistEntries[PlaylistIndex];
+		Entries.Reset(NewTracks.Num());
+
+		// The new entries are added before the old ones are released, so tracks the playlist keeps keep their slot.
+		TBitArray<> bKept;
+		for (const TrackType& Track : NewTracks)
+		{
+			const int32 TrackIndex = FindOrAddTrackLocked(Track);
+			Entries.Add(TrackIndex);
+
+			// Membership is recorded once per playlist, however often the track appears in it.
+			TrackPlaylists[TrackIndex].AddUnique(PlaylistIndex);
+
+			if (TrackIndex >= bKept.Num())
+			{
+				bKept.Add(false, TrackIndex + 1 - bKept.Num());
+			}
+			bKept[TrackIndex] = true;
+		}
+
+		for (const int32 TrackIndex : OldEntries)
+		{
+			if (TrackIndex >= bKept.Num() || !bKept[TrackIndex])
+			{
+				RemoveMembershipLocked(TrackIndex, PlaylistIndex);
+			}
+		}
+	}
+
+	template <typename TrackType>
+	int32 FindOrAddTrackLocked(const TrackType& Track)
+	{
+		const FTrackProfile& Profile = GetTrack(Track);
+		if (const int32* Existing = TrackIndices.Find(Profile.TrackId))
+		{
+			// A changed track is replaced, the newest metadata then wins for every playlist.
+			TSharedPtr<const FTrackProfile, ESPMode::ThreadSafe>& Held = Tracks[*Existing];
+			if (!IsHeld(Held, Track))
+			{
+				Held = ShareTrack(Track);
+			}
+			return *Existing;
+		}
+
+		int32 TrackIndex;
+		if (FreeTrackSlots.Num() > 0)
+		{
+			TrackIndex = FreeTrackSlots.Pop();
+			Tracks[TrackIndex] = ShareTrack(Track);
+		}
+		else
+		{
+			TrackIndex = Tracks.Add(ShareTrack(Track));
+			TrackPlaylists.AddDefaulted();
+		}
+		TrackIndices.Add(Profile.TrackId, TrackIndex);
+		return TrackIndex;
+	}
+
+	int32 FindOrAddPlaylistLocked(const FString& PlaylistId)
+	{
+		if (const int32* Existing = PlaylistIndices.Find(PlaylistId))
+		{
+			return *Existing;
+		}
+
+		int32 PlaylistIndex;
+		if (FreePlaylistSlots.Num() > 0)
+		{
+			PlaylistIndex = FreePlaylistSlots.Pop();
+			Playlists[PlaylistIndex] = PlaylistId;
+		}
+		else
+		{
+			PlaylistIndex = Playlists.Add(PlaylistId);
+			PlaylistEntries.AddDefaulted();
+		}
+		PlaylistIndices.Add(PlaylistId, PlaylistIndex);
+		return PlaylistIndex;
+	}
+
+	/**
+	 * Drops the entries of a playlist and frees its slot, the caller removes it from PlaylistIndices.
+	 */
+	void ReleasePlaylistLocked(const int32 PlaylistIndex)
+	{
+		const TArray<int32> Entries = MoveTemp(PlaylistEntries[PlaylistIndex]);
+		for (const int32 TrackIndex : Entries)
+		{
+			RemoveMembershipLocked(TrackIndex, PlaylistIndex);
+		}
+
+		Playlists[PlaylistIndex].Empty();
+		FreePlaylistSlots.Add(PlaylistIndex);
+	}
+
+	/**
+	 * Removes a playlist from a track's membership, a track no playlist contains any more is freed.
+	 * Safe to call again for a track that was already freed.
+	 */
+	void RemoveMembershipLocked(const int32 TrackIndex, const int32 PlaylistIndex)
+	{
+		TArray<int32>& Membership = TrackPlaylists[TrackIndex];
+		Membership.RemoveSwap(PlaylistIndex);
+		if (Membership.Num() == 0 && Tracks[TrackIndex].IsValid())
+		{
+			TrackIndices.Remove(Tracks[TrackIndex]->TrackId);
+			Tracks[TrackIndex].Reset();
+			Membership.Empty();
+			FreeTrackSlots.Add(TrackIndex);
+		}
+	}
+
+	mutable FRWLock StoreLock;
+
+	// Null for free slots.
+	TArray<TSharedPtr<const FTrackProfile, ESPMode::ThreadSafe>> Tracks;
+	TMap<FString, int32> TrackIndices;
+	// The playlists (indices into Playlists) containing each track.
+	TArray<TArray<int32>> TrackPlaylists;
+	TArray<int32> FreeTrackSlots;
+
+	// Empty for free slots.
+	TArray<FString> Playlists;
+	TMap<FString, int32> PlaylistIndices;
+	TArray<TArray<int32>> PlaylistEntries;
+	TArray<int32> FreePlaylistSlots;
+};
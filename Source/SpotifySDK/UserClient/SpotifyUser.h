@@ -4,6 +4,7 @@
 
 #include "CoreMinimal.h"
 #include "RequestUtils.h"
+#include "SpotifyResult.h"
 #include "SpotifyUser.generated.h"
 
 USTRUCT(BlueprintType)
@@ -33,43 +34,95 @@ public:
 	 * ENDPOINT: https://developer.spotify.com/documentation/web-api/reference/get-current-users-profile
 	 * @param UserToken The access token for the Spotify user.
 	 * @param Callback A function that will be called with the retrieved profile data.
+	 * @param OnFailure An optional function that will be called with the error if the request fails.
+	 * @return A handle to cancel the request.
 	 */
-	static void RequestUserProfile(const FString& UserToken, TFunction<void(const FUserProfile& Profile)> Callback)
+	static FSpotifyRequestHandle RequestUserProfile(const FString& UserToken, TFunction<void(const FUserProfile& Profile)> Callback, TFunction<void(const FSpotifyError& Error)> OnFailure = nullptr)
 	{
-		FString BaseUrl = TEXT("https://api.spotify.com/v1/me");
+		FCancellationTokenRef Token = MakeShared<FCancellationToken, ESPMode::ThreadSafe>();
+		FString BaseUrl = FRequestUtils::GetApiBaseUrl() + TEXT("/me");
 
-		TMap<FString, FString> Headers;
-		Headers.Add(TEXT("Authorization"), FString::Printf(TEXT("Bearer %s"), *UserToken));
-		TSharedRef<IHttpRequest> HttpRequest = FRequestUtils::CreateGETRequest(BaseUrl, Headers);
-
-		HttpRequest->OnProcessRequestComplete().BindLambda(
-			[Callback](FHttpRequestPtr Request, FHttpResponsePtr Response, bool bConnectedSuccessfully)
+		FRequestUtils::ProcessDecodedGETRequest<FUserProfile>(BaseUrl, UserToken, &ParseUserProfile,
+			[Callback, OnFailure, Token](int ResponseCode, const FString& ResponseStr, const FUserProfile* Profile, const FString& RetryAfter)
 			{
-				if (bConnectedSuccessfully && Response.IsValid() && Response->GetResponseCode() == 200)
+				if (Profile)
 				{
-					FUserProfile Profile;
-					FString ResponseStr = Response->GetContentAsString();
-
-					FRequestUtils::GetFieldEntry(*ResponseStr, "display_name", Profile.Username);
-					FRequestUtils::GetFieldEntry(*ResponseStr, "id", Profile.UserId);
-					FRequestUtils::GetFieldEntry(*ResponseStr, "email", Profile.Email);
-					FRequestUtils::GetFieldEntry(*ResponseStr, "uri", Profile.UserUri);
-
-					TArray<TSharedPtr<FJsonValue>> ImagesArray;
-					FRequestUtils::GetArrayEntry(*ResponseStr, "images", ImagesArray);
-					FRequestUtils::GetFieldEntryAtIndex(ImagesArray, "url", 0, Profile.ImgUrl);
+					FAsyncDecode::Deliver([Callback, Token, Profile = *Profile]()
+					{
+						if (!Token->IsCancelled())
+						{
+							Callback(Profile);
+						}
+					});
+					return;
+				}
 
-					Callback(Profile);
+				FSpotifyError Error;
+				if (ResponseCode == 200)
+				{
+					UE_LOG(LogTemp, Error, TEXT("Spotify User Profile response could not be decoded!!!"));
+					Error = FSpotifyError::Make(ESpotifyErrorType::Decode, ResponseStr);
 				}
 				else
 				{
 					FString ErrorStr = TEXT("Spotify User Profile request failed!!!");
 					UE_LOG(LogTemp, Error, TEXT("%s"), *ErrorStr);
-					UE_LOG(LogTemp, Error, TEXT("Request Error: %s"), *Response->GetContentAsString());
+					UE_LOG(LogTemp, Error, TEXT("Request Error (%d): %s"), ResponseCode, *ResponseStr);
+
+					Error = FSpotifyError::FromResponse(ResponseCode, ResponseStr, RetryAfter);
 				}
-			}
+
+				if (OnFailure)
+				{
+					FAsyncDecode::Deliver([OnFailure, Token, Error]()
+					{
+						if (!Token->IsCancelled())
+						{
+							OnFailure(Error);
+						}
+					});
+				}
+			},
+			ERequestPriority::Interactive,
+			Token
 		);
 
-		HttpRequest->ProcessRequest();
+		return FSpotifyRequestHandle(Token);
+	}
+
+	/**
+	 * Parses the response of the current user's profile endpoint.
+	 * @param ResponseStr The raw response body.
+	 * @param OutProfile The parsed profile.
+	 * @return True if the response was valid JSON.
+	 */
+	static bool ParseUserProfile(const FString& ResponseStr, FUserProfile& OutProfile)
+	{
+		TSharedPtr<FJsonObject> ResponseObject;
+		if (!FRequestUtils::ParseResponseString(ResponseStr, ResponseObject))
+		{
+			return false;
+		}
+
+		FRequestUtils::GetFieldEntry(ResponseObject, "display_name", OutProfile.Username);
+		FRequestUtils::GetFieldEntry(ResponseObject, "id", OutProfile.UserId);
+		FRequestUtils::GetFieldEntry(ResponseObject, "email", OutProfile.Email);
+		FRequestUtils::GetFieldEntry(ResponseObject, "uri", OutProfile.UserUri);
+
+		TArray<TSharedPtr<FJsonValue>> ImagesArray;
+		FRequestUtils::GetArrayEntry(ResponseObject, "images", ImagesArray);
+		FRequestUtils::GetFieldEntryAtIndex(ImagesArray, "url", 0, OutProfile.ImgUrl);
+
+		return true;
+	}
+
+	/**
+	 * Future based variant of RequestUserProfile, cancelling the future cancels the request.
+	 */
+	static TSpotifyFuture<FUserProfile> RequestUserProfileAsync(const FString& UserToken)
+	{
+		TSpotifyPromise<FUserProfile> Promise;
+		Promise.SetCancelHandler(RequestUserProfile(UserToken, Promise.GetValueCallback(), Promise.GetErrorCallback()));
+		return Promise.GetFuture();
 	}
 };